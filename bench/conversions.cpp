@@ -0,0 +1,296 @@
+/*
+ * conversions.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "verify.h"
+
+#include <clocale>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "channelconversation.h"
+#include "detail/conversiontable.h"
+#include "detail/rawfile.h"
+
+namespace {
+
+/// a raw value and the expected result of the conversion
+struct check {
+  double raw;
+  bool integer; // raw is converted as int64_t instead of double
+  const char* raw_text; // raw text of types 9 and 10
+  double value;
+  const char* text; // result text of types 7, 8 and 10
+};
+
+check value(double raw, double result) {
+  check c = { raw, false, nullptr, result, nullptr };
+  return c;
+}
+
+check integer(double raw, double result) {
+  check c = { raw, true, nullptr, result, nullptr };
+  return c;
+}
+
+check value_text(double raw, bool integer, const char* result) {
+  check c = { raw, integer, nullptr, 0, result };
+  return c;
+}
+
+check text_value(const char* raw, double result) {
+  check c = { 0, false, raw, result, nullptr };
+  return c;
+}
+
+check text_text(const char* raw, const char* result) {
+  check c = { 0, false, raw, 0, result };
+  return c;
+}
+
+/// a CC block and the values to convert with it
+struct conversion_case {
+  const char* name;
+  unsigned type;
+  std::vector<double> val;
+  std::vector<const char*> refs; // texts of the TX blocks, nullptr for no link
+  bool valid; // the conversion table can be built
+  std::vector<check> checks;
+  bool comma_locale; // built with a decimal comma in the C locale
+};
+
+std::string nested(std::size_t depth, const std::string& open, const std::string& close) {
+  std::string text;
+  for (std::size_t i = 0; i < depth; i++) {
+    text += open;
+  }
+  text += "X";
+  for (std::size_t i = 0; i < depth; i++) {
+    text += close;
+  }
+  return text;
+}
+
+std::vector<conversion_case> make_cases(std::vector<std::string>& texts) {
+  // formulas too long to write down, kept alive for the refs
+  texts.push_back(nested(40, "(", ")"));
+  texts.push_back(nested(1000, "(", ")"));
+  texts.push_back(nested(40, "-", ""));
+  texts.push_back(nested(1000, "-", ""));
+  texts.push_back(nested(1000, "sin(", ")"));
+
+  const double none = -1;
+  std::vector<conversion_case> cases = {
+    { "formula", 3, { }, { "2*X + 1" }, true,
+      { value(0, 1), value(-3, -5), integer(4, 9) } },
+    { "formula-neg-power", 3, { }, { "-X^2" }, true,
+      { value(3, -9), value(-3, -9) } },
+    { "formula-power", 3, { }, { "2^X^2 + X**2/4" }, true,
+      { value(2, 17), value(0, 1), value(-1, 2.25) } },
+    { "formula-functions", 3, { }, { "sqrt(abs(X)) * (1 - -X)" }, true,
+      { value(4, 10), value(-9, -24) } },
+    { "formula-nested", 3, { }, { texts[0].c_str() }, true, { value(7, 7) } },
+    { "formula-too-deep", 3, { }, { texts[1].c_str() }, false, { } },
+    { "formula-signs", 3, { }, { texts[2].c_str() }, true, { value(7, 7) } },
+    { "formula-too-many-signs", 3, { }, { texts[3].c_str() }, false, { } },
+    { "formula-too-many-calls", 3, { }, { texts[4].c_str() }, false, { } },
+    { "formula-invalid", 3, { }, { "X +" }, false, { } },
+    { "formula-numbers", 3, { }, { "2.5E-1*X + 1e+2 + 3. - .5e1" }, true,
+      { value(4, 99) } },
+    { "formula-comma-locale", 3, { }, { "X*0.5 + 1.5e1" }, true,
+      { value(3, 16.5) }, true },
+
+    // interpolation, outside of the keys the nearest value
+    { "value-to-value", 4, { 0, 0, 10, 100, 20, 50 }, { }, true,
+      { value(5, 50), integer(15, 75), value(2.5, 25), value(-1, 0), integer(30, 50) } },
+
+    // nearest key, the lower one in the middle
+    { "value-to-value-nearest", 5, { 0, 0, 10, 100, 20, 50 }, { }, true,
+      { value(5, 0), integer(5, 0), value(5.5, 100), value(4.5, 0), integer(15, 100),
+        value(15.5, 50), value(-1, 0), integer(30, 50) } },
+
+    // upper bound included for integer raw values only
+    { "range-to-value", 6, { 0, 10, 1, 20, 30, 2, none }, { }, true,
+      { integer(10, 1), value(10, none), value(9.5, 1), integer(15, none),
+        integer(20, 2), integer(30, 2), value(30, none), integer(-5, none) } },
+    { "range-to-value-sparse", 6, { 0, 10, 1, 1e6, 1e6 + 10, 2, none }, { }, true,
+      { integer(10, 1), value(10, none), integer(1e6 + 10, 2), value(1e6 + 10, none),
+        integer(500, none) } },
+
+    { "value-to-text", 7, { 1, 2 }, { "one", "two", "other" }, true,
+      { value_text(1, true, "one"), value_text(2, false, "two"),
+        value_text(3, true, "other"), value_text(1.5, false, "other") } },
+
+    { "range-to-text", 8, { 0, 10, 20, 30 }, { "low", "high", "none" }, true,
+      { value_text(10, true, "low"), value_text(10, false, "none"),
+        value_text(25, false, "high"), value_text(30, true, "high"),
+        value_text(31, true, "none"), value_text(-1, false, "none") } },
+
+    { "text-to-value", 9, { 1, 0, none }, { "on", "off" }, true,
+      { text_value("on", 1), text_value("off", 0), text_value("of", none),
+        text_value("", none) } },
+
+    // no text for b keeps the text, as does no default
+    { "text-to-text", 10, { }, { "a", "A", "b", nullptr, "?" }, true,
+      { text_text("a", "A"), text_text("b", "b"), text_text("c", "?") } },
+    { "text-to-text-no-default", 10, { }, { "a", "A", nullptr }, true,
+      { text_text("a", "A"), text_text("c", "c") } },
+  };
+  return cases;
+}
+
+/// blocks of a file in memory
+class block_image {
+public:
+  block_image() : data_(64, '\0') { }
+
+  const std::string& data() const { return data_; }
+
+  mdf::link block(char c1, char c2, const std::vector<mdf::link>& links,
+      const void* data, std::size_t n) {
+    data_.resize((data_.size() + 7) / 8 * 8);
+    mdf::link begin = data_.size();
+    mdf::block_header header = { mdf::make_id('#', '#'), mdf::make_id(c1, c2), 0,
+        sizeof(header) + links.size() * sizeof(mdf::link) + n, links.size() };
+    append(&header, sizeof(header));
+    append(links.data(), links.size() * sizeof(mdf::link));
+    append(data, n);
+    return begin;
+  }
+
+  mdf::link text(const char* text) {
+    return text ? block('T', 'X', std::vector<mdf::link>(), text, std::strlen(text) + 1) : 0;
+  }
+
+  mdf::link conversion(const conversion_case& c) {
+    // cc_tx_name, cc_md_unit, cc_md_comment, cc_cc_inverse, cc_ref
+    std::vector<mdf::link> links(4);
+    for (const char* ref : c.refs) {
+      links.push_back(text(ref));
+    }
+
+    mdf::ccblock cc = mdf::ccblock();
+    cc.type = c.type;
+    cc.ref_count = c.refs.size();
+    cc.val_count = c.val.size();
+    std::string data(reinterpret_cast<const char*>(&cc), sizeof(cc));
+    data.append(reinterpret_cast<const char*>(c.val.data()), c.val.size() * sizeof(double));
+    return block('C', 'C', links, data.data(), data.size());
+  }
+
+private:
+  std::string data_;
+
+  void append(const void* data, std::size_t n) {
+    data_.append(static_cast<const char*>(data), n);
+  }
+};
+
+std::string describe(const check& c) {
+  return c.raw_text ? "\"" + std::string(c.raw_text) + "\"" :
+      std::to_string(c.raw) + (c.integer ? " (integer)" : "");
+}
+
+std::string run_check(const mdf::conversion_table& table, const check& c) {
+  if (table.get_type() == 10) {
+    std::string result = table.convert_text_to_text(c.raw_text).to_string();
+    return result == c.text ? "" : describe(c) + " gives \"" + result + "\"";
+  }
+
+  double result = table.get_type() == 9 ? table.convert_text(c.raw_text)
+      : c.integer ? table.convert(static_cast<int64_t>(c.raw)) : table.convert(c.raw);
+  if (table.has_text_result()) {
+    std::string text = table.get_texts().at(static_cast<std::size_t>(result)).to_string();
+    return text == c.text ? "" : describe(c) + " gives \"" + text + "\"";
+  }
+  return result == c.value ? "" : describe(c) + " gives " + std::to_string(result);
+}
+
+} // namespace
+
+/// Switch LC_NUMERIC to a locale with a decimal comma, false if none is
+/// installed
+bool set_comma_locale() {
+  const char* const names[] = { "de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8",
+      "fr_FR.utf8", "fr_FR", "nl_NL.UTF-8", "ru_RU.UTF-8" };
+  for (const char* name : names) {
+    if (setlocale(LC_NUMERIC, name) && std::strcmp(localeconv()->decimal_point, ",") == 0) {
+      return true;
+    }
+  }
+  setlocale(LC_NUMERIC, "C");
+  return false;
+}
+
+int verify_conversions() {
+  std::vector<std::string> texts;
+  std::vector<conversion_case> cases = make_cases(texts);
+
+  block_image image;
+  std::vector<mdf::link> links;
+  for (const conversion_case& c : cases) {
+    links.push_back(image.conversion(c));
+  }
+
+  FILE* handle = std::tmpfile();
+  if (!handle || std::fwrite(image.data().data(), 1, image.data().size(), handle) !=
+      image.data().size() || std::fflush(handle) != 0) {
+    throw std::runtime_error("cannot write conversion blocks to temporary file");
+  }
+  mdf::rawfile file(handle);
+
+  int failed = 0;
+  for (std::size_t i = 0; i < cases.size(); i++) {
+    const conversion_case& c = cases[i];
+    std::string numeric = setlocale(LC_NUMERIC, nullptr);
+    if (c.comma_locale && !set_comma_locale()) {
+      printf("%-24s %-20s skipped, no locale with decimal comma\n", "conversion", c.name);
+      continue;
+    }
+
+    std::string failure;
+    try {
+      mdf::channel_conversation conversion(&file, links[i]);
+      const std::shared_ptr<const mdf::conversion_table>& table = conversion.get_table();
+      if (!table) {
+        failure = c.valid ? "no conversion table" : "";
+      } else if (!c.valid) {
+        failure = "invalid conversion is accepted";
+      }
+      for (std::size_t j = 0; j < c.checks.size() && failure.empty(); j++) {
+        failure = run_check(*table, c.checks[j]);
+      }
+    } catch (const std::exception& e) {
+      failure = e.what();
+    }
+    setlocale(LC_NUMERIC, numeric.c_str());
+
+    printf("%-24s %-20s %s%s\n", "conversion", c.name,
+        failure.empty() ? "ok" : "FAIL: ", failure.c_str());
+    if (!failure.empty()) {
+      failed++;
+    }
+  }
+  fflush(stdout);
+  return failed;
+}
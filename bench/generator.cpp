@@ -0,0 +1,702 @@
+/*
+ * generator.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "generator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "detail/mdf4.h"
+#include "detail/rawfile.h"
+#include "writer.h"
+
+namespace {
+
+using mdf::link;
+
+// default block size of compressed data without a given block size
+const uint64_t default_compressed_block_size = 4 << 20;
+
+// links in one DL block
+const std::size_t dl_links = 1024;
+
+struct field {
+  uint8_t data_type; // cn_data_type
+  unsigned bit_count;
+  uint64_t bit_position;
+  bool real;
+  bool big_endian;
+};
+
+field parse_type(const std::string& type, uint64_t& position) {
+  field result = field();
+  std::string name = type;
+  if (name.size() > 2 && name.compare(name.size() - 2, 2, "be") == 0) {
+    result.big_endian = true;
+    name.resize(name.size() - 2);
+  }
+
+  char* end = nullptr;
+  unsigned long bits = name.size() < 2 ? 0 : std::strtoul(name.c_str() + 1, &end, 10);
+  if (bits == 0 || *end != '\0') {
+    throw std::invalid_argument("unknown channel type");
+  }
+
+  bool byte_aligned = true;
+  switch (name[0]) {
+  case 'u':
+  case 'i':
+    if (bits != 8 && bits != 16 && bits != 32 && bits != 64) {
+      throw std::invalid_argument("integer channels have 8, 16, 32 or 64 bits");
+    }
+    result.data_type = name[0] == 'u' ? 0 : 2;
+    break;
+
+  case 'f':
+    if (bits != 32 && bits != 64) {
+      throw std::invalid_argument("float channels have 32 or 64 bits");
+    }
+    result.data_type = 4;
+    result.real = true;
+    break;
+
+  case 'b':
+  case 's':
+    if (bits > 64 || result.big_endian) {
+      throw std::invalid_argument("bit fields are little endian with up to 64 bits");
+    }
+    result.data_type = name[0] == 'b' ? 0 : 2;
+    byte_aligned = false;
+    break;
+
+  default:
+    throw std::invalid_argument("unknown channel type");
+  }
+  if (result.big_endian) {
+    result.data_type++;
+  }
+
+  if (byte_aligned) {
+    position = (position + 7) / 8 * 8;
+  }
+  result.bit_count = bits;
+  result.bit_position = position;
+  position += bits;
+  return result;
+}
+
+std::vector<field> make_layout(const generator_options& options, std::size_t& size) {
+  if (options.types.empty()) {
+    throw std::invalid_argument("no channel types given");
+  }
+
+  // the master channel is a double at byte 0
+  uint64_t position = 64;
+  std::vector<field> fields;
+  for (std::size_t i = 0; i < options.channels; i++) {
+    fields.push_back(parse_type(options.types[i % options.types.size()], position));
+  }
+  size = (position + 7) / 8 + options.padding;
+  return fields;
+}
+
+/// endless stream of the bytes of the records
+class record_source {
+public:
+  record_source(const std::vector<field>& fields, std::size_t record_size, uint32_t seed) :
+      fields_(fields), record_size_(record_size),
+      state_(seed * 0x9e3779b97f4a7c15ull | 1), index_(0),
+      buffer_(record_size * std::max<std::size_t>(1, (1 << 20) / record_size)),
+      pos_(buffer_.size())
+  { }
+
+  void read(char* out, std::size_t n) {
+    while (n != 0) {
+      if (pos_ == buffer_.size()) {
+        for (std::size_t i = 0; i < buffer_.size(); i += record_size_) {
+          fill(&buffer_[i]);
+        }
+        pos_ = 0;
+      }
+      std::size_t k = std::min(n, buffer_.size() - pos_);
+      std::memcpy(out, &buffer_[pos_], k);
+      out += k;
+      pos_ += k;
+      n -= k;
+    }
+  }
+
+private:
+  const std::vector<field>& fields_;
+  std::size_t record_size_;
+  uint64_t state_;
+  uint64_t index_;
+  std::vector<char> buffer_;
+  std::size_t pos_;
+
+  // xorshift64*
+  uint64_t random() {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return state_ * 0x2545f4914f6cdd1dull;
+  }
+
+  static void put(char* out, const void* value, std::size_t n, bool big_endian) {
+    std::memcpy(out, value, n);
+    if (big_endian) {
+      std::reverse(out, out + n);
+    }
+  }
+
+  void fill(char* record) {
+    std::memset(record, 0, record_size_);
+    double t = index_++ * 1e-3;
+    std::memcpy(record, &t, sizeof(t));
+
+    for (const field& f : fields_) {
+      uint64_t r = random();
+      char* out = record + f.bit_position / 8;
+      if (f.real) {
+        double value = static_cast<int32_t>(r) * 1e-3;
+        float single = value;
+        if (f.bit_count == 32) {
+          put(out, &single, sizeof(single), f.big_endian);
+        } else {
+          put(out, &value, sizeof(value), f.big_endian);
+        }
+      } else if (f.bit_count % 8 == 0 && f.bit_position % 8 == 0) {
+        put(out, &r, f.bit_count / 8, f.big_endian);
+      } else {
+        // bit field, can span 9 bytes
+        uint64_t value = f.bit_count == 64 ? r : r & ((uint64_t(1) << f.bit_count) - 1);
+        unsigned shift = f.bit_position % 8;
+        for (unsigned k = 0; 8 * k < shift + f.bit_count; k++) {
+          uint64_t bits = k == 0 ? value << shift :
+              8 * k - shift < 64 ? value >> (8 * k - shift) : 0;
+          out[k] |= static_cast<char>(bits & 0xff);
+        }
+      }
+    }
+  }
+};
+
+// record of the second channel group of an unsorted file
+const std::size_t other_record_size = 5;
+
+/// the records of source with record id 1, and after every third one a
+/// record with record id 2
+class unsorted_source {
+public:
+  unsorted_source(record_source& records, std::size_t record_size) :
+      records_(records), record_size_(record_size), index_(0), buffer_(), pos_(0)
+  { }
+
+  static uint64_t data_length(uint64_t records, std::size_t record_size) {
+    return records * (1 + record_size) + records / 3 * (1 + other_record_size);
+  }
+
+  void read(char* out, std::size_t n) {
+    while (n != 0) {
+      if (pos_ == buffer_.size()) {
+        fill();
+      }
+      std::size_t k = std::min(n, buffer_.size() - pos_);
+      std::memcpy(out, &buffer_[pos_], k);
+      out += k;
+      pos_ += k;
+      n -= k;
+    }
+  }
+
+private:
+  record_source& records_;
+  std::size_t record_size_;
+  uint64_t index_;
+  std::vector<char> buffer_;
+  std::size_t pos_;
+
+  void fill() {
+    buffer_.clear();
+    pos_ = 0;
+    while (buffer_.size() < (1 << 20)) {
+      std::size_t pos = buffer_.size();
+      buffer_.resize(pos + 1 + record_size_);
+      buffer_[pos] = 1;
+      records_.read(&buffer_[pos + 1], record_size_);
+      if (index_++ % 3 == 2) {
+        buffer_.push_back(2);
+        buffer_.insert(buffer_.end(), other_record_size, static_cast<char>(0xa5));
+      }
+    }
+  }
+};
+
+/// raw value of a field in a record, decoded bit by bit
+double field_value(const field& f, const char* record) {
+  if (f.real) {
+    char bytes[8];
+    std::memcpy(bytes, record + f.bit_position / 8, f.bit_count / 8);
+    if (f.big_endian) {
+      std::reverse(bytes, bytes + f.bit_count / 8);
+    }
+    if (f.bit_count == 32) {
+      float value;
+      std::memcpy(&value, bytes, sizeof(value));
+      return value;
+    }
+    double value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+  }
+
+  uint64_t value = 0;
+  for (unsigned i = 0; i < f.bit_count; i++) {
+    uint64_t bit = f.bit_position + i;
+    if (f.big_endian) {
+      // bytes in reverse order, bit i of the value in byte i / 8 from the end
+      bit = f.bit_position + (f.bit_count / 8 - 1 - i / 8) * 8 + i % 8;
+    }
+    if ((record[bit / 8] >> (bit % 8)) & 1) {
+      value |= uint64_t(1) << i;
+    }
+  }
+
+  bool is_signed = f.data_type == 2 || f.data_type == 3;
+  if (is_signed && f.bit_count < 64 && (value >> (f.bit_count - 1)) & 1) {
+    value |= ~uint64_t(0) << f.bit_count;
+  }
+  return is_signed ? static_cast<double>(static_cast<int64_t>(value)) :
+      static_cast<double>(value);
+}
+
+/// physical value of the channel of raw value
+double physical_value(const generator_options& options, const field& f, double raw) {
+  return options.linear && !f.real ? -1.0 + 0.5 * raw : raw;
+}
+
+/// appends blocks to a file
+class block_writer {
+public:
+  explicit block_writer(const std::string& filename) : file_(filename, "w"), position_(0) { }
+
+  uint64_t position() const { return position_; }
+
+  void write(const void* data, std::size_t n) {
+    file_.write(static_cast<const char*>(data), n);
+    position_ += n;
+  }
+
+  /// write the header and links of a block with data_length bytes of data,
+  /// returns the position of the block
+  uint64_t begin_block(char c1, char c2, const std::vector<link>& links, uint64_t data_length) {
+    align();
+    uint64_t begin = position_;
+    mdf::block_header header = { mdf::make_id('#', '#'), mdf::make_id(c1, c2), 0,
+        sizeof(header) + links.size() * sizeof(link) + data_length, links.size() };
+    write(&header, sizeof(header));
+    write(links.data(), links.size() * sizeof(link));
+    return begin;
+  }
+
+  uint64_t block(char c1, char c2, const std::vector<link>& links, const void* data,
+      std::size_t n) {
+    uint64_t begin = begin_block(c1, c2, links, n);
+    write(data, n);
+    return begin;
+  }
+
+  uint64_t text(const std::string& text) {
+    return block('T', 'X', std::vector<link>(), text.c_str(), text.size() + 1);
+  }
+
+  /// overwrite link i of the block at position
+  void patch_link(uint64_t block, std::size_t i, link value) {
+    file_.seek(block + sizeof(mdf::block_header) + i * sizeof(link));
+    file_.write(value);
+    file_.seek(position_);
+  }
+
+  void align() {
+    static const char zeros[8] = { };
+    write(zeros, (8 - position_ % 8) % 8);
+  }
+
+  void close() {
+    align();
+    file_.close();
+  }
+
+private:
+  mdf::rawfile file_;
+  uint64_t position_;
+};
+
+link write_channel(block_writer& out, const std::string& name, const std::string& unit,
+    const mdf::cnblock& cn, link conversion, link next) {
+  link name_link = out.text(name);
+  link unit_link = unit.empty() ? 0 : out.text(unit);
+  std::vector<link> links = { next, 0, name_link, 0, conversion, 0, unit_link, 0 };
+  return out.block('C', 'N', links, &cn, sizeof(cn));
+}
+
+link write_linear_conversion(block_writer& out, double offset, double factor) {
+  mdf::ccblock cc = mdf::ccblock();
+  cc.type = 1;
+  cc.val_count = 2;
+  char data[sizeof(cc) + 2 * sizeof(double)];
+  std::memcpy(data, &cc, sizeof(cc));
+  std::memcpy(data + sizeof(cc), &offset, sizeof(offset));
+  std::memcpy(data + sizeof(cc) + sizeof(offset), &factor, sizeof(factor));
+  return out.block('C', 'C', std::vector<link>(4, 0), data, sizeof(data));
+}
+
+std::vector<uint64_t> block_sizes(const generator_options& options, uint64_t data_length) {
+  uint64_t size = options.block_size;
+  if (size == 0 && options.compress) {
+    size = default_compressed_block_size;
+  }
+  if (size == 0 || size >= data_length) {
+    return std::vector<uint64_t>(1, data_length);
+  }
+
+  std::vector<uint64_t> sizes;
+  uint64_t state = options.seed * 0x9e3779b97f4a7c15ull | 1;
+  for (uint64_t pos = 0; pos < data_length;) {
+    uint64_t n = size;
+    if (options.random_blocks) {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      n = 1 + (state >> 33) % (2 * size);
+    }
+    n = std::min(n, data_length - pos);
+    sizes.push_back(n);
+    pos += n;
+  }
+  return sizes;
+}
+
+template<typename Source>
+link write_data(block_writer& out, Source& records,
+    const generator_options& options, uint64_t data_length) {
+  std::vector<uint64_t> sizes = block_sizes(options, data_length);
+
+  std::vector<link> blocks;
+  std::vector<char> buffer;
+  std::vector<char> compressed;
+  for (uint64_t size : sizes) {
+    if (options.compress) {
+      buffer.resize(size);
+      records.read(buffer.data(), size);
+      uLongf length = compressBound(size);
+      compressed.resize(length);
+      if (compress2(reinterpret_cast<Bytef*>(compressed.data()), &length,
+          reinterpret_cast<const Bytef*>(buffer.data()), size, Z_BEST_SPEED) != Z_OK) {
+        throw std::runtime_error("compression failed");
+      }
+      mdf::dzblock dz = { { 'D', 'T' }, 0, 0, 0, size, length };
+      blocks.push_back(out.begin_block('D', 'Z', std::vector<link>(), sizeof(dz) + length));
+      out.write(&dz, sizeof(dz));
+      out.write(compressed.data(), length);
+    } else {
+      blocks.push_back(out.begin_block('D', 'T', std::vector<link>(), size));
+      buffer.resize(std::min<uint64_t>(size, 4 << 20));
+      for (uint64_t pos = 0; pos < size; pos += buffer.size()) {
+        std::size_t n = std::min<uint64_t>(buffer.size(), size - pos);
+        records.read(buffer.data(), n);
+        out.write(buffer.data(), n);
+      }
+    }
+  }
+
+  if (blocks.size() == 1 && options.block_size == 0) {
+    return blocks[0];
+  }
+
+  // chain of DL blocks, written from the last one
+  bool equal = !options.random_blocks;
+  link next = 0;
+  for (std::size_t end = blocks.size(); end > 0;) {
+    std::size_t begin = (end - 1) / dl_links * dl_links;
+    std::vector<link> links(1, next);
+    links.insert(links.end(), blocks.begin() + begin, blocks.begin() + end);
+
+    mdf::dlblock dl = { uint8_t(equal ? 1 : 0), { }, uint32_t(end - begin) };
+    std::vector<uint64_t> data;
+    if (equal) {
+      data.push_back(sizes[0]);
+    } else {
+      uint64_t offset = 0;
+      for (std::size_t i = 0; i < begin; i++) {
+        offset += sizes[i];
+      }
+      for (std::size_t i = begin; i < end; i++) {
+        data.push_back(offset);
+        offset += sizes[i];
+      }
+    }
+    next = out.begin_block('D', 'L', links, sizeof(dl) + data.size() * sizeof(uint64_t));
+    out.write(&dl, sizeof(dl));
+    out.write(data.data(), data.size() * sizeof(uint64_t));
+    end = begin;
+  }
+
+  if (!options.compress || options.no_hl) {
+    return next;
+  }
+  mdf::hlblock hl = { uint16_t(equal ? 1 : 0), 0, { } };
+  return out.block('H', 'L', std::vector<link>(1, next), &hl, sizeof(hl));
+}
+
+// records of the columns of write_file()
+const std::size_t column_tile = 64 * 1024;
+
+/// bytes of a sample in a column of write_file()
+std::size_t element_size(const field& f) {
+  return f.real ? f.bit_count / 8 :
+      f.bit_count <= 8 ? 1 : f.bit_count <= 16 ? 2 : f.bit_count <= 32 ? 4 : 8;
+}
+
+/// columns of write_file(), the time first
+std::vector<std::vector<char> > make_columns(const std::vector<field>& fields,
+    const generator_options& options) {
+  std::vector<std::vector<char> > columns(fields.size() + 1);
+  columns[0].resize(column_tile * sizeof(double));
+  uint64_t state = options.seed * 0x9e3779b97f4a7c15ull | 1;
+  for (std::size_t i = 0; i < fields.size(); i++) {
+    const field& f = fields[i];
+    std::size_t element = element_size(f);
+    std::vector<char>& column = columns[i + 1];
+    column.resize(column_tile * element);
+    for (std::size_t k = 0; k < column_tile; k++) {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      uint64_t r = state ^ (state >> 29);
+      if (f.real) {
+        double value = static_cast<int32_t>(r) * 1e-3;
+        float single = value;
+        std::memcpy(&column[k * element], element == 4 ? static_cast<const void*>(&single) :
+            static_cast<const void*>(&value), element);
+      } else {
+        std::memcpy(&column[k * element], &r, element);
+      }
+    }
+  }
+  return columns;
+}
+
+} // namespace
+
+std::size_t record_size(const generator_options& options) {
+  std::size_t size;
+  make_layout(options, size);
+  return size;
+}
+
+uint64_t generate_file(const std::string& filename, const generator_options& options) {
+  std::size_t size;
+  std::vector<field> fields = make_layout(options, size);
+
+  block_writer out(filename);
+
+  mdf::idblock id = mdf::idblock();
+  std::memcpy(id.file_id, "MDF     ", 8);
+  std::memcpy(id.format_id, options.no_hl ? "4.20    " : "4.10    ", 8);
+  std::memcpy(id.program_id, "mdf4benc", 8);
+  id.version_number = options.no_hl ? 420 : 410;
+  out.write(&id, sizeof(id));
+  out.write(std::vector<char>(64 - sizeof(id)).data(), 64 - sizeof(id));
+
+  mdf::hdblock hd = mdf::hdblock();
+  mdf::link hd_link = out.block('H', 'D', std::vector<mdf::link>(6, 0), &hd, sizeof(hd));
+
+  // channels from the last one, so the next link is known
+  mdf::link next = 0;
+  for (std::size_t i = fields.size(); i-- > 0;) {
+    const field& f = fields[i];
+    mdf::cnblock cn = mdf::cnblock();
+    cn.data_type = f.data_type;
+    cn.bit_offset = f.bit_position % 8;
+    cn.byte_offset = f.bit_position / 8;
+    cn.bit_count = f.bit_count;
+
+    mdf::link conversion = 0;
+    if (options.linear && !f.real) {
+      conversion = write_linear_conversion(out, -1.0, 0.5);
+    }
+    next = write_channel(out, "channel" + std::to_string(i) + "_" +
+        options.types[i % options.types.size()], "", cn, conversion, next);
+  }
+  if (options.virtual_master && options.padding == 0) {
+    throw std::invalid_argument(
+        "a virtual master channel needs padding for its invalidation byte");
+  }
+  mdf::cnblock master = mdf::cnblock();
+  master.type = options.virtual_master ? 3 : 2;
+  master.flags = options.virtual_master ? 2 : 0;
+  master.sync_type = 1;
+  master.data_type = 4;
+  master.bit_count = 64;
+  next = write_channel(out, "time", "s", master, 0, next);
+
+  mdf::link other_cg_link = 0;
+  if (options.unsorted) {
+    mdf::cgblock other = mdf::cgblock();
+    other.record_id = 2;
+    other.cycle_count = options.records / 3;
+    other.data_bytes = other_record_size;
+    other_cg_link = out.block('C', 'G', std::vector<mdf::link>(6, 0), &other, sizeof(other));
+  }
+
+  mdf::cgblock cg = mdf::cgblock();
+  cg.record_id = options.unsorted ? 1 : 0;
+  cg.cycle_count = options.records;
+  cg.data_bytes = options.virtual_master ? size - 1 : size;
+  cg.inval_bytes = options.virtual_master ? 1 : 0;
+  std::vector<mdf::link> cg_links = { other_cg_link, next, 0, 0, 0, 0 };
+  mdf::link cg_link = out.block('C', 'G', cg_links, &cg, sizeof(cg));
+
+  uint8_t dg[8] = { uint8_t(options.unsorted ? 1 : 0) };
+  std::vector<mdf::link> dg_links = { 0, cg_link, 0, 0 };
+  mdf::link dg_link = out.block('D', 'G', dg_links, dg, sizeof(dg));
+
+  record_source records(fields, size, options.seed);
+  mdf::link data;
+  if (options.unsorted) {
+    unsorted_source stream(records, size);
+    data = write_data(out, stream, options, unsorted_source::data_length(options.records, size));
+  } else {
+    data = write_data(out, records, options, options.records * size);
+  }
+
+  out.patch_link(dg_link, 2, data);
+  out.patch_link(hd_link, 0, dg_link);
+  out.close();
+  return out.position();
+}
+
+uint64_t write_file(const std::string& filename, const generator_options& options) {
+  std::size_t size;
+  std::vector<field> fields = make_layout(options, size);
+
+  mdf::write_options write;
+  if (options.block_size != 0) {
+    write.block_size = options.block_size;
+  }
+  write.compress = options.compress;
+
+  mdf::file_writer out(filename, write);
+  mdf::group_writer& group = out.add_group();
+  group.add_master_channel();
+  for (std::size_t i = 0; i < fields.size(); i++) {
+    const field& f = fields[i];
+    std::size_t index = group.add_channel(
+        "channel" + std::to_string(i) + "_" + options.types[i % options.types.size()],
+        static_cast<mdf::channel::data_type>(f.data_type), f.bit_count);
+    if (options.linear && !f.real) {
+      group.set_linear_conversion(index, -1.0, 0.5);
+    }
+  }
+
+  // one tile of random columns is appended again and again, only the time
+  // goes on
+  std::vector<std::vector<char> > columns = make_columns(fields, options);
+  std::vector<const void*> pointers;
+  for (const std::vector<char>& column : columns) {
+    pointers.push_back(column.data());
+  }
+
+  double* time = reinterpret_cast<double*>(columns[0].data());
+  for (uint64_t first = 0; first < options.records; first += column_tile) {
+    std::size_t n = std::min<uint64_t>(column_tile, options.records - first);
+    for (std::size_t k = 0; k < n; k++) {
+      time[k] = (first + k) * 1e-3;
+    }
+    group.append_columns(pointers, n);
+  }
+  out.close();
+
+  mdf::rawfile file(filename, "rb");
+  file.seek(0, mdf::rawfile::seek_orgin::end);
+  return file.tell();
+}
+
+std::vector<double> generated_values(const generator_options& options,
+    std::size_t channel, uint64_t first, uint64_t last) {
+  std::size_t size;
+  std::vector<field> fields = make_layout(options, size);
+  if (channel > fields.size()) {
+    throw std::invalid_argument("no such channel");
+  }
+
+  std::vector<double> result;
+  record_source records(fields, size, options.seed);
+  std::vector<char> record(size);
+  for (uint64_t i = 0; i < last; i++) {
+    records.read(record.data(), size);
+    if (i < first) {
+      continue;
+    }
+    if (channel == 0 && options.virtual_master) {
+      result.push_back(double(i));
+    } else if (channel == 0) {
+      double t;
+      std::memcpy(&t, record.data(), sizeof(t));
+      result.push_back(t);
+    } else {
+      const field& f = fields[channel - 1];
+      result.push_back(physical_value(options, f, field_value(f, record.data())));
+    }
+  }
+  return result;
+}
+
+std::vector<double> written_values(const generator_options& options,
+    std::size_t channel, uint64_t first, uint64_t last) {
+  std::size_t size;
+  std::vector<field> fields = make_layout(options, size);
+  if (channel > fields.size()) {
+    throw std::invalid_argument("no such channel");
+  }
+
+  std::vector<double> result;
+  if (channel == 0) {
+    for (uint64_t i = first; i < last; i++) {
+      result.push_back(i * 1e-3);
+    }
+    return result;
+  }
+
+  // the sample as the only field of a record at bit 0, in host byte order
+  field f = fields[channel - 1];
+  f.bit_position = 0;
+  f.big_endian = false;
+  std::vector<std::vector<char> > columns = make_columns(fields, options);
+  const std::vector<char>& column = columns[channel];
+  std::size_t element = element_size(f);
+  for (uint64_t i = first; i < last; i++) {
+    const char* sample = &column[i % column_tile * element];
+    result.push_back(physical_value(options, f, field_value(f, sample)));
+  }
+  return result;
+}
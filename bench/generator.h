@@ -0,0 +1,101 @@
+/*
+ * generator.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCH_GENERATOR_H_
+#define BENCH_GENERATOR_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// parameters of a synthetic mdf4 file with one channel group
+struct generator_options {
+  generator_options() :
+      channels(16), types(1, "f64"), padding(0), records(1000000),
+      block_size(0), random_blocks(false), compress(false), no_hl(false),
+      linear(false), unsorted(false), virtual_master(false), seed(1)
+  { }
+
+  /// count of channels besides the master channel
+  std::size_t channels;
+
+  /// Types of the channels, used in turn: u8 ... u64, i8 ... i64, f32 and
+  /// f64, with suffix "be" for big endian. bN and sN are unsigned and
+  /// signed bit fields of N bits, packed without gaps.
+  std::vector<std::string> types;
+
+  /// unused bytes at the end of every record
+  std::size_t padding;
+
+  uint64_t records;
+
+  /// bytes of record data per DT block, 0 for only one block. Blocks end
+  /// anywhere in a record.
+  uint64_t block_size;
+
+  /// block sizes vary randomly between 1 and 2 * block_size
+  bool random_blocks;
+
+  /// DZ blocks with deflate
+  bool compress;
+
+  /// DZ blocks listed in DL blocks directly, without HL block (mdf 4.2)
+  bool no_hl;
+
+  /// linear conversion for the integer channels
+  bool linear;
+
+  /// Records with a record id of one byte, after every third record a
+  /// record of a second channel group without channels follows.
+  bool unsorted;
+
+  /// virtual master channel, its samples are the record indices, with an
+  /// invalidation bit in the last padding byte
+  bool virtual_master;
+
+  uint32_t seed;
+};
+
+/// bytes of one record, throws std::invalid_argument for an unknown type
+std::size_t record_size(const generator_options& options);
+
+/// Write the file with a time master channel and random samples. The
+/// records are generated block by block, so the file can be larger than
+/// the memory. Returns the size of the file.
+uint64_t generate_file(const std::string& filename, const generator_options& options);
+
+/// Write a file with the same channels through mdf::file_writer, from one
+/// column of random samples per channel. Blocks hold whole records, padding
+/// and random block sizes are not used. Returns the size of the file.
+uint64_t write_file(const std::string& filename, const generator_options& options);
+
+/// Physical values of a channel of the file of generate_file() for the
+/// records [first, last), decoded from the generated bytes without the
+/// library. Channel 0 is the master channel, channel i + 1 the i-th channel
+/// of the types.
+std::vector<double> generated_values(const generator_options& options,
+    std::size_t channel, uint64_t first, uint64_t last);
+
+/// same for the file of write_file()
+std::vector<double> written_values(const generator_options& options,
+    std::size_t channel, uint64_t first, uint64_t last);
+
+#endif // BENCH_GENERATOR_H_
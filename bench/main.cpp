@@ -0,0 +1,393 @@
+/*
+ * main.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+#include "libmdf4.h"
+#include "generator.h"
+#include "verify.h"
+#include "../config.h"
+
+// options
+static generator_options generator;
+static uint64_t data_size = 0;
+static std::string filename = "mdf4-bench.mf4";
+static bool keep_file = false;
+static bool reuse_file = false;
+static std::string export_program;
+static bool parallel = false;
+static unsigned repeat = 3;
+static std::size_t channel_limit = 16;
+static bool measure_writer = false;
+static bool verify_mode = false;
+
+static const char short_options[] = "c:t:w:n:s:b:RzHlUf:kKe:Pr:C:WVh";
+static const struct option long_options[] = {
+    {"channels", required_argument, 0, 'c'},
+    {"types", required_argument, 0, 't'},
+    {"padding", required_argument, 0, 'w'},
+    {"records", required_argument, 0, 'n'},
+    {"size", required_argument, 0, 's'},
+    {"block-size", required_argument, 0, 'b'},
+    {"random-blocks", 0, 0, 'R'},
+    {"compress", 0, 0, 'z'},
+    {"no-hl", 0, 0, 'H'},
+    {"linear", 0, 0, 'l'},
+    {"unsorted", 0, 0, 'U'},
+    {"file", required_argument, 0, 'f'},
+    {"keep", 0, 0, 'k'},
+    {"reuse", 0, 0, 'K'},
+    {"export", required_argument, 0, 'e'},
+    {"parallel", 0, 0, 'P'},
+    {"repeat", required_argument, 0, 'r'},
+    {"channel-limit", required_argument, 0, 'C'},
+    {"write", 0, 0, 'W'},
+    {"verify", 0, 0, 'V'},
+    {"help", 0, 0, 'h'},
+    {0, 0, 0, 0}
+};
+
+static void usage() {
+  puts(
+      "Usage: mdf4-bench [OPTION]...\n"
+      "Generate a synthetic mdf4 file and measure reading it.\n"
+      "\n"
+      "File parameters:\n"
+      "  -c, --channels=N        N channels besides the master channel (default 16)\n"
+      "  -t, --types=LIST        channel types used in turn (default f64): u8, u16,\n"
+      "                          u32, u64, i8, i16, i32, i64, f32, f64, with suffix\n"
+      "                          be for big endian, bN and sN for bit fields of N bits\n"
+      "  -w, --padding=BYTES     unused bytes at the end of every record\n"
+      "  -n, --records=N         count of records (default 1000000)\n"
+      "  -s, --size=SIZE         records for SIZE bytes of data, instead of -n\n"
+      "  -b, --block-size=SIZE   split the data into DT blocks of SIZE bytes in DL\n"
+      "                          blocks (default one DT block)\n"
+      "  -R, --random-blocks     block sizes vary between 1 and 2 * SIZE\n"
+      "  -z, --compress          DZ blocks in a HL block\n"
+      "  -H, --no-hl             with -z, DZ blocks listed in DL blocks directly\n"
+      "  -l, --linear            linear conversion for integer channels\n"
+      "  -U, --unsorted          records with record ids, mixed with the records of\n"
+      "                          a second channel group\n"
+      "\n"
+      "Measurement:\n"
+      "  -f, --file=FILE         generated file (default mdf4-bench.mf4)\n"
+      "  -k, --keep              keep the file\n"
+      "  -K, --reuse             use an existing FILE, implies -k\n"
+      "  -e, --export=PROGRAM    time mdf4-export PROGRAM for csv and arrow output\n"
+      "  -P, --parallel          decode on all processor cores\n"
+      "  -r, --repeat=N          best of N runs (default 3)\n"
+      "  -C, --channel-limit=N   decode at most N channels one by one (default 16)\n"
+      "  -W, --write             time writing the channels with the writer of the\n"
+      "                          library into FILE.write\n"
+      "  -V, --verify            instead of measuring, read generated files of all\n"
+      "                          kinds in all modes through FILE and compare the\n"
+      "                          samples with the generated values\n"
+      "  -h, --help              print this help\n"
+      "\n"
+      "SIZE may have a suffix K, M or G. The results are printed as one JSON\n"
+      "object. Throughput in bytes is of record data read, files are read from\n"
+      "the page cache after the first run.");
+}
+
+static uint64_t parse_size(const std::string& str) {
+  uint64_t factor = 1;
+  std::string digits = str;
+  if (!digits.empty()) {
+    switch (digits.back()) {
+    case 'K': factor = uint64_t(1) << 10; break;
+    case 'M': factor = uint64_t(1) << 20; break;
+    case 'G': factor = uint64_t(1) << 30; break;
+    }
+    if (factor != 1) {
+      digits.pop_back();
+    }
+  }
+  return boost::lexical_cast<uint64_t>(digits) * factor;
+}
+
+static double now() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// shortest time of repeat calls of f
+template<typename F>
+static double measure(F f) {
+  double best = 0;
+  for (unsigned i = 0; i < std::max(1u, repeat); i++) {
+    double start = now();
+    f();
+    double t = now() - start;
+    if (i == 0 || t < best) {
+      best = t;
+    }
+  }
+  return best;
+}
+
+static std::string json_string(const std::string& str) {
+  std::string result = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      result.push_back('\\');
+    }
+    result.push_back(c);
+  }
+  return result + "\"";
+}
+
+/// "seconds": t and throughput for records of record_size bytes
+static std::string throughput(double t, uint64_t records, std::size_t record_size) {
+  char buffer[160];
+  snprintf(buffer, sizeof(buffer),
+      "\"seconds\": %.6f, \"samples_per_s\": %.6g, \"gb_per_s\": %.6g",
+      t, records / t, records * double(record_size) / t / 1e9);
+  return buffer;
+}
+
+static int run(const std::vector<std::string>& args) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    std::vector<char*> argv;
+    for (const std::string& arg : args) {
+      argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+
+  int status = -1;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+    return -1;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char* argv[]) {
+  int c;
+  try {
+    while ((c = getopt_long(argc, argv, short_options, long_options, nullptr)) != -1) {
+      switch (c) {
+      case 'c': generator.channels = boost::lexical_cast<std::size_t>(optarg); break;
+      case 't':
+        generator.types.clear();
+        boost::split(generator.types, optarg, boost::is_any_of(","));
+        break;
+      case 'w': generator.padding = boost::lexical_cast<std::size_t>(optarg); break;
+      case 'n': generator.records = boost::lexical_cast<uint64_t>(optarg); break;
+      case 's': data_size = parse_size(optarg); break;
+      case 'b': generator.block_size = parse_size(optarg); break;
+      case 'R': generator.random_blocks = true; break;
+      case 'z': generator.compress = true; break;
+      case 'H': generator.no_hl = true; break;
+      case 'l': generator.linear = true; break;
+      case 'U': generator.unsorted = true; break;
+      case 'f': filename = optarg; break;
+      case 'k': keep_file = true; break;
+      case 'K': reuse_file = keep_file = true; break;
+      case 'e': export_program = optarg; break;
+      case 'P': parallel = true; break;
+      case 'r': repeat = boost::lexical_cast<unsigned>(optarg); break;
+      case 'C': channel_limit = boost::lexical_cast<std::size_t>(optarg); break;
+      case 'W': measure_writer = true; break;
+      case 'V': verify_mode = true; break;
+      case 'h': usage(); return EXIT_SUCCESS;
+      default:
+        fputs("Try `mdf4-bench --help' for more information.\n", stderr);
+        return EXIT_FAILURE;
+      }
+    }
+  } catch (const boost::bad_lexical_cast&) {
+    fputs("Invalid argument\nTry `mdf4-bench --help' for more information.\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  if (verify_mode) {
+    int failed = verify(filename);
+    if (failed != 0) {
+      fprintf(stderr, "mdf4-bench: %d cases failed\n", failed);
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  try {
+    std::size_t size = record_size(generator);
+    if (data_size != 0) {
+      generator.records = data_size / size;
+    }
+
+    double generate_time = 0;
+    if (!reuse_file) {
+      double start = now();
+      generate_file(filename, generator);
+      generate_time = now() - start;
+    }
+
+    mdf::decode_options options;
+    options.parallel = parallel;
+
+    std::unique_ptr<mdf::file> file;
+    double open_time = measure([&]() {
+      file.reset(new mdf::file());
+      file->open(filename.c_str());
+    });
+
+    struct stat file_stat;
+    if (stat(filename.c_str(), &file_stat) != 0) {
+      throw mdf::io_error();
+    }
+
+    // metadata walk
+    std::size_t channel_count = 0;
+    double metadata_time = measure([&]() {
+      mdf::file walked;
+      mdf::open_options lazy;
+      lazy.lazy = true;
+      walked.open(filename.c_str(), lazy);
+      channel_count = 0;
+      for (const auto& dg : walked.get_data_groups()) {
+        for (const auto& cg : dg.get_channel_groups()) {
+          for (const auto& ch : cg.get_channels()) {
+            ch.get_name_ref();
+            ch.get_metadata_unit_ref();
+            ch.get_channel_conversation();
+            channel_count++;
+          }
+        }
+      }
+    });
+
+    const mdf::channel_group& cg = file->get_data_groups().at(0).get_channel_groups().at(0);
+    const auto& channels = cg.get_channels();
+    uint64_t records = cg.get_cycle_count();
+    std::size_t rs = cg.get_data_bytes() + cg.get_inval_bytes();
+
+    // decode windows of at most 256 MiB of doubles
+    uint64_t window = std::max<uint64_t>(1024, (std::size_t(256) << 20) / (8 * channels.size()));
+    std::vector<double> buffer(std::min(window * channels.size(), records * channels.size()));
+
+    printf("{\n  \"version\": %s,\n", json_string(mdf::version()).c_str());
+    printf("  \"parameters\": {\"channels\": %zu, \"types\": [", generator.channels);
+    for (std::size_t i = 0; i < generator.types.size(); i++) {
+      printf("%s%s", i == 0 ? "" : ", ", json_string(generator.types[i]).c_str());
+    }
+    printf("], \"padding\": %zu, \"records\": %llu, \"record_bytes\": %zu, "
+        "\"block_size\": %llu, \"random_blocks\": %s, \"compress\": %s, "
+        "\"linear\": %s, \"parallel\": %s, \"repeat\": %u},\n",
+        generator.padding, (unsigned long long) records, rs,
+        (unsigned long long) generator.block_size,
+        generator.random_blocks ? "true" : "false", generator.compress ? "true" : "false",
+        generator.linear ? "true" : "false", parallel ? "true" : "false", repeat);
+    printf("  \"file_bytes\": %llu,\n", (unsigned long long) file_stat.st_size);
+    if (!reuse_file) {
+      printf("  \"generate_seconds\": %.6f,\n", generate_time);
+    }
+    printf("  \"open_seconds\": %.6f,\n", open_time);
+    printf("  \"metadata_walk\": {\"seconds\": %.6f, \"channels\": %zu},\n",
+        metadata_time, channel_count);
+    fflush(stdout);
+
+    printf("  \"channel_decode\": [");
+    for (std::size_t i = 0; i < std::min(channel_limit, channels.size()); i++) {
+      const mdf::channel& ch = channels[i];
+      double t = measure([&]() {
+        for (uint64_t first = 0; first < records; first += window) {
+          ch.get_data(buffer.data(), first, std::min(records, first + window), options);
+        }
+      });
+      printf("%s\n    {\"name\": %s, %s}", i == 0 ? "" : ",",
+          json_string(ch.get_name()).c_str(), throughput(t, records, rs).c_str());
+      fflush(stdout);
+    }
+    printf("\n  ],\n");
+
+    std::vector<mdf::decoder<double> > decoders;
+    for (const auto& ch : channels) {
+      decoders.push_back(ch.get_decoder<double>());
+    }
+    double multi_time = measure([&]() {
+      std::vector<double*> buffers;
+      for (std::size_t i = 0; i < channels.size(); i++) {
+        buffers.push_back(buffer.data() + i * std::min(window, records));
+      }
+      for (uint64_t first = 0; first < records; first += window) {
+        cg.decode(decoders, buffers, first, std::min(records, first + window), options);
+      }
+    });
+    printf("  \"multi_channel_decode\": {\"channels\": %zu, %s}",
+        channels.size(), throughput(multi_time, records, rs).c_str());
+
+    if (!export_program.empty()) {
+      for (const char* format : { "csv", "arrow" }) {
+        std::vector<std::string> args = { export_program, "-F", format, "-o", "/dev/null" };
+        if (parallel) {
+          args.push_back("-P");
+        }
+        args.push_back(filename);
+
+        int status = 0;
+        double t = measure([&]() { status = run(args); });
+        if (status != 0) {
+          fprintf(stderr, "%s failed with status %d\n", export_program.c_str(), status);
+          return EXIT_FAILURE;
+        }
+        printf(",\n  \"export_%s\": {%s}", format, throughput(t, records, rs).c_str());
+      }
+    }
+    if (measure_writer) {
+      std::string written = filename + ".write";
+      uint64_t bytes = 0;
+      double t = measure([&]() { bytes = write_file(written, generator); });
+      unlink(written.c_str());
+      printf(",\n  \"write\": {\"file_bytes\": %llu, %s}", (unsigned long long) bytes,
+          throughput(t, generator.records, record_size(generator) - generator.padding).c_str());
+    }
+    printf("\n}\n");
+
+  } catch (const std::exception& e) {
+    fprintf(stderr, "mdf4-bench: %s\n", e.what());
+    if (!keep_file) {
+      unlink(filename.c_str());
+    }
+    return EXIT_FAILURE;
+  }
+
+  if (!keep_file) {
+    unlink(filename.c_str());
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,277 @@
+/*
+ * verify.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "verify.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+#include "libmdf4.h"
+#include "generator.h"
+
+namespace {
+
+/// a generated file
+struct verify_case {
+  std::string name;
+  generator_options options;
+  bool writer; // written by write_file() instead of generate_file()
+};
+
+/// a way of opening and decoding the file
+struct read_mode {
+  const char* name;
+  bool memory_map;
+  bool read_cache;
+  bool lazy;
+  bool parallel;
+};
+
+const read_mode read_modes[] = {
+  { "pread", false, false, false, false },
+  { "cached", false, true, false, false },
+  { "mmap", true, false, false, false },
+  { "lazy", false, true, true, false },
+  { "parallel", false, true, false, true },
+  { "mmap-lazy-parallel", true, false, true, true },
+};
+
+generator_options make_options(const std::string& types, uint64_t records,
+    uint64_t block_size = 0, bool random_blocks = false) {
+  generator_options options;
+  options.types.clear();
+  boost::split(options.types, types, boost::is_any_of(","));
+  options.channels = options.types.size();
+  options.records = records;
+  options.block_size = block_size;
+  options.random_blocks = random_blocks;
+  return options;
+}
+
+std::vector<verify_case> make_cases() {
+  std::vector<verify_case> cases;
+  auto add = [&cases](const std::string& name, const generator_options& options, bool writer) {
+    verify_case c = { name, options, writer };
+    cases.push_back(c);
+  };
+
+  add("one-dt-block", make_options("u8,i16,u32be,i64,f32,f64be,u64,i8,u16be", 60000), false);
+  add("bit-fields", make_options("b1,s3,b12,s13,b33,s64,u16,b7,s2", 60000, 1000, true), false);
+
+  generator_options linear = make_options("u16,i32be,f64,s13", 80000, 4096);
+  linear.linear = true;
+  add("dl-equal-linear", linear, false);
+
+  generator_options compressed = make_options("b12,f32,i16be,s5,u64", 80000, 10000, true);
+  compressed.compress = true;
+  add("dz-hl", compressed, false);
+
+  // equal block lengths without HL block, the blocks must not be taken
+  // for DT blocks of that length
+  generator_options plain_list = make_options("u16,f64,b12", 80000, 8192);
+  plain_list.compress = true;
+  plain_list.no_hl = true;
+  add("dz-in-dl-without-hl", plain_list, false);
+
+  // records over 1 MiB, parallel decoding of a few of them
+  generator_options large = make_options("u16,f64", 40);
+  large.padding = (1 << 20) + 4096;
+  add("large-records", large, false);
+
+  // no record bytes to read the invalidation bit from
+  generator_options virtual_master = make_options("u16,b5,f64", 30000, 4096);
+  virtual_master.padding = 1;
+  virtual_master.virtual_master = true;
+  add("virtual-master", virtual_master, false);
+
+  generator_options unsorted = make_options("u32,b9,f64", 60000, 777, true);
+  unsorted.unsorted = true;
+  add("unsorted", unsorted, false);
+  unsorted.compress = true;
+  add("unsorted-dz", unsorted, false);
+
+  generator_options written = make_options("u8,b12,s5,i32be,f64,u64,f32be", 80000, 10000);
+  written.linear = true;
+  add("writer", written, true);
+  written.compress = true;
+  add("writer-dz-transposed", written, true);
+
+  return cases;
+}
+
+/// first difference of values to expected[first, last), empty if equal
+std::string compare(const std::vector<double>& values, const std::vector<double>& expected,
+    uint64_t first, uint64_t last) {
+  last = std::min<uint64_t>(last, expected.size());
+  if (values.size() != last - first) {
+    return std::to_string(values.size()) + " samples instead of " +
+        std::to_string(last - first);
+  }
+  for (std::size_t i = 0; i < values.size(); i++) {
+    if (!(values[i] == expected[first + i])) {
+      char buffer[128];
+      snprintf(buffer, sizeof(buffer), "record %llu is %.17g instead of %.17g",
+          (unsigned long long) (first + i), values[i], expected[first + i]);
+      return buffer;
+    }
+  }
+  return std::string();
+}
+
+/// read the file in mode, returns the first difference to expected
+std::string check_file(const std::string& filename, const read_mode& mode,
+    const std::vector<std::vector<double> >& expected) {
+  mdf::open_options open;
+  open.memory_map = mode.memory_map;
+  open.read_cache = mode.read_cache;
+  open.lazy = mode.lazy;
+  mdf::file file(filename, open);
+
+  mdf::decode_options options;
+  options.parallel = mode.parallel;
+
+  const mdf::channel_group& cg = file.get_data_groups().at(0).get_channel_groups().at(0);
+  const std::vector<mdf::channel>& channels = cg.get_channels();
+  if (channels.size() != expected.size()) {
+    return std::to_string(channels.size()) + " channels instead of " +
+        std::to_string(expected.size());
+  }
+  uint64_t n = expected[0].size();
+  if (cg.get_cycle_count() != n) {
+    return "wrong cycle count";
+  }
+
+  std::string difference;
+  for (std::size_t i = 0; i < channels.size() && difference.empty(); i++) {
+    std::vector<double> data;
+    channels[i].get_data_real(data, options);
+    difference = compare(data, expected[i], 0, n);
+    if (!difference.empty()) {
+      return channels[i].get_name() + ": " + difference;
+    }
+
+    // no sample of the generated files is invalid
+    std::vector<uint8_t> validity;
+    channels[i].get_data_real(data, validity, options);
+    difference = compare(data, expected[i], 0, n);
+    for (uint64_t k = 0; k < n && difference.empty(); k++) {
+      if (!((validity.at(k / 8) >> (k % 8)) & 1)) {
+        difference = "sample " + std::to_string(k) + " is invalid";
+      }
+    }
+    if (!difference.empty()) {
+      return channels[i].get_name() + " with validity: " + difference;
+    }
+
+    // ranges inside and across data blocks, and beyond the last record
+    const uint64_t ranges[][2] = { { 0, 1 }, { n / 3, n / 3 + 1 },
+        { n / 2 - 17, n / 2 + 4099 }, { n - 5, n + 10 } };
+    for (const auto& range : ranges) {
+      std::vector<double> buffer(range[1] - range[0]);
+      buffer.resize(channels[i].get_data(buffer.data(), range[0], range[1], options));
+      difference = compare(buffer, expected[i], range[0], range[1]);
+      if (!difference.empty()) {
+        return channels[i].get_name() + " [" + std::to_string(range[0]) + ", " +
+            std::to_string(range[1]) + "): " + difference;
+      }
+    }
+  }
+
+  std::vector<const mdf::channel*> pointers;
+  for (const mdf::channel& ch : channels) {
+    pointers.push_back(&ch);
+  }
+  std::vector<std::vector<double> > data;
+  cg.get_data_real(pointers, data, options);
+  for (std::size_t i = 0; i < channels.size(); i++) {
+    difference = compare(data[i], expected[i], 0, n);
+    if (!difference.empty()) {
+      return "multi-channel " + channels[i].get_name() + ": " + difference;
+    }
+  }
+
+  // window by the time of the master channel
+  uint64_t first = n / 4;
+  uint64_t last = std::min<uint64_t>(n, first + 1001);
+  uint64_t window = cg.get_window_real(pointers, data, expected[0][first],
+      expected[0][last - 1], options);
+  if (window != first) {
+    return "window starts at record " + std::to_string(window) + " instead of " +
+        std::to_string(first);
+  }
+  for (std::size_t i = 0; i < channels.size(); i++) {
+    difference = compare(data[i], expected[i], first, last);
+    if (!difference.empty()) {
+      return "window " + channels[i].get_name() + ": " + difference;
+    }
+  }
+  return std::string();
+}
+
+} // namespace
+
+int verify(const std::string& filename) {
+  int failed = 0;
+  for (const verify_case& c : make_cases()) {
+    std::vector<std::vector<double> > expected;
+    std::string failure;
+    try {
+      if (c.writer) {
+        write_file(filename, c.options);
+      } else {
+        generate_file(filename, c.options);
+      }
+      for (std::size_t i = 0; i <= c.options.channels; i++) {
+        expected.push_back(c.writer ? written_values(c.options, i, 0, c.options.records) :
+            generated_values(c.options, i, 0, c.options.records));
+      }
+    } catch (const std::exception& e) {
+      failure = std::string("generating failed: ") + e.what();
+    }
+
+    for (const read_mode& mode : read_modes) {
+      if (failure.empty()) {
+        try {
+          failure = check_file(filename, mode, expected);
+        } catch (const std::exception& e) {
+          failure = e.what();
+        }
+      }
+      printf("%-24s %-20s %s%s\n", c.name.c_str(), mode.name,
+          failure.empty() ? "ok" : "FAIL: ", failure.c_str());
+      fflush(stdout);
+      if (!failure.empty()) {
+        failed++;
+        break;
+      }
+    }
+  }
+
+  unlink(filename.c_str());
+  return failed + verify_conversions();
+}
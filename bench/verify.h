@@ -0,0 +1,39 @@
+/*
+ * verify.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCH_VERIFY_H_
+#define BENCH_VERIFY_H_
+
+#include <string>
+
+/// Generate small files covering the decoding paths of the library, read
+/// them in all open and decode modes and compare the samples with the
+/// generated values. The files are written to filename and removed. Prints
+/// one line per case to stdout and returns the number of failed cases,
+/// including those of verify_conversions().
+int verify(const std::string& filename);
+
+/// Build CC blocks of conversion types 3 to 10 in a temporary file and
+/// compare their conversion of chosen raw values with the expected results.
+/// Prints one line per CC block and returns the number of failed blocks.
+int verify_conversions();
+
+#endif // BENCH_VERIFY_H_
@@ -0,0 +1,197 @@
+/*
+ * batch.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "batch.h"
+#include "detail/threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <exception>
+#include <unordered_map>
+
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+
+namespace mdf {
+
+namespace {
+
+bool has_mdf_extension(const std::string& name) {
+  std::size_t dot = name.rfind('.');
+  if (dot == std::string::npos) {
+    return false;
+  }
+  std::string extension = name.substr(dot + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+  return extension == "mf4" || extension == "mdf";
+}
+
+void add_file(std::vector<batch_file>& files, const std::string& name) {
+  struct stat info;
+  batch_file file = { name, 0 };
+  if (stat(name.c_str(), &info) == 0) {
+    file.size = info.st_size;
+  }
+  files.push_back(file);
+}
+
+void add_directory(std::vector<batch_file>& files, const std::string& directory) {
+  DIR* dir = opendir(directory.c_str());
+  if (!dir) {
+    add_file(files, directory);
+    return;
+  }
+
+  std::vector<std::string> names;
+  while (struct dirent* entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (has_mdf_extension(name)) {
+      names.push_back(directory + (directory.back() == '/' ? "" : "/") + name);
+    }
+  }
+  closedir(dir);
+
+  std::sort(names.begin(), names.end());
+  for (const std::string& name : names) {
+    struct stat info;
+    if (stat(name.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+      add_file(files, name);
+    }
+  }
+}
+
+} // namespace
+
+std::vector<batch_file> find_batch_files(const std::vector<std::string>& args) {
+  std::vector<batch_file> files;
+  for (const std::string& arg : args) {
+    struct stat info;
+    if (stat(arg.c_str(), &info) == 0) {
+      if (S_ISDIR(info.st_mode)) {
+        add_directory(files, arg);
+      } else {
+        add_file(files, arg);
+      }
+      continue;
+    }
+
+    glob_t matches;
+    if (arg.find_first_of("*?[") != std::string::npos &&
+        glob(arg.c_str(), 0, nullptr, &matches) == 0) {
+      for (std::size_t i = 0; i < matches.gl_pathc; i++) {
+        add_file(files, matches.gl_pathv[i]);
+      }
+      globfree(&matches);
+    } else {
+      add_file(files, arg);
+    }
+  }
+  return files;
+}
+
+std::size_t run_batch(const std::vector<batch_file>& files, std::size_t jobs,
+    const std::function<bool(const batch_file&)>& process,
+    const std::function<void(const batch_file&, const char*)>& failed) {
+  std::vector<const batch_file*> order;
+  for (const batch_file& file : files) {
+    order.push_back(&file);
+  }
+  std::stable_sort(order.begin(), order.end(),
+      [](const batch_file* a, const batch_file* b) { return a->size > b->size; });
+
+  std::atomic<std::size_t> next(0);
+  std::atomic<std::size_t> failures(0);
+  auto work = [&]() {
+    std::size_t i;
+    while ((i = next++) < order.size()) {
+      const batch_file& file = *order[i];
+      bool ok = false;
+      try {
+        ok = process(file);
+      } catch (const std::exception& e) {
+        failed(file, e.what());
+      } catch (...) {
+        failed(file, "unknown error");
+      }
+      if (!ok) {
+        failures++;
+      }
+    }
+  };
+
+  jobs = std::max<std::size_t>(1, std::min(jobs, order.size()));
+  thread_pool pool(jobs);
+  std::vector<std::future<void> > workers;
+  for (std::size_t i = 0; i < jobs; i++) {
+    workers.push_back(pool.submit(work));
+  }
+  for (std::future<void>& worker : workers) {
+    worker.get();
+  }
+  return failures;
+}
+
+std::string batch_output_path(const std::string& input, const std::string& directory,
+    const std::string& suffix) {
+  std::size_t slash = input.rfind('/');
+  std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+  std::size_t dot = name.rfind('.');
+  if (dot != std::string::npos && dot != 0) {
+    name.resize(dot);
+  }
+
+  std::string path = directory;
+  if (path.empty() && slash != std::string::npos) {
+    path = input.substr(0, slash + 1);
+  } else if (!path.empty() && path.back() != '/') {
+    path.push_back('/');
+  }
+  return path + name + suffix;
+}
+
+std::pair<const batch_file*, const batch_file*> find_output_conflict(
+    const std::vector<batch_file>& files, const std::string& directory,
+    const std::string& suffix) {
+  std::unordered_map<std::string, const batch_file*> outputs;
+  for (const batch_file& file : files) {
+    std::string path = batch_output_path(file.name, directory, suffix);
+
+    // the directory by device and inode, a/x and ./a/x are the same
+    std::size_t slash = path.rfind('/');
+    std::string parent = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    std::string key = path;
+    struct stat info;
+    if (stat(parent.c_str(), &info) == 0) {
+      key = std::to_string(info.st_dev) + ":" + std::to_string(info.st_ino) + "/" +
+          path.substr(slash + 1);
+    }
+
+    auto inserted = outputs.emplace(key, &file);
+    if (!inserted.second) {
+      return std::make_pair(inserted.first->second, &file);
+    }
+  }
+  return std::make_pair(nullptr, nullptr);
+}
+
+} // namespace mdf
@@ -0,0 +1,71 @@
+/*
+ * batch.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MDF4_COMMON_BATCH_H_
+#define MDF4_COMMON_BATCH_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mdf {
+
+/// input file of a batch
+struct batch_file {
+  std::string name;
+  uint64_t size;
+};
+
+/// Files named by args in their order. Directories are searched for files
+/// ending with .mf4 or .mdf in any case, not recursively. Arguments with *, ?
+/// or [ which are no existing file are expanded by glob(). Other arguments
+/// are kept even if they are missing, opening them reports the error then.
+std::vector<batch_file> find_batch_files(const std::vector<std::string>& args);
+
+/// Call process for every file, on jobs threads at the same time. The
+/// largest files are started first, so no long file is left for the end.
+/// An exception thrown by process is passed to failed together with the
+/// file, and the batch goes on. Returns the count of files for which
+/// process returned false or threw.
+std::size_t run_batch(const std::vector<batch_file>& files, std::size_t jobs,
+    const std::function<bool(const batch_file&)>& process,
+    const std::function<void(const batch_file&, const char*)>& failed);
+
+/// Path of the output for input: the name of input without extension in
+/// directory (in the directory of input if directory is empty), followed by
+/// suffix
+std::string batch_output_path(const std::string& input, const std::string& directory,
+    const std::string& suffix);
+
+/// First two files whose outputs from batch_output_path() are the same
+/// file, like x.mf4 and x.mdf or a/x.mf4 and b/x.mf4 with one output
+/// directory. Both are nullptr if every file has an output of its own. The
+/// output directories have to exist to tell different names of one
+/// directory apart.
+std::pair<const batch_file*, const batch_file*> find_output_conflict(
+    const std::vector<batch_file>& files, const std::string& directory,
+    const std::string& suffix);
+
+} // namespace mdf
+
+#endif // MDF4_COMMON_BATCH_H_
@@ -42,6 +42,8 @@ public:
 protected:
   mutable std::shared_ptr<rawfile> file_;
   const block* parent_;
+
+  void set_parent(const block* parent) { parent_ = parent; }
 };
 
 } // namespace mdf
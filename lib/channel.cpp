@@ -21,231 +21,502 @@
 
 #include "channel.h"
 
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
 #include "datagroup.h"
-#include "detail/memory.h"
+#include "detail/threadpool.h"
+#include "detail/zip.h"
 
 namespace mdf {
 
-channel::channel(const channel_group* cg, uint64_t l) :
-    block(cg, l), links_(), cn_(), channel_group_(cg)
-{
-  file_->seek(l);
+namespace {
+
+// length of a sample up to the first zero character of a string
+uint32_t string_length(const char* ptr, std::size_t n, channel::data_type type) {
+  switch (type) {
+  case channel::data_type::string_latin1:
+  case channel::data_type::string_utf8: {
+    const void* end = memchr(ptr, 0, n);
+    return end ? static_cast<const char*>(end) - ptr : n;
+  }
+
+  case channel::data_type::string_utf16le:
+  case channel::data_type::string_utf16be:
+    for (std::size_t i = 0; i + 1 < n; i += 2) {
+      if (ptr[i] == 0 && ptr[i + 1] == 0) {
+        return i;
+      }
+    }
+    return n;
+
+  default:
+    return n;
+  }
+}
 
-  // CN Channel
-  block_header header = prase_block_header(file_.get(), make_id('C', 'N'));
-  file_->read_to_container(links_, header.link_count);
+// append the data of a SD or DZ block to buffer
+void append_signal_block(const rawfile* file, link l, std::vector<char>& buffer) {
+  rawfile_cursor cursor(file, l);
+  block_header header = prase_block_header(cursor);
+  if (header.id == make_id('D', 'Z')) {
+    std::vector<char> data = read_dz(file, l, "SD");
+    buffer.insert(buffer.end(), data.begin(), data.end());
+    return;
+  }
 
-  file_->read(cn_);
+  if (header.id != make_id('S', 'D')) {
+    throw error("format error: expected SD or DZ block");
+  }
+  if (header.length < sizeof(block_header) + header.link_count * sizeof(link)) {
+    throw error("format error: wrong block length");
+  }
 
-  if (links_[3] != 0) {
+  uint64_t begin = l + sizeof(block_header) + header.link_count * sizeof(link);
+  std::size_t pos = buffer.size();
+  buffer.resize(pos + (l + header.length - begin));
+  file->read_at(begin, &buffer[pos], buffer.size() - pos);
+}
+
+} // namespace
+
+void channel::prase_references() const {
+  metadata_table& metadata = get_file()->get_metadata();
+
+  if (record_->links[3] != 0) {
     // M4_SI
-    source_information_ = source_information(this, links_[3]);
+    record_->source_links = metadata.get_source_links(record_->links[3]);
   }
 
-  if (links_[4] != 0) {
+  if (record_->links[4] != 0) {
     // M4_CC
-    channel_conversation_ = channel_conversation(file_, links_[4]);
+    record_->conversion = metadata.get_conversion(record_->links[4]);
   }
+
+  record_->references_parsed = true;
 }
 
-std::string channel::get_name() const {
-  return prase_tx(file_.get(), links_[2]);
+void channel::load_references() const {
+  std::lock_guard<std::mutex> lock(*channel_group_->metadata_mutex_);
+  if (!record_->references_parsed) {
+    phase_timer timer(get_file()->get_counters(), file_counters::metadata_phase);
+    prase_references();
+  }
 }
 
-std::string channel::get_metadata_unit() const {
-  return prase_tx(file_.get(), links_[6]);
+void channel::relink(const channel_group* cg) {
+  channel_group_ = cg;
 }
 
-std::string channel::get_metadata_comment() const {
-  return prase_tx(file_.get(), links_[7]);
+const std::shared_ptr<rawfile>& channel::get_file() const {
+  return channel_group_->get_file();
 }
 
-channel::data_type channel::get_data_type() const {
-  return static_cast<data_type>(cn_.data_type);
+boost::optional<source_information> channel::get_source_information() const {
+  load_references();
+  if (!record_->source_links) {
+    return boost::none;
+  }
+  return source_information(get_file().get(), record_->source_links);
 }
 
-template<typename T>
-T reverse_byte_order(T* value) {
-  T result;
+const channel_conversation* channel::get_channel_conversation() const {
+  load_references();
+  return record_->conversion;
+}
 
-  char* ptr = reinterpret_cast<char*>(value) + sizeof(T) - 1;
-  char* rptr = reinterpret_cast<char*>(&result);
+boost::string_ref channel::get_name_ref() const {
+  return get_tx(get_file().get(), record_->links[2]);
+}
 
-  for (std::size_t i = 0; i < sizeof(T); i++) {
-    *rptr = *ptr;
+boost::string_ref channel::get_metadata_unit_ref() const {
+  return get_tx(get_file().get(), record_->links[6]);
+}
 
-    ptr--;
-    rptr++;
-  }
+boost::string_ref channel::get_metadata_comment_ref() const {
+  return get_tx(get_file().get(), record_->links[7]);
+}
 
-  return result;
+boost::string_ref channel::get_comment_ref() const {
+  return get_tx_comment(get_file().get(), record_->links[7]);
 }
 
-template<typename T>
-static void convert_none(const channel_conversation& cc, T& value) {
+channel::data_type channel::get_data_type() const {
+  return static_cast<data_type>(record_->cn.data_type);
 }
 
-template<typename T>
-static void convert_linear(const channel_conversation& cc, T& value) {
-  value = cc.val_[1] * value + cc.val_[0];
+bool channel::has_conversion() const {
+  const channel_conversation* cc = get_channel_conversation();
+  return cc && cc->block_.type != 0;
 }
 
 template<typename T>
-static void convert_rational(const channel_conversation& cc, T& value) {
-  auto o = cc.val_[0] * value * value + cc.val_[1] * value + cc.val_[2];
-  auto u = cc.val_[3] * value * value + cc.val_[4] * value + cc.val_[5];
-  value = o/u;
+decoder<T> channel::get_decoder() const {
+  return decoder<T>(record_->cn, get_channel_conversation());
 }
 
-template<typename From, typename To>
-static To convert_type(const void* void_ptr) {
-  const From* ptr = static_cast<const From*>(void_ptr);
-  return static_cast<To>(*ptr);
+validity_decoder channel::get_validity_decoder() const {
+  return validity_decoder(record_->cn, channel_group_->get_data_bytes(),
+      channel_group_->get_inval_bytes());
 }
 
-template<typename From, typename To>
-static To convert_from_be_type(const void* void_ptr) {
-  From from = *static_cast<const From*>(void_ptr);
-  return static_cast<To>(reverse_byte_order(&from));
+template<typename T>
+void channel::decode(const record_batch& batch, T* out) const {
+  get_decoder<T>()(batch, out);
 }
 
-typedef double (*convert_type_func)(const void*);
-typedef void (*convert_func)(const channel_conversation& cc, double& value);
+template<typename T>
+uint64_t channel::get_data(T* buffer, const decode_options& options) const {
+  return get_data(buffer, 0, channel_group_->get_cycle_count(), options);
+}
+
+template<typename T>
+uint64_t channel::get_data(T* buffer, uint64_t first, uint64_t last,
+    const decode_options& options) const {
+  decoder<T> decode = get_decoder<T>();
 
-static convert_func get_conv_func(const boost::optional<channel_conversation>& cc) {
-  if (cc) {
-    switch (cc->block_.type) {
-    case 0: return convert_none<double>; break;
-    case 1: return convert_linear<double>; break;
-    case 2: return convert_rational<double>; break;
-    default: throw error("Conversation type not supported");
+  if (get_type() == 3) {
+    last = std::min(last, channel_group_->get_cycle_count());
+    if (first >= last) {
+      return 0;
     }
-  } else {
-    return convert_none<double>;
+
+    record_batch batch = { nullptr, last - first, 0, first };
+    decode(batch, buffer);
+    return batch.count;
   }
-}
 
+  return channel_group_->decode_channel(decode, buffer, nullptr, nullptr, first, last,
+      options);
+}
 
-void channel::get_data_real(std::vector<double>& data) const {
-  auto n = channel_group_->get_cycle_count();
+template<typename T>
+uint64_t channel::get_data(T* buffer, uint8_t* validity, uint64_t first, uint64_t last,
+    const decode_options& options) const {
+  validity_decoder valid = get_validity_decoder();
+  if (get_type() == 3 || !valid.has_invalidation_bit()) {
+    uint64_t n = get_data(buffer, first, last, options);
+    record_batch batch = { nullptr, n, 0, first };
+    valid(batch, validity, 0);
+    return n;
+  }
 
-  auto nRecLen = channel_group_->get_data_bytes() + channel_group_->get_inval_bytes();
+  return channel_group_->decode_channel(get_decoder<T>(), buffer, &valid, validity,
+      first, last, options);
+}
 
-  convert_func conv_func = get_conv_func(channel_conversation_);
+void channel::get_data_real(std::vector<double>& data, std::vector<uint8_t>& validity,
+    const decode_options& options) const {
+  uint64_t count = channel_group_->get_cycle_count();
+  data.resize(count);
+  validity.resize((count + 7) / 8);
 
-  if (get_type() == 3) {
-    for (std::size_t i = 0; i < channel_group_->get_cycle_count(); i++) {
-      data.push_back(i);
+  uint64_t n = get_data(data.data(), validity.data(), 0, count, options);
+  data.resize(n);
+  validity.resize((n + 7) / 8);
+}
 
-      // Channel Conversion
-      if (channel_conversation_) {
-        conv_func(channel_conversation_.get(), data.back());
-      }
-    }
+void channel::get_data_real(std::vector<double>& data, const decode_options& options) const {
+  get_data_real(data, 0, channel_group_->get_cycle_count(), options);
+}
 
+void channel::get_data_real(std::vector<double>& data, uint64_t first, uint64_t last,
+    const decode_options& options) const {
+  last = std::min(last, channel_group_->get_cycle_count());
+  if (first >= last) {
     return;
   }
 
-  convert_type_func conv_type_func;
-  switch (cn_.data_type) {
-  case 0: // unsigned int, little endian
-    switch (cn_.bit_count) {
-    case 8: conv_type_func = convert_type<uint8_t, double>; break;
-    case 16: conv_type_func = convert_type<uint16_t, double>; break;
-    case 32: conv_type_func = convert_type<uint32_t, double>; break;
-    case 64: conv_type_func = convert_type<uint64_t, double>; break;
-    default: throw error("Bit count of integer type not supported");
-    }
-    break;
-
- case 1: // unsigned int, big endian
-    switch (cn_.bit_count) {
-    case 8: conv_type_func = convert_from_be_type<uint8_t, double>; break;
-    case 16: conv_type_func = convert_from_be_type<uint16_t, double>; break;
-    case 32: conv_type_func = convert_from_be_type<uint32_t, double>; break;
-    case 64: conv_type_func = convert_from_be_type<uint64_t, double>; break;
-    default: throw error("Bit count of integer type not supported");
+  std::size_t n = data.size();
+  data.resize(n + (last - first));
+  data.resize(n + get_data(data.data() + n, first, last, options));
+}
+
+std::vector<sample_summary> channel::summarize(uint64_t first, uint64_t last,
+    std::size_t bucket_count, const channel* master, double t0, double t1,
+    const decode_options& options) const {
+  last = std::min(last, channel_group_->get_available_records());
+  std::vector<sample_summary> result(bucket_count);
+  if (first >= last || bucket_count == 0) {
+    return result;
+  }
+
+  phase_timer timer(get_file()->get_counters(), file_counters::decode_phase);
+  decoder<double> decode = get_decoder<double>();
+  validity_decoder valid = get_validity_decoder();
+  bool none_valid = !valid.is_all_valid() && !valid.has_invalidation_bit();
+  boost::optional<decoder<double> > decode_master;
+  if (master) {
+    decode_master = master->get_decoder<double>();
+  }
+  double scale = t1 > t0 ? bucket_count / (t1 - t0) : 0;
+
+  // With a master channel the bucket of a record follows from its master
+  // value, otherwise bucket k holds the records from
+  // first + ceil(k * count / bucket_count) on.
+  uint64_t count = last - first;
+  auto bucket_start = [=](uint64_t k) {
+    return first + (k * count + bucket_count - 1) / bucket_count;
+  };
+
+  auto summarize_range = [&](uint64_t begin, uint64_t end, std::vector<sample_summary>& buckets) {
+    record_cursor records(channel_group_, begin, end);
+    records.set_read_ahead(options.read_ahead_blocks, options.read_ahead_bytes);
+    if (options.parallel) {
+      records.set_prefetch(0);
     }
-    break;
-
-  case 2: // int, little endian
-    switch (cn_.bit_count) {
-    case 8: conv_type_func = convert_type<int8_t, double>; break;
-    case 16: conv_type_func = convert_type<int16_t, double>; break;
-    case 32: conv_type_func = convert_type<int32_t, double>; break;
-    case 64: conv_type_func = convert_type<int64_t, double>; break;
-    default: throw error("Bit count of integer type not supported");
+
+    std::vector<double> values;
+    std::vector<double> times;
+    std::vector<uint8_t> bitmap;
+    std::size_t bucket = master ? 0 : (begin - first) * bucket_count / count;
+    uint64_t next_start = bucket_start(bucket + 1);
+
+    record_batch batch;
+    while (records.next(batch)) {
+      values.resize(batch.count);
+      decode(batch, values.data());
+      if (master) {
+        times.resize(batch.count);
+        decode_master.get()(batch, times.data());
+      }
+      if (valid.has_invalidation_bit()) {
+        bitmap.resize((batch.count + 7) / 8);
+        valid(batch, bitmap.data(), 0);
+      }
+
+      for (std::size_t i = 0; i < batch.count; i++) {
+        uint64_t record = batch.first_record + i;
+        if (master) {
+          double position = (times[i] - t0) * scale;
+          bucket = !(position >= 1) ? 0 : std::min<double>(position, bucket_count - 1);
+        } else {
+          while (record >= next_start) {
+            bucket++;
+            next_start = bucket_start(bucket + 1);
+          }
+        }
+
+        sample_summary& summary = buckets[bucket];
+        if (summary.records == 0) {
+          summary.first_record = record;
+        }
+        summary.records++;
+        if (!none_valid && (!valid.has_invalidation_bit() || (bitmap[i / 8] >> (i % 8)) & 1)) {
+          summary.add(values[i]);
+        }
+      }
     }
-    break;
-
-  case 3: // int, big endian
-    switch (cn_.bit_count) {
-    case 8: conv_type_func = convert_from_be_type<int8_t, double>; break;
-    case 16: conv_type_func = convert_from_be_type<int16_t, double>; break;
-    case 32: conv_type_func = convert_from_be_type<int32_t, double>; break;
-    case 64: conv_type_func = convert_from_be_type<int64_t, double>; break;
-    default: throw error("Bit count of integer type not supported");
+  };
+
+  if (!options.parallel || channel_group_->get_data_bytes() + channel_group_->get_inval_bytes() == 0) {
+    summarize_range(first, last, result);
+    return result;
+  }
+
+  thread_pool& pool = options.pool ? *options.pool : thread_pool::get_default();
+  std::vector<uint64_t> bounds = channel_group_->parallel_bounds(first, last, 1, pool);
+  std::vector<std::vector<sample_summary> > partial(bounds.size() - 1,
+      std::vector<sample_summary>(bucket_count));
+  pool.parallel_for(bounds.size() - 1, [&](std::size_t i) {
+    summarize_range(bounds[i], bounds[i + 1], partial[i]);
+  });
+
+  // the ranges are in record order
+  for (std::size_t i = 0; i < partial.size(); i++) {
+    for (std::size_t k = 0; k < bucket_count; k++) {
+      result[k].merge(partial[i][k]);
     }
-    break;
+  }
+  return result;
+}
+
+std::vector<sample_summary> channel::get_summary(uint64_t first, uint64_t last,
+    std::size_t bucket_count, const decode_options& options) const {
+  return summarize(first, last, bucket_count, nullptr, 0, 0, options);
+}
+
+std::vector<sample_summary> channel::get_summary_by_time(double t0, double t1,
+    std::size_t bucket_count, const decode_options& options) const {
+  const channel* master = channel_group_->get_master_channel();
+  if (!master) {
+    throw std::invalid_argument("channel group has no master channel");
+  }
+
+  std::pair<uint64_t, uint64_t> range = channel_group_->find_records(t0, t1);
+  return summarize(range.first, range.second, bucket_count, master, t0, t1, options);
+}
 
-  case 4: // real, little endian
-    switch (cn_.bit_count) {
-    case 32: conv_type_func = convert_type<float, double>; break;
-    case 64: conv_type_func = convert_type<double, double>; break;
-    default: throw error("Bit count of float type not supported");
+std::vector<sample_summary> channel::get_overview(std::size_t bucket_count,
+    const decode_options& options) const {
+  if (bucket_count > overview_size) {
+    return get_summary(0, channel_group_->get_cycle_count(), bucket_count, options);
+  }
+
+  // computed without a lock, if two threads compute the same overview the
+  // first stored one is kept
+  metadata_table& metadata = get_file()->get_metadata();
+  const std::vector<sample_summary>* overview = metadata.get_overview(record_);
+  if (!overview) {
+    overview = &metadata.set_overview(record_,
+        get_summary(0, channel_group_->get_cycle_count(), overview_size, options));
+  }
+
+  std::vector<sample_summary> result(bucket_count);
+  for (std::size_t k = 0; k < bucket_count; k++) {
+    for (std::size_t i = k * overview_size / bucket_count;
+        i < (k + 1) * overview_size / bucket_count; i++) {
+      result[k].merge(overview->at(i));
     }
-    break;
+  }
+  return result;
+}
+
+uint64_t channel::read_signal_data(string_data& data) const {
+  link l = record_->links[5];
+  if (l == 0) {
+    return 0;
+  }
+
+  rawfile_cursor cursor(get_file().get(), l);
+  block_header header = prase_block_header(cursor);
+  std::vector<link> links;
+  cursor.read_to_container(links, header.link_count);
 
-  case 5: // real, big endian
-    switch (cn_.bit_count) {
-    case 32: conv_type_func = convert_from_be_type<float, double>; break;
-    case 64: conv_type_func = convert_from_be_type<double, double>; break;
-    default: throw error("Bit count of float type not supported");
+  if (header.id == make_id('S', 'D') && get_file()->is_mapped()) {
+    // single block, the samples are used in place
+    uint64_t begin = cursor.tell();
+    if (header.length < begin - l || l + header.length > get_file()->size()) {
+      throw error("format error: wrong block length");
     }
-    break;
-
-/* else if (dt < 10) {
-    // @bug String data types
-    throw error("String data types not supported");
-    return 1e10;
-  } else if ( dt <= 14) {
-    // @bug Complex data types
-    //throw error("complex data types not supported");
-    return 1e10;
-  } else {
-    //throw error("error in data file");
-    return 1e10;
-  }*/
+    data.file_ = get_file();
+    data.mapped_ = get_file()->data() + begin;
+    return l + header.length - begin;
+  }
 
-  default:
-    throw error("wrong data type requested");
+  if (header.id == make_id('S', 'D') || header.id == make_id('D', 'Z')) {
+    append_signal_block(get_file().get(), l, data.buffer_);
+    return data.buffer_.size();
   }
 
-  if (cn_.bit_offset != 0) {
-    throw error("Bit offset in channel data not supported");
+  link next;
+  if (header.id == make_id('H', 'L')) {
+    next = links.at(0);
+  } else if (header.id == make_id('D', 'L')) {
+    next = l;
+  } else if (header.id == make_id('C', 'G')) {
+    throw error("VLSD channel groups not supported");
+  } else {
+    throw error("format error: expected SD, DL, HL or DZ block");
   }
 
-  const std::vector<std::string>& complete_data = channel_group_->get_data_group()->get_data();
-  for (std::size_t i = 0; i < complete_data.size(); i++) {
-    auto nBytes = complete_data[i].size();
-    auto nRec = std::min(n, nBytes / nRecLen);
+  while (next) {
+    rawfile_cursor dl_cursor(get_file().get(), next);
+    block_header dl = prase_block_header(dl_cursor, make_id('D', 'L'));
+    std::vector<link> dl_links;
+    dl_cursor.read_to_container(dl_links, dl.link_count);
+
+    for (std::size_t i = 1; i < dl_links.size(); i++) {
+      append_signal_block(get_file().get(), dl_links[i], data.buffer_);
+    }
+    next = dl_links.at(0);
+  }
+  return data.buffer_.size();
+}
 
-/*    const char* ptr = complete_data[i].data() + cn_.byte_offset;
-    for (std::size_t i = 0; i < nRec; i++) {
-      data.push_back(conv_type_func(ptr));
-      ptr += nRecLen;
-    }*/
+void channel::get_data_string(string_data& data, const decode_options& options) const {
+  get_data_string(data, 0, channel_group_->get_cycle_count(), options);
+}
 
-    auto range = make_memory_range<char>(complete_data[i].data(), nRec, cn_.byte_offset, nRecLen - 1);
-    for (const char& c : range) {
-      data.push_back(conv_type_func(&c));
+void channel::get_data_string(string_data& data, uint64_t first, uint64_t last,
+    const decode_options& options) const {
+  data.clear();
+  if (record_->cn.data_type < 6 || record_->cn.data_type > 12) {
+    throw error("channel has no string or byte array data");
+  }
+  phase_timer timer(get_file()->get_counters(), file_counters::decode_phase);
 
-      // Channel Conversion
-      if (channel_conversation_) {
-        conv_func(channel_conversation_.get(), data.back());
+  last = std::min(last, channel_group_->get_cycle_count());
+  if (first >= last) {
+    return;
+  }
+  data_type type = get_data_type();
+
+  if (get_type() == 1) {
+    uint64_t size = read_signal_data(data);
+
+    // offsets are unsigned integers in the records
+    cnblock cn = record_->cn;
+    cn.data_type = 0;
+    std::vector<uint64_t> offsets(last - first);
+    offsets.resize(channel_group_->decode(
+        std::vector<decoder<uint64_t> >(1, decoder<uint64_t>(cn, nullptr)),
+        std::vector<uint64_t*>(1, offsets.data()), first, last, options));
+
+    data.offsets_.reserve(offsets.size());
+    data.lengths_.reserve(offsets.size());
+    const char* signal_data = data.data();
+    for (uint64_t offset : offsets) {
+      uint32_t length;
+      if (offset > size || size - offset < sizeof(length)) {
+        throw error("format error: VLSD offset exceeds signal data");
+      }
+      memcpy(&length, signal_data + offset, sizeof(length));
+      offset += sizeof(length);
+      if (size - offset < length) {
+        throw error("format error: VLSD offset exceeds signal data");
       }
+
+      data.offsets_.push_back(offset);
+      data.lengths_.push_back(string_length(signal_data + offset, length, type));
+    }
+    return;
+  }
+
+  if (record_->cn.bit_offset != 0 || record_->cn.bit_count % 8 != 0) {
+    throw error("format error: string channel not byte aligned");
+  }
+  std::size_t bytes = record_->cn.bit_count / 8;
+  if (record_->cn.byte_offset + bytes > channel_group_->get_data_bytes()) {
+    throw error("format error: channel exceeds record");
+  }
+
+  data.offsets_.reserve(last - first);
+  data.lengths_.reserve(last - first);
+  record_cursor records(channel_group_, first, last);
+  record_batch batch;
+  while (records.next(batch)) {
+    const char* ptr = batch.data + record_->cn.byte_offset;
+    for (std::size_t i = 0; i < batch.count; i++) {
+      uint32_t length = string_length(ptr, bytes, type);
+      data.offsets_.push_back(data.buffer_.size());
+      data.lengths_.push_back(length);
+      data.buffer_.insert(data.buffer_.end(), ptr, ptr + length);
+      ptr += batch.record_size;
     }
   }
 }
 
+#define INSTANTIATE_DECODE(T) \
+  template decoder<T> channel::get_decoder<T>() const; \
+  template void channel::decode<T>(const record_batch&, T*) const; \
+  template uint64_t channel::get_data<T>(T*, const decode_options&) const; \
+  template uint64_t channel::get_data<T>(T*, uint64_t, uint64_t, \
+      const decode_options&) const; \
+  template uint64_t channel::get_data<T>(T*, uint8_t*, uint64_t, uint64_t, \
+      const decode_options&) const
+
+INSTANTIATE_DECODE(int8_t);
+INSTANTIATE_DECODE(uint8_t);
+INSTANTIATE_DECODE(int16_t);
+INSTANTIATE_DECODE(uint16_t);
+INSTANTIATE_DECODE(int32_t);
+INSTANTIATE_DECODE(uint32_t);
+INSTANTIATE_DECODE(int64_t);
+INSTANTIATE_DECODE(uint64_t);
+INSTANTIATE_DECODE(float);
+INSTANTIATE_DECODE(double);
+
 } // namespace mdf
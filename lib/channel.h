@@ -26,67 +26,181 @@
 #include <memory>
 #include <boost/optional.hpp>
 
-#include "block.h"
 #include "sourceinformation.h"
 #include "channelconversation.h"
+#include "recordcursor.h"
+#include "samplesummary.h"
+#include "stringdata.h"
 #include "detail/mdf4.h"
 #include "detail/macros.h"
+#include "detail/decoder.h"
+#include "detail/metadata.h"
 
 namespace mdf {
 
 class channel_group;
 
-class channel : block {
+/// A channel of a channel group. Only a handle: the CN block is a record in
+/// the metadata table of the file, see metadata_table.
+class channel {
 public:
+  // data type of the raw values (cn_data_type)
   enum class data_type {
-    // integer types, little endian
-    int8,
-    uint8,
-    int32,
-    uint32,
-    int64,
-    uint64,
+    // integer types
+    unsigned_le,
+    unsigned_be,
+    signed_le,
+    signed_be,
 
     // float types
-    real32,
-    real64,
+    real_le,
+    real_be,
+
+    // string types
+    string_latin1,
+    string_utf8,
+    string_utf16le,
+    string_utf16be,
 
     // other types
-    string,
-    complex
+    byte_array,
+    mime_sample,
+    mime_stream,
+    canopen_date,
+    canopen_time
   };
 
-  channel(const channel_group* cg, uint64_t l);
-
-  const boost::optional<source_information>& get_source_information() const
-      { return source_information_; }
-
-  const boost::optional<channel_conversation>& get_channel_conversation() const
-      { return channel_conversation_; }
-
-  std::string get_name() const;
-  std::string get_metadata_unit() const;
-  std::string get_metadata_comment() const;
-
-  void get_data_real(std::vector<double>& data) const;
+  channel(const channel_group* cg, channel_record* record) :
+    record_(record), channel_group_(cg)
+  { }
+
+  boost::optional<source_information> get_source_information() const;
+
+  /// conversion of the raw values, nullptr if there is none
+  const channel_conversation* get_channel_conversation() const;
+
+  std::string get_name() const { return get_name_ref().to_string(); }
+  std::string get_metadata_unit() const { return get_metadata_unit_ref().to_string(); }
+  std::string get_metadata_comment() const { return get_metadata_comment_ref().to_string(); }
+
+  /// comment text, the <TX> element if the comment is a MD block
+  std::string get_comment() const { return get_comment_ref().to_string(); }
+
+  // texts are cached per file, references stay valid while the file is open
+  boost::string_ref get_name_ref() const;
+  boost::string_ref get_metadata_unit_ref() const;
+  boost::string_ref get_metadata_comment_ref() const;
+  boost::string_ref get_comment_ref() const;
+
+  void get_data_real(std::vector<double>& data,
+      const decode_options& options = decode_options()) const;
+
+  /// append the samples of the records [first, last) to data
+  void get_data_real(std::vector<double>& data, uint64_t first, uint64_t last,
+      const decode_options& options = decode_options()) const;
+
+  /// Decode all samples as T into buffer, which must have space for
+  /// get_cycle_count() values of the channel group. Without a conversion the
+  /// raw values are cast to T directly, so integers keep their precision if
+  /// T is the native type. Returns the number of decoded samples.
+  ///
+  /// T can be any of int8_t ... uint64_t, float and double.
+  template<typename T>
+  uint64_t get_data(T* buffer, const decode_options& options = decode_options()) const;
+
+  /// Decode the samples of the records [first, last) into buffer, which must
+  /// have space for last - first values. Only the data blocks containing
+  /// these records are read.
+  template<typename T>
+  uint64_t get_data(T* buffer, uint64_t first, uint64_t last,
+      const decode_options& options = decode_options()) const;
+
+  /// Like above, and the validity of the samples goes to validity, which
+  /// must have space for (last - first + 7) / 8 bytes. See validity_decoder.
+  template<typename T>
+  uint64_t get_data(T* buffer, uint8_t* validity, uint64_t first, uint64_t last,
+      const decode_options& options = decode_options()) const;
+
+  /// Decode all samples into data and their validity bitmap into validity,
+  /// both are replaced. Without invalidation bits in the channel group no
+  /// record is read for the validity.
+  void get_data_real(std::vector<double>& data, std::vector<uint8_t>& validity,
+      const decode_options& options = decode_options()) const;
+
+  /// Read the samples of a string or byte array channel into data. Fixed
+  /// length samples are copied out of the records. For a VLSD channel
+  /// (channel type 1) the records hold offsets into the signal data, which
+  /// is read from the SD blocks as a whole.
+  void get_data_string(string_data& data,
+      const decode_options& options = decode_options()) const;
+
+  /// read only the samples of the records [first, last)
+  void get_data_string(string_data& data, uint64_t first, uint64_t last,
+      const decode_options& options = decode_options()) const;
+
+  /// Split the records [first, last) into bucket_count buckets of equal
+  /// record count and summarize the valid samples of every bucket. The
+  /// samples are aggregated batch by batch while decoding, so memory does not
+  /// grow with the count of records.
+  std::vector<sample_summary> get_summary(uint64_t first, uint64_t last,
+      std::size_t bucket_count, const decode_options& options = decode_options()) const;
+
+  /// Split [t0, t1] of the master channel into bucket_count buckets of equal
+  /// duration, like above. The values of the master channel must be
+  /// increasing, see channel_group::find_records().
+  std::vector<sample_summary> get_summary_by_time(double t0, double t1,
+      std::size_t bucket_count, const decode_options& options = decode_options()) const;
+
+  /// Summary of all records in bucket_count buckets. Up to overview_size
+  /// buckets, they are merged from a summary of overview_size buckets,
+  /// which is computed on first use and kept.
+  std::vector<sample_summary> get_overview(std::size_t bucket_count,
+      const decode_options& options = decode_options()) const;
+
+  static const std::size_t overview_size = 4096;
+
+  /// decode the samples of the records in batch, out must have space for
+  /// batch.count values
+  template<typename T>
+  void decode(const record_batch& batch, T* out) const;
+
+  /// decoder for many batches, resolves data type and conversion only once
+  template<typename T>
+  decoder<T> get_decoder() const;
+
+  /// decoder for the validity of the samples
+  validity_decoder get_validity_decoder() const;
+
+  /// true if the validity of the samples is given by an invalidation bit
+  bool has_invalidation_bit() const { return get_validity_decoder().has_invalidation_bit(); }
+
+  /// true if raw values are converted to physical values
+  bool has_conversion() const;
 
   data_type get_data_type() const;
-  unsigned get_type() const { return cn_.type; }
-  unsigned get_sync_type() const { return cn_.sync_type; }
+  unsigned get_bit_count() const { return record_->cn.bit_count; }
+  unsigned get_type() const { return record_->cn.type; }
+  unsigned get_sync_type() const { return record_->cn.sync_type; }
 
-  uint64_t get_next_channel() const { return links_[0]; }
+  uint64_t get_next_channel() const { return record_->links[0]; }
 
 private:
-  std::vector<uint64_t> links_;
+  channel_record* record_;
+  const channel_group* channel_group_;
 
-  boost::optional<source_information> source_information_;
-  boost::optional<channel_conversation> channel_conversation_;
+  const std::shared_ptr<rawfile>& get_file() const;
 
-  cnblock cn_;
+  void get_rawdata(void* data);
+  uint64_t read_signal_data(string_data& data) const;
+  std::vector<sample_summary> summarize(uint64_t first, uint64_t last,
+      std::size_t bucket_count, const channel* master, double t0, double t1,
+      const decode_options& options) const;
 
-  const channel_group* channel_group_;
+  void prase_references() const;
+  void load_references() const;
 
-  void get_rawdata(void* data);
+  friend class channel_group;
+  void relink(const channel_group* cg);
 };
 
 } // namespace mdf
@@ -21,20 +21,36 @@
 
 #include "channelconversation.h"
 
+#include "detail/conversiontable.h"
+
 namespace mdf {
 
-channel_conversation::channel_conversation(const std::shared_ptr<rawfile>& file, uint64_t l) :
-    file_(file), links_(), link_(l)
+channel_conversation::channel_conversation(const rawfile* file, uint64_t l) :
+    file_(file), links_(), link_(l), block_(), val_(), table_()
 {
-  file->seek(link_);
+  rawfile_cursor cursor(file_, link_, rawfile_cursor::read_mode::cached);
 
   // CC Channel conversion
-  block_header header = prase_block_header(file_.get(), make_id('C', 'C'));
-  file->read_to_container(links_, header.link_count);
+  block_header header = prase_block_header(cursor, make_id('C', 'C'));
+  cursor.read_to_container(links_, header.link_count);
 
   // p77 0: 1:1, 1: linear, ... 10: text-to-text
-  file->read(block_);
-  file->read_to_container(val_, block_.val_count);
+  cursor.read(block_);
+  cursor.read_to_container(val_, block_.val_count);
+
+  if (block_.type >= 3 && block_.type <= 10) {
+    // the texts of cc_ref, a conversion there (scaling of a value to
+    // text table) is not supported and leaves the table unset
+    try {
+      std::vector<boost::string_ref> refs;
+      for (std::size_t i = 4; i < links_.size(); i++) {
+        refs.push_back(get_tx(file_, links_[i]));
+      }
+      table_ = std::make_shared<conversion_table>(block_.type, val_, std::move(refs));
+    } catch (const error&) {
+      table_.reset();
+    }
+  }
 }
 
 } // namespace mdf
@@ -29,19 +29,30 @@
 
 namespace mdf {
 
+class conversion_table;
+
 class channel_conversation {
 public:
   channel_conversation();
-  channel_conversation(const std::shared_ptr<rawfile>& file, uint64_t l);
+  channel_conversation(const rawfile* file, uint64_t l);
+
+  /// p77 0: 1:1, 1: linear, ... 10: text-to-text
+  unsigned get_type() const { return block_.type; }
+
+  /// lookup structure of the types 3 to 10, null for the other types and
+  /// for conversions that are not supported
+  const std::shared_ptr<const conversion_table>& get_table() const { return table_; }
 
 public:
-  mutable std::shared_ptr<rawfile> file_;
+  const rawfile* file_;
   std::vector<uint64_t> links_;
 
   uint64_t link_; // link to this channel in the file
 
   ccblock block_;
   std::vector<double> val_;
+
+  std::shared_ptr<const conversion_table> table_;
 };
 
 } // namespace mdf
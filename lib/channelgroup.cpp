@@ -21,34 +21,500 @@
 
 #include "channelgroup.h"
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
 #include "datagroup.h"
+#include "detail/metadata.h"
+#include "detail/threadpool.h"
 
 namespace mdf
 {
 
-channel_group::channel_group(const data_group* dg, link l) :
-    block(dg->get_file(), l), links_(), channels_(), data_group_(dg)
+channel_group::channel_group(const data_group* dg, link l, bool lazy) :
+    block(dg->get_file(), l), links_(nullptr), channels_(), channels_prased_(false),
+    metadata_mutex_(new std::mutex()), data_group_(dg)
 {
-  file_->seek(l);
-  block_header header = prase_block_header(file_.get(), make_id('C', 'G'));
-  file_->read_to_container(links_, header.link_count);
+  rawfile_cursor cursor(file_.get(), l, rawfile_cursor::read_mode::cached);
+  block_header header = prase_block_header(cursor, make_id('C', 'G'));
+  std::vector<link> links;
+  cursor.read_to_container(links, header.link_count);
+  links_ = file_->get_metadata().store_links(links);
 
   cgblock cg;
-  file_->read(cg);
+  cursor.read(cg);
 
+  cg_record_id_ = cg.record_id;
   cg_cycle_count_ = cg.cycle_count;
+  cg_flags_ = cg.flags;
   cg_data_bytes_ = cg.data_bytes;
   cg_inval_bytes_ = cg.inval_bytes;
 
-  parse_channels();
+  if (!lazy) {
+    parse_channels(false);
+  }
 }
 
-void channel_group::parse_channels() {
+void channel_group::parse_channels(bool lazy) const {
+  phase_timer timer(file_->get_counters(), file_counters::metadata_phase);
+
+  // the CN blocks are read into one array of records and one slab of links
+  std::vector<channel_record> records;
+  std::vector<link> links;
+  std::vector<link> block_links;
   link next = links_[1];
   while (next) {
-    channels_.emplace_back(this, next);
-    next = channels_.back().get_next_channel();
+    rawfile_cursor cursor(file_.get(), next, rawfile_cursor::read_mode::cached);
+
+    // CN Channel
+    block_header header = prase_block_header(cursor, make_id('C', 'N'));
+    cursor.read_to_container(block_links, header.link_count);
+    if (block_links.size() < 8) {
+      throw error("format error: too few links in CN block");
+    }
+
+    channel_record record = channel_record();
+    cursor.read(record.cn);
+    record.link_count = block_links.size();
+    records.push_back(record);
+    links.insert(links.end(), block_links.begin(), block_links.end());
+
+    next = block_links[0];
+  }
+
+  metadata_table& metadata = file_->get_metadata();
+  const link* slab = metadata.store_links(links);
+  channel_record* stored = metadata.store_channels(records);
+
+  channels_.reserve(records.size());
+  for (std::size_t i = 0; i < records.size(); i++) {
+    stored[i].links = slab;
+    slab += stored[i].link_count;
+    channels_.emplace_back(this, &stored[i]);
+    if (!lazy) {
+      channels_.back().prase_references();
+    }
+  }
+  channels_prased_ = true;
+}
+
+const std::vector<channel>& channel_group::get_channels() const {
+  std::lock_guard<std::mutex> lock(*metadata_mutex_);
+  if (!channels_prased_) {
+    parse_channels(true);
+  }
+  return channels_;
+}
+
+void channel_group::relink(const data_group* dg) {
+  data_group_ = dg;
+  for (channel& ch : channels_) {
+    ch.relink(this);
+  }
+}
+
+const channel* channel_group::get_master_channel() const {
+  for (const channel& ch : get_channels()) {
+    if (ch.get_type() == 2 || ch.get_type() == 3) {
+      return &ch;
+    }
+  }
+  return nullptr;
+}
+
+uint64_t channel_group::get_available_records() const {
+  std::size_t record_size = get_data_bytes() + get_inval_bytes();
+  if (record_size == 0) {
+    return 0;
+  }
+
+  if (!get_data_group()->is_sorted()) {
+    return std::min<uint64_t>(get_cycle_count(),
+        get_data_group()->get_record_offsets(this).size());
+  }
+
+  uint64_t data_length = get_data_group()->get_block_offsets().back();
+  return std::min<uint64_t>(get_cycle_count(), data_length / record_size);
+}
+
+uint64_t channel_group::find_master_record(const channel& master, double t,
+    bool after) const {
+  // true if record is before the searched one
+  auto before = [t, after](double value) { return after ? value <= t : value < t; };
+
+  decoder<double> decode = master.get_decoder<double>();
+  auto value = [this, &decode](uint64_t record) {
+    double result;
+    record_cursor records(this, record, record + 1);
+    records.set_prefetch(0);
+    record_batch batch;
+    if (!records.next(batch)) {
+      throw error("format error: record of master channel missing");
+    }
+    decode(batch, &result);
+    return result;
+  };
+
+  if (master.get_type() == 3) {
+    // value is computed from the record index
+    uint64_t count = get_cycle_count();
+    auto index_value = [&decode](uint64_t record) {
+      double result;
+      record_batch batch = { nullptr, 1, 0, record };
+      decode(batch, &result);
+      return result;
+    };
+
+    const channel_conversation* cc = master.get_channel_conversation();
+    unsigned type = cc ? cc->block_.type : 0;
+    double offset = type == 1 ? cc->val_.at(0) : 0.0;
+    double factor = type == 1 ? cc->val_.at(1) : 1.0;
+    if (type <= 1 && factor > 0) {
+      double index = (t - offset) / factor;
+      uint64_t record = 0;
+      if (index > 0) {
+        record = std::min<double>(count, after ? std::floor(index) + 1 : std::ceil(index));
+      }
+
+      // correct rounding errors
+      while (record > 0 && !before(index_value(record - 1))) {
+        record--;
+      }
+      while (record < count && before(index_value(record))) {
+        record++;
+      }
+      return record;
+    }
+
+    uint64_t lo = 0, hi = count;
+    while (lo < hi) {
+      uint64_t mid = lo + (hi - lo) / 2;
+      if (before(index_value(mid))) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  uint64_t lo = 0, hi = get_available_records();
+  if (lo == hi) {
+    return 0;
+  }
+
+  if (get_data_group()->is_compressed() && get_data_group()->is_sorted()) {
+    // search the block first, only the first record of a block is read
+    std::size_t record_size = get_data_bytes() + get_inval_bytes();
+    std::vector<uint64_t> starts;
+    for (uint64_t offset : get_data_group()->get_block_offsets()) {
+      uint64_t record = (offset + record_size - 1) / record_size;
+      if (record >= hi) {
+        break;
+      }
+      if (starts.empty() || starts.back() != record) {
+        starts.push_back(record);
+      }
+    }
+
+    auto block = std::partition_point(starts.begin(), starts.end(),
+        [&](uint64_t record) { return before(value(record)); });
+    if (block == starts.begin()) {
+      return 0;
+    }
+    lo = *(block - 1);
+    if (block != starts.end()) {
+      hi = *block;
+    }
+
+    std::vector<double> values(hi - lo);
+    std::vector<decoder<double> > decoders(1, decode);
+    std::vector<double*> buffers(1, values.data());
+    values.resize(this->decode(decoders, buffers, lo, hi, decode_options()));
+    return lo + (std::partition_point(values.begin(), values.end(), before) - values.begin());
+  }
+
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (before(value(mid))) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+std::pair<uint64_t, uint64_t> channel_group::find_records(double t0, double t1) const {
+  const channel* master = get_master_channel();
+  if (!master) {
+    throw std::invalid_argument("channel group has no master channel");
+  }
+
+  uint64_t first = find_master_record(*master, t0, false);
+  if (t1 < t0) {
+    return std::make_pair(first, first);
+  }
+  return std::make_pair(first, std::max(first, find_master_record(*master, t1, true)));
+}
+
+uint64_t channel_group::get_window_real(const std::vector<const channel*>& channels,
+    std::vector<std::vector<double> >& data, double t0, double t1,
+    const decode_options& options) const {
+  std::pair<uint64_t, uint64_t> window = find_records(t0, t1);
+
+  std::vector<decoder<double> > decoders;
+  std::vector<double*> buffers;
+  data.resize(channels.size());
+  for (std::size_t i = 0; i < channels.size(); i++) {
+    decoders.push_back(channels[i]->get_decoder<double>());
+    data[i].resize(window.second - window.first);
+    buffers.push_back(data[i].data());
+  }
+
+  uint64_t n = decode(decoders, buffers, window.first, window.second, options);
+  for (auto& column : data) {
+    column.resize(n);
+  }
+
+  return window.first;
+}
+
+template<typename DecodeTile>
+uint64_t channel_group::decode_range(record_cursor& records, uint64_t first,
+    std::size_t tile_size, const DecodeTile& decode_tile) const {
+  uint64_t n = 0;
+
+  record_batch batch;
+  while (records.next(batch)) {
+    std::size_t tile_records = std::max<std::size_t>(1, tile_size / batch.record_size);
+
+    for (std::size_t begin = 0; begin < batch.count; begin += tile_records) {
+      record_batch tile = batch;
+      tile.data += begin * batch.record_size;
+      tile.count = std::min(tile_records, batch.count - begin);
+      tile.first_record += begin;
+      decode_tile(tile, tile.first_record - first);
+    }
+    n += batch.count;
+  }
+
+  return n;
+}
+
+template<typename T>
+uint64_t channel_group::decode(const std::vector<decoder<T> >& decoders,
+    const std::vector<T*>& buffers, const decode_options& options,
+    std::size_t tile_size) const {
+  return decode(decoders, buffers, 0, get_cycle_count(), options, tile_size);
+}
+
+template<typename T>
+uint64_t channel_group::decode(const std::vector<decoder<T> >& decoders,
+    const std::vector<T*>& buffers, uint64_t first, uint64_t last,
+    const decode_options& options, std::size_t tile_size) const {
+  return decode(decoders, buffers, std::vector<validity_decoder>(),
+      std::vector<uint8_t*>(), first, last, options, tile_size);
+}
+
+std::vector<uint64_t> channel_group::parallel_bounds(uint64_t first, uint64_t end,
+    uint64_t alignment, const thread_pool& pool) const {
+  std::size_t record_size = get_data_bytes() + get_inval_bytes();
+
+  // first record of every range, ranges of compressed data end at block
+  // boundaries so every block is decompressed only once
+  uint64_t min_records = std::max<uint64_t>(
+      min_parallel_bytes / record_size, (end - first) / (pool.size() * 4));
+  min_records += (alignment - min_records % alignment) % alignment;
+  min_records = std::max<uint64_t>(min_records, alignment); // 0 for few large records
+  std::vector<uint64_t> bounds(1, first);
+  if (get_data_group()->is_compressed() && get_data_group()->is_sorted()) {
+    for (uint64_t offset : get_data_group()->get_block_offsets()) {
+      uint64_t record = std::min(end, (offset + record_size - 1) / record_size);
+      record -= (record - std::min(record, first)) % alignment;
+      if (record > bounds.back() && record - bounds.back() >= min_records) {
+        bounds.push_back(record);
+      }
+    }
+  } else {
+    for (uint64_t record = first + min_records; record < end; record += min_records) {
+      bounds.push_back(record);
+    }
+  }
+  if (bounds.back() != end) {
+    bounds.push_back(end);
+  }
+  return bounds;
+}
+
+template<typename T>
+uint64_t channel_group::decode(const std::vector<decoder<T> >& decoders,
+    const std::vector<T*>& buffers,
+    const std::vector<validity_decoder>& validity,
+    const std::vector<uint8_t*>& bitmaps, uint64_t first, uint64_t last,
+    const decode_options& options, std::size_t tile_size) const {
+  if (decoders.size() != buffers.size() || validity.size() != bitmaps.size()) {
+    throw std::invalid_argument("count of channels and buffers differs");
+  }
+
+  return decode_records(first, last, !bitmaps.empty(), options, tile_size,
+      [&](const record_batch& tile, uint64_t index) {
+        for (std::size_t i = 0; i < decoders.size(); i++) {
+          decoders[i](tile, buffers[i] + index);
+        }
+        for (std::size_t i = 0; i < validity.size(); i++) {
+          validity[i](tile, bitmaps[i], index);
+        }
+      });
+}
+
+uint64_t channel_group::decode(const column_set& columns, uint64_t first, uint64_t last,
+    const decode_options& options, std::size_t tile_size) const {
+  return decode_records(first, last, columns.has_validity(), options, tile_size, columns);
+}
+
+template<typename T>
+uint64_t channel_group::decode_channel(const decoder<T>& decode, T* buffer,
+    const validity_decoder* valid, uint8_t* bitmap, uint64_t first, uint64_t last,
+    const decode_options& options) const {
+  return decode_records(first, last, valid != nullptr, options, default_tile_size,
+      [&](const record_batch& tile, uint64_t index) {
+        decode(tile, buffer + index);
+        if (valid) {
+          (*valid)(tile, bitmap, index);
+        }
+      });
+}
+
+template<typename DecodeTile>
+uint64_t channel_group::decode_records(uint64_t first, uint64_t last, bool bitmaps,
+    const decode_options& options, std::size_t tile_size,
+    const DecodeTile& decode_tile) const {
+  phase_timer timer(file_->get_counters(), file_counters::decode_phase);
+  std::size_t record_size = get_data_bytes() + get_inval_bytes();
+  if (!options.parallel || record_size == 0) {
+    record_cursor records(this, first, last);
+    records.set_read_ahead(options.read_ahead_blocks, options.read_ahead_bytes);
+    return decode_range(records, first, tile_size, decode_tile);
+  }
+
+  thread_pool& pool = options.pool ? *options.pool : thread_pool::get_default();
+  uint64_t end = std::min(last, get_available_records());
+  if (first >= end) {
+    return 0;
+  }
+
+  // ranges must not share bytes of the bitmaps
+  std::vector<uint64_t> bounds = parallel_bounds(first, end, bitmaps ? 8 : 1, pool);
+
+  pool.parallel_for(bounds.size() - 1, [&](std::size_t i) {
+    record_cursor records(this, bounds[i], bounds[i + 1]);
+    records.set_prefetch(0);
+    records.set_read_ahead(options.read_ahead_blocks, options.read_ahead_bytes);
+    decode_range(records, first, tile_size, decode_tile);
+  });
+
+  return end - first;
+}
+
+uint64_t channel_group::get_data_real(const std::vector<const channel*>& channels,
+    const std::vector<double*>& buffers, std::size_t tile_size) const {
+  if (channels.size() != buffers.size()) {
+    throw std::invalid_argument("count of channels and buffers differs");
+  }
+
+  std::vector<decoder<double> > decoders;
+  for (const channel* ch : channels) {
+    decoders.push_back(ch->get_decoder<double>());
+  }
+
+  return decode(decoders, buffers, decode_options(), tile_size);
+}
+
+uint64_t channel_group::get_data_real(const std::vector<const channel*>& channels,
+    const std::vector<double*>& buffers, const decode_options& options) const {
+  if (channels.size() != buffers.size()) {
+    throw std::invalid_argument("count of channels and buffers differs");
+  }
+
+  std::vector<decoder<double> > decoders;
+  for (const channel* ch : channels) {
+    decoders.push_back(ch->get_decoder<double>());
+  }
+
+  return decode(decoders, buffers, options);
+}
+
+void channel_group::get_data_real(const std::vector<const channel*>& channels,
+    std::vector<std::vector<double> >& data, const decode_options& options) const {
+  std::vector<double*> buffers;
+
+  data.resize(channels.size());
+  for (auto& column : data) {
+    column.resize(get_cycle_count());
+    buffers.push_back(column.data());
+  }
+
+  uint64_t n = get_data_real(channels, buffers, options);
+
+  for (auto& column : data) {
+    column.resize(n);
+  }
+}
+
+void channel_group::get_data_real(const std::vector<const channel*>& channels,
+    std::vector<std::vector<double> >& data,
+    std::vector<std::vector<uint8_t> >& validity, const decode_options& options) const {
+  std::vector<decoder<double> > decoders;
+  std::vector<double*> buffers;
+  std::vector<validity_decoder> validity_decoders;
+  std::vector<uint8_t*> bitmaps;
+
+  data.resize(channels.size());
+  validity.resize(channels.size());
+  for (std::size_t i = 0; i < channels.size(); i++) {
+    decoders.push_back(channels[i]->get_decoder<double>());
+    data[i].resize(get_cycle_count());
+    buffers.push_back(data[i].data());
+
+    validity_decoders.push_back(channels[i]->get_validity_decoder());
+    validity[i].resize((get_cycle_count() + 7) / 8);
+    bitmaps.push_back(validity[i].data());
+  }
+
+  uint64_t n = decode(decoders, buffers, validity_decoders, bitmaps, 0,
+      get_cycle_count(), options);
+
+  for (std::size_t i = 0; i < channels.size(); i++) {
+    data[i].resize(n);
+    validity[i].resize((n + 7) / 8);
   }
 }
 
+#define INSTANTIATE_DECODE(T) \
+  template uint64_t channel_group::decode<T>(const std::vector<decoder<T> >&, \
+      const std::vector<T*>&, const decode_options&, std::size_t) const; \
+  template uint64_t channel_group::decode<T>(const std::vector<decoder<T> >&, \
+      const std::vector<T*>&, const std::vector<validity_decoder>&, \
+      const std::vector<uint8_t*>&, uint64_t, uint64_t, const decode_options&, \
+      std::size_t) const; \
+  template uint64_t channel_group::decode<T>(const std::vector<decoder<T> >&, \
+      const std::vector<T*>&, uint64_t, uint64_t, const decode_options&, \
+      std::size_t) const; \
+  template uint64_t channel_group::decode_channel<T>(const decoder<T>&, T*, \
+      const validity_decoder*, uint8_t*, uint64_t, uint64_t, \
+      const decode_options&) const
+
+INSTANTIATE_DECODE(int8_t);
+INSTANTIATE_DECODE(uint8_t);
+INSTANTIATE_DECODE(int16_t);
+INSTANTIATE_DECODE(uint16_t);
+INSTANTIATE_DECODE(int32_t);
+INSTANTIATE_DECODE(uint32_t);
+INSTANTIATE_DECODE(int64_t);
+INSTANTIATE_DECODE(uint64_t);
+INSTANTIATE_DECODE(float);
+INSTANTIATE_DECODE(double);
+
 } // namespace mdf
@@ -22,9 +22,14 @@
 #ifndef CHANNELGROUP_H_
 #define CHANNELGROUP_H_
 
+#include <memory>
+#include <mutex>
+#include <utility>
+
 #include "detail/mdf4.h"
 #include "block.h"
 #include "channel.h"
+#include "recordcursor.h"
 
 namespace mdf
 {
@@ -35,28 +40,152 @@ class data_group;
 class channel_group : public block
 {
 public:
-  channel_group(const data_group* dg, link l);
+  channel_group(const data_group* dg, link l, bool lazy = false);
 
   uint64_t get_next_group() const { return links_[0]; }
   const data_group* get_data_group() const { return data_group_; }
-  const std::vector<channel>& get_channels() const { return channels_; }
+
+  /// channels of this group, read on first call if the file was opened lazy
+  const std::vector<channel>& get_channels() const;
+
+  /// master channel (channel type 2 or 3) of this group, nullptr if none
+  const channel* get_master_channel() const;
 
   // Channel Group
+  uint64_t get_record_id() const { return cg_record_id_; }
   uint64_t get_cycle_count() const { return cg_cycle_count_; }
+  uint16_t get_flags() const { return cg_flags_; }
   uint32_t get_data_bytes() const { return cg_data_bytes_; }
   uint32_t get_inval_bytes() const { return cg_inval_bytes_; }
 
+  /// stream over all records of this channel group
+  record_cursor get_records(std::size_t buffer_size = record_cursor::default_buffer_size) const {
+    return record_cursor(this, buffer_size);
+  }
+
+  /// Decode the samples of many channels of this group in one pass over the
+  /// records. buffers[i] gets the samples of channels[i] and must have space
+  /// for get_cycle_count() values. Returns the number of decoded records.
+  ///
+  /// The records are processed in tiles of tile_size bytes, all channels are
+  /// decoded from a tile while it is still in cache.
+  uint64_t get_data_real(const std::vector<const channel*>& channels,
+      const std::vector<double*>& buffers,
+      std::size_t tile_size = default_tile_size) const;
+
+  /// like above, with records decoded in parallel if requested in options
+  uint64_t get_data_real(const std::vector<const channel*>& channels,
+      const std::vector<double*>& buffers, const decode_options& options) const;
+
+  void get_data_real(const std::vector<const channel*>& channels,
+      std::vector<std::vector<double> >& data,
+      const decode_options& options = decode_options()) const;
+
+  /// like above, validity[i] gets the validity bitmap of channels[i]
+  void get_data_real(const std::vector<const channel*>& channels,
+      std::vector<std::vector<double> >& data,
+      std::vector<std::vector<uint8_t> >& validity,
+      const decode_options& options = decode_options()) const;
+
+  /// Decode records with the given decoders into buffers, each record goes to
+  /// the index of the record in the buffer. Returns the number of decoded
+  /// records.
+  template<typename T>
+  uint64_t decode(const std::vector<decoder<T> >& decoders,
+      const std::vector<T*>& buffers, const decode_options& options,
+      std::size_t tile_size = default_tile_size) const;
+
+  /// Decode only the records [first, last), record first goes to index 0.
+  /// Only the data blocks containing these records are read.
+  template<typename T>
+  uint64_t decode(const std::vector<decoder<T> >& decoders,
+      const std::vector<T*>& buffers, uint64_t first, uint64_t last,
+      const decode_options& options, std::size_t tile_size = default_tile_size) const;
+
+  /// Like above, and the validity of the samples of channel i goes to
+  /// bitmaps[i], bit k for record first + k. A bitmap must have space for
+  /// (last - first + 7) / 8 bytes. Invalidation bits are extracted in the
+  /// same pass as the values.
+  template<typename T>
+  uint64_t decode(const std::vector<decoder<T> >& decoders,
+      const std::vector<T*>& buffers,
+      const std::vector<validity_decoder>& validity,
+      const std::vector<uint8_t*>& bitmaps, uint64_t first, uint64_t last,
+      const decode_options& options, std::size_t tile_size = default_tile_size) const;
+
+  /// Like above for channels with samples of different types, all columns
+  /// are decoded in one pass over the records.
+  uint64_t decode(const column_set& columns, uint64_t first, uint64_t last,
+      const decode_options& options, std::size_t tile_size = default_tile_size) const;
+
+  /// Range [first, last) of the records whose master channel value is in
+  /// [t0, t1]. The values of the master channel must be increasing. A block
+  /// of compressed data is only decompressed if a sample of it is compared,
+  /// for a virtual master channel with a linear conversion no data is read.
+  std::pair<uint64_t, uint64_t> find_records(double t0, double t1) const;
+
+  /// Decode the records with master channel value in [t0, t1] into data,
+  /// data[i] gets the samples of channels[i]. Returns the index of the first
+  /// record of the window.
+  uint64_t get_window_real(const std::vector<const channel*>& channels,
+      std::vector<std::vector<double> >& data, double t0, double t1,
+      const decode_options& options = decode_options()) const;
+
+  static const std::size_t default_tile_size = 32 * 1024;
+
+  /// smallest range of records decoded by a parallel task
+  static const std::size_t min_parallel_bytes = 1 << 20;
+
 private:
-  std::vector<uint64_t> links_;
-  std::vector<channel> channels_;
+  const link* links_; // in the metadata table
+  mutable std::vector<channel> channels_;
+  mutable bool channels_prased_;
+
+  // guards channels_ and the lazy read parts of the channels
+  mutable std::unique_ptr<std::mutex> metadata_mutex_;
 
+  uint64_t cg_record_id_;
   uint64_t cg_cycle_count_;
+  uint16_t cg_flags_;
   uint32_t cg_data_bytes_;
   uint32_t cg_inval_bytes_;
 
   const data_group* data_group_;
 
-  void parse_channels();
+  void parse_channels(bool lazy) const;
+
+  friend class data_group;
+  friend class channel;
+  void relink(const data_group* dg);
+
+  uint64_t get_available_records() const;
+  uint64_t find_master_record(const channel& master, double t, bool after) const;
+
+  /// split [first, end) into ranges for parallel tasks, returns the bounds
+  /// of the ranges, every range but the last has a multiple of alignment
+  /// records
+  std::vector<uint64_t> parallel_bounds(uint64_t first, uint64_t end,
+      uint64_t alignment, const thread_pool& pool) const;
+
+  /// decode a single channel without building vectors of decoders and
+  /// buffers, valid and bitmap are nullptr without validity
+  template<typename T>
+  uint64_t decode_channel(const decoder<T>& decode, T* buffer,
+      const validity_decoder* valid, uint8_t* bitmap, uint64_t first, uint64_t last,
+      const decode_options& options) const;
+
+  /// Decode the records [first, last) in tiles of tile_size bytes with
+  /// decode_tile(tile, index of the first record of tile from first), in
+  /// parallel if requested in options. With bitmaps the parallel ranges
+  /// start at multiples of 8 records.
+  template<typename DecodeTile>
+  uint64_t decode_records(uint64_t first, uint64_t last, bool bitmaps,
+      const decode_options& options, std::size_t tile_size,
+      const DecodeTile& decode_tile) const;
+
+  template<typename DecodeTile>
+  uint64_t decode_range(record_cursor& records, uint64_t first, std::size_t tile_size,
+      const DecodeTile& decode_tile) const;
 };
 
 } // namespace mdf
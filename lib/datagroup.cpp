@@ -22,125 +22,311 @@
 #include "datagroup.h"
 
 #include "detail/mdf4.h"
+#include "detail/metadata.h"
 #include "detail/rawfile.h"
+#include "recordcursor.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
 #include <vector>
 
 namespace mdf {
 
-data_group::data_group(std::shared_ptr<rawfile>& file, uint64_t l) :
-    block(file, l), links_(), channel_groups_(), rec_id_size_()
+data_group::data_group(std::shared_ptr<rawfile>& file, uint64_t l, bool lazy) :
+    block(file, l), links_(nullptr), channel_groups_(), rec_id_size_(),
+    data_blocks_(), equal_length_(), compressed_(), dl_offsets_(),
+    block_offsets_(), data_mutex_(new std::mutex()),
+    record_offsets_(), index_mutex_(new std::mutex())
 {
-  file->seek(l);
-  block_header header = prase_block_header(file.get(), make_id('D', 'G'));
-  file->read_to_container(links_, header.link_count);
+  rawfile_cursor cursor(file.get(), l, rawfile_cursor::read_mode::cached);
+  block_header header = prase_block_header(cursor, make_id('D', 'G'));
+  std::vector<link> links;
+  cursor.read_to_container(links, header.link_count);
+  links_ = file->get_metadata().store_links(links);
 
-  file->read(rec_id_size_);
-  if (rec_id_size_ != 0) {
-    throw std::invalid_argument("unsorted MDF4 files not supported");
+  cursor.read(rec_id_size_);
+  if (rec_id_size_ != 0 && rec_id_size_ != 1 && rec_id_size_ != 2 &&
+      rec_id_size_ != 4 && rec_id_size_ != 8) {
+    throw error("format error: invalid record id size");
   }
 
-  prase_channel_groups();
+  prase_channel_groups(lazy);
 }
 
-void data_group::prase_channel_groups() {
+void data_group::prase_channel_groups(bool lazy) {
   link next = links_[1];
   while (next) {
-    channel_groups_.emplace_back(this, next);
+    channel_groups_.emplace_back(this, next, lazy);
     next = channel_groups_.back().get_next_group();
   }
 }
 
-std::string data_group::get_metadata_comment() const {
-  return prase_tx(file_.get(), links_[3]);
+void data_group::relink() {
+  for (channel_group& cg : channel_groups_) {
+    cg.relink(this);
+  }
+}
+
+boost::string_ref data_group::get_metadata_comment_ref() const {
+  return get_tx(file_.get(), links_[3]);
 }
 
+std::vector<link> data_group::read_DL(const rawfile* file, link pos) const {
+  std::vector<link> dt_links;
+  uint64_t equal_length = 0;
+  bool length_known = false; // equal_length is set by a DL block before
+  std::vector<uint64_t> offsets;
+  bool offsets_valid = true;
+
+  link next = pos;
+  while (next) {
+    rawfile_cursor cursor(file, next);
+    block_header dl = prase_block_header(cursor, make_id('D', 'L'));
+
+    std::vector<link> dl_links;
+    cursor.read_to_container(dl_links, dl.link_count);
+
+    std::size_t first = dt_links.size();
+    dt_links.insert(dt_links.end(), dl_links.begin() + 1, dl_links.end());
 
+    dlblock dl_data;
+    cursor.read(dl_data);
+    if (dl_data.flags & 1) {
+      uint64_t length;
+      cursor.read(length);
+      if (!length_known) {
+        equal_length = length;
+      } else if (equal_length != length) {
+        // offsets of the blocks before are not multiples of length
+        equal_length = 0;
+        offsets_valid = false;
+      }
+      length_known = true;
 
-std::vector<std::string> data_group::get_recs(rawfile* file, std::vector<link> dt_links) const {
-    std::vector<std::string> data;
+      for (std::size_t i = first; i < dt_links.size(); i++) {
+        offsets.push_back(i * length);
+      }
+    } else {
+      equal_length = 0;
+      length_known = true;
 
-    for (std::size_t i = 0; i < dt_links.size(); i++) {
-        file->seek(dt_links[i]);
-        block_header dt = prase_block_header(file, make_id('D', 'T'));
-        uint64_t ndt_Bytes = dt.length - 24;
-//        uint64_t ndt_Rec = ndt_Bytes / (get_data_bytes() + get_inval_bytes());
-        data.push_back(std::string());
-        file->read_to_container(data.back(), ndt_Bytes);
+      std::vector<uint64_t> dl_offsets;
+      cursor.read_to_container(dl_offsets, dt_links.size() - first);
+      offsets.insert(offsets.end(), dl_offsets.begin(), dl_offsets.end());
     }
-    return data;
+
+    next = dl_links[0];
+  }
+
+  equal_length_ = equal_length;
+  if (offsets_valid) {
+    dl_offsets_ = std::move(offsets);
+  }
+  return dt_links;
 }
 
-/*std::string _mdf4_get_recs_one(rawfile* file, data_group* dg, std::vector<link> dt_links, std::size_t i) {
-  file->seek(dt_links[i]);
-  block_header dt = prase_block_header(file, make_id('D', 'T'));
-  uint64_t ndt_Bytes = dt.length - 24;
-
-    std::string data;
-    file->read_to_container(data[i], ndt_Bytes);
-    if (ctx.ssRest.size() > 0) {
-        data = ctx.ssRest + data;
-        ndt_Bytes = data.size();
-        ctx.ssRest.clear();
-    }
-    uint64_t nRest = ndt_Bytes % (dg->cg_data_bytes_ + dg->cg_inval_bytes_);
-    if (nRest != 0) {
-        ctx.ssRest.assign(data, ndt_Bytes-nRest+1, nRest);
-        data.assign(data, 0, ndt_Bytes-nRest);
+const std::vector<link>& data_group::get_data_blocks() const {
+  std::lock_guard<std::mutex> lock(*data_mutex_);
+  return get_data_blocks_locked();
+}
+
+uint64_t data_group::get_equal_length() const {
+  std::lock_guard<std::mutex> lock(*data_mutex_);
+  get_data_blocks_locked();
+  return equal_length_;
+}
+
+bool data_group::is_compressed() const {
+  std::lock_guard<std::mutex> lock(*data_mutex_);
+  get_data_blocks_locked();
+  return compressed_;
+}
+
+uint64_t data_group::read_data_length(const rawfile* file, link l) {
+  rawfile_cursor cursor(file, l);
+  block_header header = prase_block_header(cursor);
+  if (header.length < sizeof(block_header) + header.link_count * sizeof(link)) {
+    throw error("format error: wrong block length");
+  }
+
+  if (header.id == make_id('D', 'Z')) {
+    dzblock dz;
+    cursor.skip(header.link_count * sizeof(link));
+    cursor.read(dz);
+    return dz.org_data_length;
+  } else if (header.id != make_id('D', 'T')) {
+    throw error("format error: expected DT or DZ block");
+  }
+
+  return header.length - sizeof(block_header) - header.link_count * sizeof(link);
+}
+
+const std::vector<uint64_t>& data_group::get_block_offsets() const {
+  std::lock_guard<std::mutex> lock(*data_mutex_);
+  if (!block_offsets_) {
+    const std::vector<link>& blocks = get_data_blocks_locked();
+
+    std::vector<uint64_t> offsets;
+    offsets.reserve(blocks.size() + 1);
+    if (!blocks.empty() && dl_offsets_.size() == blocks.size()) {
+      // offsets are given by the DL blocks, only the length of the last block
+      // is missing
+      offsets = dl_offsets_;
+      offsets.push_back(offsets.back() + read_data_length(file_.get(), blocks.back()));
+      if (!std::is_sorted(offsets.begin(), offsets.end())) {
+        throw error("format error: unsorted offsets in DL block");
+      }
+    } else {
+      offsets.push_back(0);
+      for (link l : blocks) {
+        offsets.push_back(offsets.back() + read_data_length(file_.get(), l));
+      }
     }
-    return data;
-}*/
 
+    block_offsets_ = std::move(offsets);
+  }
 
+  return block_offsets_.get();
+}
 
-/*
-Erstmal Vektor von DT-Links aufbauen, dann über alle DT-Blöcke gehen und die
-Daten in 1000er-Blöcken nach oGroup.data[i] kopieren.
-*/
-void data_group::read_DL(rawfile* file, link pos) const {
-//  int nExtra = 0;
-//  int dt_first = 0;
-  std::vector<link> dt_extra;
+const std::vector<uint64_t>& data_group::get_record_offsets(const channel_group* cg) const {
+  std::lock_guard<std::mutex> lock(*index_mutex_);
+  if (!record_offsets_) {
+    record_offsets_ = index_records();
+  }
+  return record_offsets_->at(cg - channel_groups_.data());
+}
 
-  link next = pos;
-  while (next) {
-    file->seek(next);
-    block_header dl = prase_block_header(file, make_id('D', 'L'));
+std::vector<std::vector<uint64_t> > data_group::index_records() const {
+  struct record_type {
+    std::size_t group;
+    uint64_t length;
+    bool variable; // VLSD channel group, length is in front of the data
+  };
 
-    std::vector<link> dl_links;
-    file->read_to_container(dl_links, dl.link_count);
+  std::unordered_map<uint64_t, record_type> types;
+  for (std::size_t i = 0; i < channel_groups_.size(); i++) {
+    const channel_group& cg = channel_groups_[i];
+    record_type type = { i, uint64_t(cg.get_data_bytes()) + cg.get_inval_bytes(),
+        (cg.get_flags() & 1) != 0 };
+    types[cg.get_record_id()] = type;
+  }
 
-    dt_extra.insert(dt_extra.end(), dl_links.begin() + 1, dl_links.end());
+  std::vector<std::vector<uint64_t> > offsets(channel_groups_.size());
+  if (types.empty()) {
+    return offsets;
+  }
 
-    /*
-                // Wird nicht benötigt
-                dl_flags = fread_uint8(fp, 1);
-                reserved = fread_uint8(fp, 3);
-                dl_count = fread_uint32(fp, 1);
-                if (dl_flags & 1) {
-                    dl_equal_length = fread_uint64(fp, 1);
-                } else {
-                    dl_offset = fread_uint64(fp, dl_count);
-                }*/
+  // The data is read in batches of bytes, record ids and lengths can
+  // straddle two batches and are put together in header.
+  record_cursor stream(this, 1, 0, std::numeric_limits<uint64_t>::max());
+  record_batch batch;
 
+  char header[8];
+  std::size_t header_size = rec_id_size_;
+  std::size_t filled = 0;
+  const record_type* type = nullptr; // set while the VLSD length is read
+  std::size_t group = 0; // group of last record
+  uint64_t skip = 0; // rest of current record
+  uint64_t offset = 0;
+  while (stream.next(batch)) {
+    const char* p = batch.data;
+    const char* end = p + batch.count;
+    while (p != end) {
+      if (skip != 0) {
+        uint64_t n = std::min<uint64_t>(skip, end - p);
+        p += n;
+        offset += n;
+        skip -= n;
+        continue;
+      }
 
-    next = dl_links[0];
+      std::size_t n = std::min<std::size_t>(header_size - filled, end - p);
+      std::copy(p, p + n, header + filled);
+      p += n;
+      offset += n;
+      filled += n;
+      if (filled < header_size) {
+        continue;
+      }
+      filled = 0;
+
+      if (!type) {
+        uint64_t id = 0;
+        std::memcpy(&id, header, rec_id_size_);
+        auto it = types.find(id);
+        if (it == types.end()) {
+          throw error("format error: unknown record id in data group");
+        }
+
+        group = it->second.group;
+        offsets[group].push_back(offset);
+        if (it->second.variable) {
+          type = &it->second;
+          header_size = sizeof(uint32_t);
+          continue;
+        }
+        skip = it->second.length;
+      } else {
+        uint32_t length;
+        std::memcpy(&length, header, sizeof(length));
+        skip = length;
+        type = nullptr;
+        header_size = rec_id_size_;
+      }
+    }
   }
 
-  data_.get() = get_recs(file, dt_extra);
+  if (type || skip != 0) {
+    // last record is incomplete
+    offsets[group].pop_back();
+  }
+  return offsets;
 }
 
-void data_group::read_DT(rawfile* file, data_group* dg, link pos) const {
-  data_.get() = get_recs(file, { pos });
-}
+const std::vector<link>& data_group::get_data_blocks_locked() const {
+  if (!data_blocks_) {
+    link data = links_[2];
+    if (data == 0) {
+      data_blocks_ = std::vector<link>();
+    } else {
+      rawfile_cursor cursor(file_.get(), data);
+      block_header header = prase_block_header(cursor);
+      if (header.id == make_id('D', 'T')) {
+        // only one data block
+        data_blocks_ = std::vector<link>(1, data);
+      } else if (header.id == make_id('D', 'Z')) {
+        data_blocks_ = std::vector<link>(1, data);
+        compressed_ = true;
+      } else if (header.id == make_id('H', 'L')) {
+        // DL list of DZ blocks
+        std::vector<link> hl_links;
+        cursor.read_to_container(hl_links, header.link_count);
+        data_blocks_ = read_DL(file_.get(), hl_links.at(0));
+        compressed_ = true;
+      } else {
+        data_blocks_ = read_DL(file_.get(), data);
 
-const std::vector<std::string>& data_group::get_data() const {
-  if (!data_) {
-    data_ = std::move(std::vector<std::string>());
-    read_DL(file_.get(), links_[2]);
+        // since mdf 4.2 the list can hold DZ blocks without HL block, then
+        // the headers are read up to the first DZ block
+        idblock id;
+        file_->read_cached(0, &id, sizeof(id));
+        if (id.version_number >= 420) {
+          for (link l : *data_blocks_) {
+            rawfile_cursor block_cursor(file_.get(), l);
+            if (prase_block_header(block_cursor).id == make_id('D', 'Z')) {
+              compressed_ = true;
+              break;
+            }
+          }
+        }
+      }
+    }
   }
 
-  return data_.get();
+  return data_blocks_.get();
 }
 
 } // namespace mdf
@@ -23,6 +23,7 @@
 #define GROUP_H_
 
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <boost/optional.hpp>
@@ -36,29 +37,65 @@ class rawfile;
 
 class data_group : public block {
 public:
-  data_group(std::shared_ptr<rawfile>& file, uint64_t l);
+  data_group(std::shared_ptr<rawfile>& file, uint64_t l, bool lazy = false);
 
-  std::string get_metadata_comment() const;
+  std::string get_metadata_comment() const { return get_metadata_comment_ref().to_string(); }
+  boost::string_ref get_metadata_comment_ref() const;
 
   uint64_t get_next_group() const { return links_[0]; }
 
   const std::vector<channel_group>& get_channel_groups() const { return channel_groups_; }
 
-  const std::vector<std::string>& get_data() const;
+  /// links to all DT or DZ blocks of this data group in order
+  const std::vector<link>& get_data_blocks() const;
+
+  /// (uncompressed) data length of all blocks except the last one, 0 if not
+  /// equal
+  uint64_t get_equal_length() const;
+
+  /// true if data blocks can be DZ blocks
+  bool is_compressed() const;
+
+  /// Offset of the (uncompressed) data of every data block in the data of
+  /// this group, followed by the total data length. Taken from the DL blocks
+  /// if possible, so at most one block header is read.
+  const std::vector<uint64_t>& get_block_offsets() const;
+
+  /// false if the records of the channel groups are interleaved, each record
+  /// begins with the record id of its channel group then
+  bool is_sorted() const { return rec_id_size_ == 0; }
+
+  /// Offset of every record of cg in the data of this unsorted group,
+  /// pointing behind the record id. The records of all channel groups are
+  /// indexed on first call in one pass over the data.
+  const std::vector<uint64_t>& get_record_offsets(const channel_group* cg) const;
 
 private:
-  std::vector<uint64_t> links_;
+  const link* links_; // in the metadata table
   std::vector<channel_group> channel_groups_;
 
   uint8_t rec_id_size_;
 
-  mutable boost::optional<std::vector<std::string> > data_;
+  mutable boost::optional<std::vector<link> > data_blocks_;
+  mutable uint64_t equal_length_;
+  mutable bool compressed_;
+  mutable std::vector<uint64_t> dl_offsets_; // offsets of blocks from DL blocks
+  mutable boost::optional<std::vector<uint64_t> > block_offsets_;
+  mutable std::unique_ptr<std::mutex> data_mutex_; // guards data_blocks_, block_offsets_
+
+  // record offsets of every channel group of an unsorted group
+  mutable boost::optional<std::vector<std::vector<uint64_t> > > record_offsets_;
+  mutable std::unique_ptr<std::mutex> index_mutex_; // guards record_offsets_
+
+  const std::vector<link>& get_data_blocks_locked() const;
+  std::vector<link> read_DL(const rawfile* file, link pos) const;
+  static uint64_t read_data_length(const rawfile* file, link l);
+  std::vector<std::vector<uint64_t> > index_records() const;
 
-  std::vector<std::string> get_recs(rawfile* file, std::vector<link> dt_links) const;
-  void read_DL(rawfile* file, link pos) const;
-  void read_DT(rawfile* file, data_group* dg, link pos) const;
+  void prase_channel_groups(bool lazy);
 
-  void prase_channel_groups();
+  friend class file;
+  void relink();
 };
 
 } // namespace mdf
@@ -0,0 +1,96 @@
+/*
+ * bits.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBMDF_BITS_H_
+#define LIBMDF_BITS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace mdf {
+namespace bits {
+
+// A bit field of an integer channel is bit_count bits from bit_offset on in
+// the little or big endian integer made of the bytes the field touches.
+
+/// bytes touched by a field, at most 9
+inline unsigned field_bytes(unsigned bit_offset, unsigned bit_count) {
+  return (bit_offset + bit_count + 7) / 8;
+}
+
+inline uint64_t field_mask(unsigned bit_count) {
+  return bit_count >= 64 ? ~uint64_t(0) : (uint64_t(1) << bit_count) - 1;
+}
+
+inline int64_t sign_extend(uint64_t value, unsigned bit_count) {
+  uint64_t sign = uint64_t(1) << (bit_count - 1);
+  return static_cast<int64_t>((value ^ sign) - sign);
+}
+
+/// 8 bytes at ptr, byte swapped for big endian
+inline uint64_t load_word(const char* ptr, bool big_endian) {
+  uint64_t word;
+  memcpy(&word, ptr, sizeof(word));
+  return big_endian ? __builtin_bswap64(word) : word;
+}
+
+/// Right shift of a field in the word loaded at its first byte. Only valid
+/// if the field touches at most 8 bytes.
+inline unsigned word_shift(unsigned bit_offset, unsigned bit_count, bool big_endian) {
+  return big_endian ? 64 - 8 * field_bytes(bit_offset, bit_count) + bit_offset : bit_offset;
+}
+
+/// Number of records from the begin of a batch for which load_word at
+/// byte_offset does not read beyond the end of the batch.
+inline std::size_t word_records(std::size_t count, std::size_t record_size,
+    std::size_t byte_offset) {
+  std::size_t tail = (byte_offset + sizeof(uint64_t) - 1) / record_size;
+  return count > tail ? count - tail : 0;
+}
+
+/// read a field byte by byte, nothing behind its last byte is read
+inline uint64_t load_field(const char* ptr, unsigned bit_offset,
+    unsigned bit_count, bool big_endian) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(ptr);
+  unsigned n = field_bytes(bit_offset, bit_count);
+  unsigned low = n > 8 ? 8 : n;
+
+  // lower 8 bytes of the integer
+  const unsigned char* first = big_endian ? bytes + (n - low) : bytes;
+  uint64_t word = 0;
+  for (unsigned i = 0; i < low; i++) {
+    word = (word << 8) | first[big_endian ? i : low - 1 - i];
+  }
+
+  uint64_t value = word >> bit_offset;
+  if (n > 8) {
+    // only with bit_offset > 0
+    uint64_t high = big_endian ? bytes[0] : bytes[8];
+    value |= high << (64 - bit_offset);
+  }
+  return value & field_mask(bit_count);
+}
+
+} // namespace bits
+} // namespace mdf
+
+#endif // LIBMDF_BITS_H_
@@ -0,0 +1,266 @@
+/*
+ * conversiontable.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "conversiontable.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "mdf4.h"
+
+namespace mdf {
+
+namespace {
+
+/// index of the last key not greater than x, -1 if x is less than all keys
+/// or NaN; the loop has no data dependent branches
+inline std::ptrdiff_t find_last_not_greater(const std::vector<double>& keys, double x) {
+  std::size_t n = keys.size();
+  if (n == 0 || !(keys[0] <= x)) {
+    return -1;
+  }
+
+  const double* base = keys.data();
+  while (n > 1) {
+    std::size_t half = n / 2;
+    base = base[half] <= x ? base + half : base;
+    n -= half;
+  }
+  return base - keys.data();
+}
+
+// direct tables are used up to this number of entries
+const int64_t max_direct_size = 1 << 16;
+
+} // namespace
+
+conversion_table::conversion_table(unsigned type, const std::vector<double>& val,
+    std::vector<boost::string_ref> refs) :
+    type_(type), keys_(), upper_(), values_(), default_(), direct_first_(),
+    direct_(), formula_(), texts_(), text_values_(), text_texts_(),
+    text_default_(), has_text_default_()
+{
+  // entries of a table: key, upper bound and result
+  struct entry {
+    double key;
+    double upper;
+    double value;
+  };
+  std::vector<entry> entries;
+
+  switch (type) {
+  case 3: // algebraic
+    if (refs.empty()) {
+      throw error("format error: algebraic conversion without formula");
+    }
+    formula_.reset(new formula(refs[0]));
+    return;
+
+  case 4: // value to value with interpolation
+  case 5: // value to value without interpolation
+    for (std::size_t i = 0; i + 1 < val.size(); i += 2) {
+      entry e = { val[i], val[i], val[i + 1] };
+      entries.push_back(e);
+    }
+    if (entries.empty()) {
+      throw error("format error: empty conversion table");
+    }
+    break;
+
+  case 6: // value range to value
+    if (val.empty()) {
+      throw error("format error: value range conversion without default");
+    }
+    for (std::size_t i = 0; i + 3 < val.size(); i += 3) {
+      entry e = { val[i], val[i + 1], val[i + 2] };
+      entries.push_back(e);
+    }
+    default_ = val.back();
+    break;
+
+  case 7: // value to text
+    if (refs.size() < val.size() + 1) {
+      throw error("format error: missing texts in value to text conversion");
+    }
+    for (std::size_t i = 0; i < val.size(); i++) {
+      entry e = { val[i], val[i], double(i) };
+      entries.push_back(e);
+    }
+    default_ = val.size();
+    texts_.assign(refs.begin(), refs.begin() + val.size() + 1);
+    break;
+
+  case 8: // value range to text
+    for (std::size_t i = 0; i + 1 < val.size(); i += 2) {
+      entry e = { val[i], val[i + 1], double(i / 2) };
+      entries.push_back(e);
+    }
+    if (refs.size() < entries.size() + 1) {
+      throw error("format error: missing texts in value range to text conversion");
+    }
+    default_ = entries.size();
+    texts_.assign(refs.begin(), refs.begin() + entries.size() + 1);
+    break;
+
+  case 9: // text to value
+    if (val.size() < refs.size() + 1) {
+      throw error("format error: missing values in text to value conversion");
+    }
+    for (std::size_t i = 0; i < refs.size(); i++) {
+      text_values_.emplace_back(refs[i], val[i]);
+    }
+    default_ = val[refs.size()];
+    // first entry of equal keys is used
+    std::stable_sort(text_values_.begin(), text_values_.end(),
+        [](const std::pair<boost::string_ref, double>& a,
+           const std::pair<boost::string_ref, double>& b) { return a.first < b.first; });
+    return;
+
+  case 10: // text to text
+    for (std::size_t i = 0; i + 1 < refs.size(); i += 2) {
+      text_texts_.emplace_back(refs[i], refs[i + 1]);
+    }
+    if (refs.size() % 2 == 1) {
+      // an unset default keeps the text
+      text_default_ = refs.back();
+      has_text_default_ = text_default_.data() != nullptr;
+    }
+    std::stable_sort(text_texts_.begin(), text_texts_.end(),
+        [](const std::pair<boost::string_ref, boost::string_ref>& a,
+           const std::pair<boost::string_ref, boost::string_ref>& b) { return a.first < b.first; });
+    return;
+
+  default:
+    throw error("Conversation type not supported");
+  }
+
+  // sort by key, of equal keys the first one is used
+  std::stable_sort(entries.begin(), entries.end(),
+      [](const entry& a, const entry& b) { return a.key < b.key; });
+  entries.erase(std::unique(entries.begin(), entries.end(),
+      [](const entry& a, const entry& b) { return a.key == b.key; }), entries.end());
+
+  for (const entry& e : entries) {
+    keys_.push_back(e.key);
+    upper_.push_back(e.upper);
+    values_.push_back(e.value);
+  }
+  if (type_ != 6 && type_ != 8) {
+    upper_.clear();
+  }
+
+  build_direct_table();
+}
+
+void conversion_table::build_direct_table() {
+  if (keys_.empty()) {
+    return;
+  }
+
+  double first = std::ceil(keys_.front());
+  double last = std::floor(upper_.empty() ? keys_.back()
+      : *std::max_element(upper_.begin(), upper_.end()));
+  if (!std::isfinite(first) || !std::isfinite(last) || first > last ||
+      first < -4e18 || last > 4e18) {
+    return;
+  }
+
+  // only for dense keys
+  int64_t size = static_cast<int64_t>(last) - static_cast<int64_t>(first) + 1;
+  int64_t limit = std::max<int64_t>(64, 4 * int64_t(keys_.size()));
+  if (size > limit || size > max_direct_size) {
+    return;
+  }
+
+  direct_first_ = static_cast<int64_t>(first);
+  direct_.resize(size);
+  for (int64_t i = 0; i < size; i++) {
+    direct_[i] = convert_value(static_cast<double>(direct_first_ + i), true);
+  }
+}
+
+double conversion_table::convert_value(double raw, bool integer) const {
+  switch (type_) {
+  case 3:
+    return formula_->evaluate(raw);
+
+  case 4: {
+    std::ptrdiff_t i = find_last_not_greater(keys_, raw);
+    if (i < 0) {
+      return values_.front();
+    }
+    if (std::size_t(i) + 1 == keys_.size()) {
+      return values_.back();
+    }
+    double t = (raw - keys_[i]) / (keys_[i + 1] - keys_[i]);
+    return values_[i] + t * (values_[i + 1] - values_[i]);
+  }
+
+  case 5: {
+    // value of the nearest key, the lower one in the middle
+    std::ptrdiff_t i = find_last_not_greater(keys_, raw);
+    if (i < 0) {
+      return values_.front();
+    }
+    if (std::size_t(i) + 1 == keys_.size()) {
+      return values_.back();
+    }
+    return raw - keys_[i] <= keys_[i + 1] - raw ? values_[i] : values_[i + 1];
+  }
+
+  case 6:
+  case 8: {
+    // upper bound is included for integer raw values only
+    std::ptrdiff_t i = find_last_not_greater(keys_, raw);
+    if (i >= 0 && (integer ? raw <= upper_[i] : raw < upper_[i])) {
+      return values_[i];
+    }
+    return default_;
+  }
+
+  case 7: {
+    std::ptrdiff_t i = find_last_not_greater(keys_, raw);
+    return i >= 0 && keys_[i] == raw ? values_[i] : default_;
+  }
+
+  default:
+    throw error("Conversation type not supported");
+  }
+}
+
+double conversion_table::convert_text(boost::string_ref text) const {
+  auto it = std::lower_bound(text_values_.begin(), text_values_.end(), text,
+      [](const std::pair<boost::string_ref, double>& a, boost::string_ref b) {
+        return a.first < b; });
+  return it != text_values_.end() && it->first == text ? it->second : default_;
+}
+
+boost::string_ref conversion_table::convert_text_to_text(boost::string_ref text) const {
+  auto it = std::lower_bound(text_texts_.begin(), text_texts_.end(), text,
+      [](const std::pair<boost::string_ref, boost::string_ref>& a, boost::string_ref b) {
+        return a.first < b; });
+  if (it != text_texts_.end() && it->first == text) {
+    return it->second.data() ? it->second : text;
+  }
+  return has_text_default_ ? text_default_ : text;
+}
+
+} // namespace mdf
@@ -0,0 +1,114 @@
+/*
+ * conversiontable.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBMDF_CONVERSIONTABLE_H_
+#define LIBMDF_CONVERSIONTABLE_H_
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/utility/string_ref.hpp>
+
+#include "formula.h"
+
+namespace mdf {
+
+/// Lookup structure of a conversion of type 3 to 10, built once per
+/// channel_conversation.
+///
+/// Keys are sorted and searched without branches. If the keys of a table
+/// for integer raw values are dense, the results for the whole key range are
+/// stored in a table indexed directly by the raw value. Value to text
+/// conversions (types 7 and 8) give the index of the text in get_texts(),
+/// the last text is the default.
+class conversion_table {
+public:
+  /// val and refs of a CC block, refs are the texts of the TX blocks
+  conversion_table(unsigned type, const std::vector<double>& val,
+      std::vector<boost::string_ref> refs);
+
+  unsigned get_type() const { return type_; }
+
+  /// true for types 7 and 8
+  bool has_text_result() const { return type_ == 7 || type_ == 8; }
+
+  /// result texts of types 7 and 8, the last one is the default
+  const std::vector<boost::string_ref>& get_texts() const { return texts_; }
+
+  /// conversion of a numeric raw value (types 3 to 8)
+  template<typename Raw>
+  double convert(Raw raw) const {
+    typedef typename std::conditional<std::is_signed<Raw>::value,
+        int64_t, uint64_t>::type integer_type;
+
+    std::size_t index;
+    if (std::is_integral<Raw>::value &&
+        direct_index(static_cast<integer_type>(raw), index)) {
+      return direct_[index];
+    }
+    return convert_value(static_cast<double>(raw), std::is_integral<Raw>::value);
+  }
+
+  /// text to value conversion (type 9)
+  double convert_text(boost::string_ref text) const;
+
+  /// text to text conversion (type 10), a text without translation is
+  /// returned as it is
+  boost::string_ref convert_text_to_text(boost::string_ref text) const;
+
+private:
+  unsigned type_;
+  std::vector<double> keys_; // sorted, lower bounds of ranges
+  std::vector<double> upper_; // upper bounds of ranges (types 6 and 8)
+  std::vector<double> values_; // results, text indices for types 7 and 8
+  double default_;
+
+  int64_t direct_first_; // raw value of direct_[0]
+  std::vector<double> direct_;
+
+  std::unique_ptr<formula> formula_; // type 3
+
+  std::vector<boost::string_ref> texts_; // types 7 and 8
+  std::vector<std::pair<boost::string_ref, double> > text_values_; // type 9
+  std::vector<std::pair<boost::string_ref, boost::string_ref> > text_texts_; // type 10
+  boost::string_ref text_default_;
+  bool has_text_default_;
+
+  bool direct_index(int64_t raw, std::size_t& index) const {
+    index = static_cast<uint64_t>(raw) - static_cast<uint64_t>(direct_first_);
+    return raw >= direct_first_ && index < direct_.size();
+  }
+
+  bool direct_index(uint64_t raw, std::size_t& index) const {
+    return raw <= static_cast<uint64_t>(INT64_MAX) &&
+        direct_index(static_cast<int64_t>(raw), index);
+  }
+
+  double convert_value(double raw, bool integer) const;
+  void build_direct_table();
+};
+
+} // namespace mdf
+
+#endif // LIBMDF_CONVERSIONTABLE_H_
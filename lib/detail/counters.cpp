@@ -0,0 +1,57 @@
+/*
+ * counters.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "counters.h"
+
+#include <algorithm>
+
+#include "mdf4.h"
+
+namespace mdf {
+
+const uint16_t file_counters::block_ids[block_types] = {
+  make_id('H', 'D'), make_id('M', 'D'), make_id('T', 'X'), make_id('F', 'H'),
+  make_id('C', 'H'), make_id('A', 'T'), make_id('E', 'V'), make_id('D', 'G'),
+  make_id('C', 'G'), make_id('S', 'I'), make_id('C', 'N'), make_id('C', 'C'),
+  make_id('C', 'A'), make_id('D', 'T'), make_id('S', 'R'), make_id('R', 'D'),
+  make_id('R', 'V'), make_id('R', 'I'), make_id('S', 'D'), make_id('D', 'L'),
+  make_id('D', 'Z'), make_id('H', 'L')
+};
+
+void file_counters::reset() {
+  for (std::atomic<uint64_t>* counter : { &read_calls, &bytes_read, &seeks,
+      &cached_reads, &cache_loads, &text_hits, &text_misses }) {
+    counter->store(0, std::memory_order_relaxed);
+  }
+  read_end.store(0, std::memory_order_relaxed);
+  for (std::atomic<uint64_t>& counter : blocks) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+  for (std::atomic<uint64_t>& counter : phase_ns) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+}
+
+std::size_t file_counters::block_index(uint16_t id) {
+  return std::find(block_ids, block_ids + block_types, id) - block_ids;
+}
+
+} // namespace mdf
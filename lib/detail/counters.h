@@ -0,0 +1,125 @@
+/*
+ * counters.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBMDF_COUNTERS_H_
+#define LIBMDF_COUNTERS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "macros.h"
+
+namespace mdf {
+
+/// Counters of the reads of a file and the work done on it. They are
+/// updated with relaxed atomic operations from any thread, so taking them
+/// costs about nothing next to the reads they count.
+struct file_counters {
+  NOT_COPYABLE(file_counters);
+
+  /// block ids counted on their own, others count as other_blocks
+  static const uint16_t block_ids[];
+  static const std::size_t block_types = 22;
+  static const std::size_t other_blocks = block_types;
+
+  file_counters() : timing(false) { reset(); }
+
+  void reset();
+
+  /// counter index of a block id
+  static std::size_t block_index(uint16_t id);
+
+  static void add(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+    counter.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  void count_read(uint64_t offset, uint64_t n) {
+    add(read_calls);
+    add(bytes_read, n);
+    if (read_end.exchange(offset + n, std::memory_order_relaxed) != offset) {
+      add(seeks);
+    }
+  }
+
+  void count_block(uint16_t id) {
+    add(blocks[block_index(id)]);
+  }
+
+  std::atomic<uint64_t> read_calls;
+  std::atomic<uint64_t> bytes_read;
+  std::atomic<uint64_t> seeks; // reads not starting at the end of the read before
+  std::atomic<uint64_t> read_end;
+  std::atomic<uint64_t> cached_reads;
+  std::atomic<uint64_t> cache_loads;
+  std::atomic<uint64_t> text_hits;
+  std::atomic<uint64_t> text_misses;
+  std::atomic<uint64_t> blocks[block_types + 1];
+
+  /// phases of which the time is taken if timing is set
+  enum phase { open_phase, metadata_phase, decode_phase, phases };
+
+  bool timing;
+  std::atomic<uint64_t> phase_ns[phases];
+};
+
+/// Adds the time from construction to destruction to a phase if timing is
+/// enabled. Nested timers of the same phase and thread, like decoding a
+/// channel inside a summary, count only once.
+class phase_timer {
+  NOT_COPYABLE(phase_timer);
+
+public:
+  phase_timer(file_counters& counters, file_counters::phase phase) :
+      counter_(), bit_(), start_()
+  {
+    unsigned bit = 1u << phase;
+    if (counters.timing && !(active() & bit)) {
+      active() |= bit;
+      counter_ = &counters.phase_ns[phase];
+      bit_ = bit;
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~phase_timer() {
+    if (counter_) {
+      file_counters::add(*counter_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start_).count());
+      active() &= ~bit_;
+    }
+  }
+
+private:
+  std::atomic<uint64_t>* counter_;
+  unsigned bit_;
+  std::chrono::steady_clock::time_point start_;
+
+  // phases timed by this thread
+  static unsigned& active() {
+    static thread_local unsigned value = 0;
+    return value;
+  }
+};
+
+} // namespace mdf
+
+#endif // LIBMDF_COUNTERS_H_
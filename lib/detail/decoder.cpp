@@ -0,0 +1,400 @@
+/*
+ * decoder.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decoder.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "../channelconversation.h"
+#include "bits.h"
+#include "conversiontable.h"
+#include "simd.h"
+
+namespace mdf {
+
+namespace {
+
+// byte order
+
+inline uint8_t byte_swap(uint8_t value) { return value; }
+inline uint16_t byte_swap(uint16_t value) { return __builtin_bswap16(value); }
+inline uint32_t byte_swap(uint32_t value) { return __builtin_bswap32(value); }
+inline uint64_t byte_swap(uint64_t value) { return __builtin_bswap64(value); }
+
+template<std::size_t Size> struct unsigned_of_size;
+template<> struct unsigned_of_size<1> { typedef uint8_t type; };
+template<> struct unsigned_of_size<2> { typedef uint16_t type; };
+template<> struct unsigned_of_size<4> { typedef uint32_t type; };
+template<> struct unsigned_of_size<8> { typedef uint64_t type; };
+
+template<typename Raw, bool BigEndian>
+struct loader {
+  static Raw load(const char* ptr) {
+    Raw value;
+    memcpy(&value, ptr, sizeof(Raw));
+    return value;
+  }
+};
+
+template<typename Raw>
+struct loader<Raw, true> {
+  static Raw load(const char* ptr) {
+    typedef typename unsigned_of_size<sizeof(Raw)>::type bits_type;
+
+    bits_type bits;
+    memcpy(&bits, ptr, sizeof(Raw));
+    bits = byte_swap(bits);
+
+    Raw value;
+    memcpy(&value, &bits, sizeof(Raw));
+    return value;
+  }
+};
+
+// conversions, params() gives what apply() needs of the decoder
+
+struct no_conversion {
+  template<typename T>
+  static const double* params(const decoder<T>& d) { return d.get_coefficients(); }
+
+  template<typename T, typename Raw>
+  static T apply(const double*, Raw value) {
+    return static_cast<T>(value);
+  }
+};
+
+struct linear_conversion {
+  template<typename T>
+  static const double* params(const decoder<T>& d) { return d.get_coefficients(); }
+
+  template<typename T, typename Raw>
+  static T apply(const double* c, Raw raw) {
+    double value = raw;
+    return static_cast<T>(c[1] * value + c[0]);
+  }
+};
+
+struct rational_conversion {
+  template<typename T>
+  static const double* params(const decoder<T>& d) { return d.get_coefficients(); }
+
+  template<typename T, typename Raw>
+  static T apply(const double* c, Raw raw) {
+    double value = raw;
+    auto o = c[0] * value * value + c[1] * value + c[2];
+    auto u = c[3] * value * value + c[4] * value + c[5];
+    return static_cast<T>(o/u);
+  }
+};
+
+// algebraic and table conversions (types 3 to 8)
+struct table_conversion {
+  template<typename T>
+  static const conversion_table* params(const decoder<T>& d) { return d.get_table(); }
+
+  template<typename T, typename Raw>
+  static T apply(const conversion_table* table, Raw raw) {
+    return static_cast<T>(table->convert(raw));
+  }
+};
+
+// kernels
+
+template<typename T, typename Raw, bool BigEndian, typename Conversion>
+void decode_values(const decoder<T>& d, const record_batch& batch, T* out) {
+  const char* ptr = batch.data + d.get_byte_offset();
+  auto c = Conversion::params(d);
+  std::size_t stride = batch.record_size;
+
+  for (std::size_t i = 0; i < batch.count; i++) {
+    out[i] = Conversion::template apply<T>(c, loader<Raw, BigEndian>::load(ptr));
+    ptr += stride;
+  }
+}
+
+template<bool Signed>
+struct field_value {
+  static uint64_t get(uint64_t value, unsigned) { return value; }
+};
+
+template<>
+struct field_value<true> {
+  static int64_t get(uint64_t value, unsigned bit_count) {
+    return bits::sign_extend(value, bit_count);
+  }
+};
+
+// integer of any bit count at any bit offset
+template<typename T, bool BigEndian, bool Signed, typename Conversion>
+void decode_bits(const decoder<T>& d, const record_batch& batch, T* out) {
+  const char* ptr = batch.data + d.get_byte_offset();
+  auto c = Conversion::params(d);
+  std::size_t stride = batch.record_size;
+  unsigned bit_offset = d.get_bit_offset();
+  unsigned bit_count = d.get_bit_count();
+
+  std::size_t i = 0;
+  if (bits::field_bytes(bit_offset, bit_count) <= sizeof(uint64_t)) {
+    // one load of a word per record, but not beyond the end of the batch
+    unsigned shift = bits::word_shift(bit_offset, bit_count, BigEndian);
+    uint64_t mask = bits::field_mask(bit_count);
+    std::size_t n = bits::word_records(batch.count, stride, d.get_byte_offset());
+    for (; i < n; i++) {
+      uint64_t value = (bits::load_word(ptr, BigEndian) >> shift) & mask;
+      out[i] = Conversion::template apply<T>(c, field_value<Signed>::get(value, bit_count));
+      ptr += stride;
+    }
+  }
+
+  for (; i < batch.count; i++) {
+    uint64_t value = bits::load_field(ptr, bit_offset, bit_count, BigEndian);
+    out[i] = Conversion::template apply<T>(c, field_value<Signed>::get(value, bit_count));
+    ptr += stride;
+  }
+}
+
+// virtual channel: value is the record index
+template<typename T, typename Conversion>
+void decode_index(const decoder<T>& d, const record_batch& batch, T* out) {
+  auto c = Conversion::params(d);
+
+  for (std::size_t i = 0; i < batch.count; i++) {
+    out[i] = Conversion::template apply<T>(c, batch.first_record + i);
+  }
+}
+
+inline bool is_bit_field(const cnblock& cn) {
+  return cn.data_type <= 3 && (cn.bit_offset != 0 || (cn.bit_count != 8 &&
+      cn.bit_count != 16 && cn.bit_count != 32 && cn.bit_count != 64));
+}
+
+template<typename T, typename Conversion>
+typename decoder<T>::kernel_func select_bits_kernel(const cnblock& cn) {
+  if (cn.bit_offset > 7) {
+    throw error("format error: bit offset greater than 7");
+  }
+  if (cn.bit_count == 0 || cn.bit_count > 64) {
+    throw error("Bit count of integer type not supported");
+  }
+
+  switch (cn.data_type) {
+  case 0: return decode_bits<T, false, false, Conversion>;
+  case 1: return decode_bits<T, true, false, Conversion>;
+  case 2: return decode_bits<T, false, true, Conversion>;
+  default: return decode_bits<T, true, true, Conversion>;
+  }
+}
+
+template<typename T, typename Conversion>
+typename decoder<T>::kernel_func select_kernel(const cnblock& cn) {
+  if (cn.type == 3) {
+    return decode_index<T, Conversion>;
+  }
+
+  if (is_bit_field(cn)) {
+    return select_bits_kernel<T, Conversion>(cn);
+  }
+
+  if (cn.bit_offset != 0) {
+    throw error("Bit offset in channel data not supported");
+  }
+
+  switch (cn.data_type) {
+  case 0: // unsigned int, little endian
+    switch (cn.bit_count) {
+    case 8: return decode_values<T, uint8_t, false, Conversion>;
+    case 16: return decode_values<T, uint16_t, false, Conversion>;
+    case 32: return decode_values<T, uint32_t, false, Conversion>;
+    case 64: return decode_values<T, uint64_t, false, Conversion>;
+    default: throw error("Bit count of integer type not supported");
+    }
+
+  case 1: // unsigned int, big endian
+    switch (cn.bit_count) {
+    case 8: return decode_values<T, uint8_t, true, Conversion>;
+    case 16: return decode_values<T, uint16_t, true, Conversion>;
+    case 32: return decode_values<T, uint32_t, true, Conversion>;
+    case 64: return decode_values<T, uint64_t, true, Conversion>;
+    default: throw error("Bit count of integer type not supported");
+    }
+
+  case 2: // int, little endian
+    switch (cn.bit_count) {
+    case 8: return decode_values<T, int8_t, false, Conversion>;
+    case 16: return decode_values<T, int16_t, false, Conversion>;
+    case 32: return decode_values<T, int32_t, false, Conversion>;
+    case 64: return decode_values<T, int64_t, false, Conversion>;
+    default: throw error("Bit count of integer type not supported");
+    }
+
+  case 3: // int, big endian
+    switch (cn.bit_count) {
+    case 8: return decode_values<T, int8_t, true, Conversion>;
+    case 16: return decode_values<T, int16_t, true, Conversion>;
+    case 32: return decode_values<T, int32_t, true, Conversion>;
+    case 64: return decode_values<T, int64_t, true, Conversion>;
+    default: throw error("Bit count of integer type not supported");
+    }
+
+  case 4: // real, little endian
+    switch (cn.bit_count) {
+    case 32: return decode_values<T, float, false, Conversion>;
+    case 64: return decode_values<T, double, false, Conversion>;
+    default: throw error("Bit count of float type not supported");
+    }
+
+  case 5: // real, big endian
+    switch (cn.bit_count) {
+    case 32: return decode_values<T, float, true, Conversion>;
+    case 64: return decode_values<T, double, true, Conversion>;
+    default: throw error("Bit count of float type not supported");
+    }
+
+  default:
+    throw error("wrong data type requested");
+  }
+}
+
+template<typename T>
+typename decoder<T>::kernel_func select_vectorized_kernel(const cnblock&, unsigned) {
+  return nullptr;
+}
+
+template<>
+decoder<double>::kernel_func select_vectorized_kernel<double>(const cnblock& cn,
+    unsigned conversion_type) {
+  return select_simd_kernel(cn, conversion_type);
+}
+
+} // namespace
+
+template<typename T>
+decoder<T>::decoder(const cnblock& cn, const channel_conversation* cc) :
+    kernel_(), byte_offset_(cn.byte_offset), bit_offset_(cn.bit_offset),
+    bit_count_(cn.bit_count), coefficients_(), table_()
+{
+  if (cc) {
+    std::copy_n(cc->val_.begin(), std::min<std::size_t>(cc->val_.size(), 6),
+        coefficients_);
+  }
+
+  unsigned conversion_type = cc ? cc->block_.type : 0;
+  switch (conversion_type) {
+  case 0: kernel_ = select_kernel<T, no_conversion>(cn); break;
+  case 1: kernel_ = select_kernel<T, linear_conversion>(cn); break;
+  case 2: kernel_ = select_kernel<T, rational_conversion>(cn); break;
+  case 3: case 4: case 5: case 6: case 7: case 8:
+    table_ = cc->get_table();
+    if (!table_) {
+      throw error("Conversation type not supported");
+    }
+    kernel_ = select_kernel<T, table_conversion>(cn);
+    break;
+  default: throw error("Conversation type not supported");
+  }
+
+  // prefer a vectorized kernel for the most common channels
+  kernel_func vectorized = select_vectorized_kernel<T>(cn, conversion_type);
+  if (vectorized) {
+    kernel_ = vectorized;
+  }
+}
+
+validity_decoder::validity_decoder(const cnblock& cn, std::size_t data_bytes,
+    std::size_t inval_bytes) :
+    state_(all_valid), byte_offset_(0), bit_(0)
+{
+  // virtual channels are decoded without records, their samples count as
+  // valid even with an invalidation bit
+  if (cn.flags & 1) {
+    // all values invalid
+    state_ = none_valid;
+  } else if ((cn.flags & 2) && inval_bytes != 0 && cn.type != 3) {
+    if (cn.inval_bit_pos / 8 >= inval_bytes) {
+      throw error("format error: invalidation bit outside of record");
+    }
+    state_ = from_bit;
+    byte_offset_ = data_bytes + cn.inval_bit_pos / 8;
+    bit_ = cn.inval_bit_pos % 8;
+  }
+}
+
+static inline void set_bit(uint8_t* bitmap, uint64_t index, bool value) {
+  uint8_t mask = uint8_t(1) << (index % 8);
+  if (value) {
+    bitmap[index / 8] |= mask;
+  } else {
+    bitmap[index / 8] &= ~mask;
+  }
+}
+
+void validity_decoder::operator()(const record_batch& batch, uint8_t* bitmap,
+    uint64_t index) const {
+  std::size_t count = batch.count;
+  std::size_t i = 0;
+
+  if (state_ != from_bit) {
+    for (; i < count && (index + i) % 8 != 0; i++) {
+      set_bit(bitmap, index + i, state_ == all_valid);
+    }
+    std::size_t bytes = (count - i) / 8;
+    std::fill_n(bitmap + (index + i) / 8, bytes, state_ == all_valid ? 0xFF : 0);
+    for (i += bytes * 8; i < count; i++) {
+      set_bit(bitmap, index + i, state_ == all_valid);
+    }
+    return;
+  }
+
+  const unsigned char* ptr = reinterpret_cast<const unsigned char*>(batch.data) + byte_offset_;
+  std::size_t stride = batch.record_size;
+
+  // bits up to the first whole byte of the bitmap
+  for (; i < count && (index + i) % 8 != 0; i++) {
+    set_bit(bitmap, index + i, ((ptr[i * stride] >> bit_) & 1) == 0);
+  }
+
+  for (; i + 8 <= count; i += 8) {
+    const unsigned char* record = ptr + i * stride;
+    unsigned invalid = 0;
+    for (unsigned k = 0; k < 8; k++) {
+      invalid |= ((record[k * stride] >> bit_) & 1) << k;
+    }
+    bitmap[(index + i) / 8] = ~invalid;
+  }
+
+  for (; i < count; i++) {
+    set_bit(bitmap, index + i, ((ptr[i * stride] >> bit_) & 1) == 0);
+  }
+}
+
+template class decoder<int8_t>;
+template class decoder<uint8_t>;
+template class decoder<int16_t>;
+template class decoder<uint16_t>;
+template class decoder<int32_t>;
+template class decoder<uint32_t>;
+template class decoder<int64_t>;
+template class decoder<uint64_t>;
+template class decoder<float>;
+template class decoder<double>;
+
+} // namespace mdf
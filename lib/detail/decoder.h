@@ -0,0 +1,145 @@
+/*
+ * block.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBMDF_DECODER_H_
+#define LIBMDF_DECODER_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "mdf4.h"
+#include "../recordcursor.h"
+
+namespace mdf {
+
+class channel_conversation;
+class conversion_table;
+
+/// Decodes the samples of a channel from records.
+///
+/// Data type, bit count, byte order and conversion type are resolved once
+/// when the decoder is created. Each combination has its own kernel, which
+/// then runs over the whole range of records of a batch.
+template<typename T>
+class decoder {
+public:
+  typedef void (*kernel_func)(const decoder& d, const record_batch& batch, T* out);
+
+  decoder(const cnblock& cn, const channel_conversation* cc);
+
+  /// decode the samples of all records in batch, out must have space for
+  /// batch.count values
+  void operator()(const record_batch& batch, T* out) const {
+    kernel_(*this, batch, out);
+  }
+
+  std::size_t get_byte_offset() const { return byte_offset_; }
+  unsigned get_bit_offset() const { return bit_offset_; }
+  unsigned get_bit_count() const { return bit_count_; }
+  const double* get_coefficients() const { return coefficients_; }
+  const conversion_table* get_table() const { return table_.get(); }
+
+private:
+  kernel_func kernel_;
+  std::size_t byte_offset_;
+  unsigned bit_offset_;
+  unsigned bit_count_;
+  double coefficients_[6];
+  std::shared_ptr<const conversion_table> table_; // conversion types 3 to 8
+};
+
+/// Decodes the invalidation bit of a channel into a validity bitmap: one
+/// bit per record, least significant bit first, set for valid samples.
+class validity_decoder {
+public:
+  /// data_bytes and inval_bytes of the channel group of the channel
+  validity_decoder(const cnblock& cn, std::size_t data_bytes, std::size_t inval_bytes);
+
+  /// false if no record has to be read, all samples are valid or invalid
+  bool has_invalidation_bit() const { return state_ == from_bit; }
+
+  /// true if no sample can be invalid
+  bool is_all_valid() const { return state_ == all_valid; }
+
+  /// write the validity of the samples in batch to the bits index ...
+  /// index + batch.count - 1 of bitmap
+  void operator()(const record_batch& batch, uint8_t* bitmap, uint64_t index) const;
+
+private:
+  enum state_type { all_valid, none_valid, from_bit };
+
+  state_type state_;
+  std::size_t byte_offset_;
+  unsigned bit_;
+};
+
+/// Decoders and buffers of channels with samples of different types, so
+/// that all of them are decoded in one pass over the records.
+class column_set {
+public:
+  /// the samples of decode go to buffer
+  template<typename T>
+  void add(const decoder<T>& decode, T* buffer) {
+    columns_.push_back([decode, buffer](const record_batch& batch, uint64_t index) {
+      decode(batch, buffer + index);
+    });
+  }
+
+  /// the validity of the samples of valid goes to bitmap
+  void add(const validity_decoder& valid, uint8_t* bitmap) {
+    validity_.push_back(valid);
+    bitmaps_.push_back(bitmap);
+  }
+
+  bool has_validity() const { return !bitmaps_.empty(); }
+
+  /// decode the records of batch to index in the buffers and bitmaps
+  void operator()(const record_batch& batch, uint64_t index) const {
+    for (const auto& column : columns_) {
+      column(batch, index);
+    }
+    for (std::size_t i = 0; i < validity_.size(); i++) {
+      validity_[i](batch, bitmaps_[i], index);
+    }
+  }
+
+private:
+  std::vector<std::function<void(const record_batch&, uint64_t)> > columns_;
+  std::vector<validity_decoder> validity_;
+  std::vector<uint8_t*> bitmaps_;
+};
+
+extern template class decoder<int8_t>;
+extern template class decoder<uint8_t>;
+extern template class decoder<int16_t>;
+extern template class decoder<uint16_t>;
+extern template class decoder<int32_t>;
+extern template class decoder<uint32_t>;
+extern template class decoder<int64_t>;
+extern template class decoder<uint64_t>;
+extern template class decoder<float>;
+extern template class decoder<double>;
+
+} // namespace mdf
+
+#endif // LIBMDF_DECODER_H_
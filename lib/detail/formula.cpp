@@ -0,0 +1,286 @@
+/*
+ * formula.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "formula.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <locale>
+#include <sstream>
+#include <string>
+
+#include "mdf4.h"
+
+namespace mdf {
+
+namespace {
+
+struct function_entry {
+  const char* name;
+  double (*function)(double);
+};
+
+double absolute(double x) { return std::fabs(x); }
+double square_root(double x) { return std::sqrt(x); }
+double exponential(double x) { return std::exp(x); }
+double logarithm(double x) { return std::log(x); }
+double logarithm10(double x) { return std::log10(x); }
+double sine(double x) { return std::sin(x); }
+double cosine(double x) { return std::cos(x); }
+double tangent(double x) { return std::tan(x); }
+double arc_sine(double x) { return std::asin(x); }
+double arc_cosine(double x) { return std::acos(x); }
+double arc_tangent(double x) { return std::atan(x); }
+double hyperbolic_sine(double x) { return std::sinh(x); }
+double hyperbolic_cosine(double x) { return std::cosh(x); }
+double hyperbolic_tangent(double x) { return std::tanh(x); }
+
+const function_entry functions[] = {
+  { "abs", absolute }, { "sqrt", square_root }, { "exp", exponential },
+  { "log", logarithm }, { "ln", logarithm }, { "log10", logarithm10 },
+  { "sin", sine }, { "cos", cosine }, { "tan", tangent },
+  { "asin", arc_sine }, { "acos", arc_cosine }, { "atan", arc_tangent },
+  { "sinh", hyperbolic_sine }, { "cosh", hyperbolic_cosine }, { "tanh", hyperbolic_tangent }
+};
+
+const error invalid_formula("invalid formula in algebraic conversion");
+
+/// recursive descent parser, emits the program in postfix order
+template<typename Instruction, typename Op>
+class parser {
+public:
+  parser(boost::string_ref text, std::vector<Instruction>& program) :
+      text_(text), pos_(0), nesting_(0), program_(program)
+  { }
+
+  void parse() {
+    expression();
+    skip_space();
+    if (pos_ != text_.size()) {
+      throw invalid_formula;
+    }
+  }
+
+private:
+  static const std::size_t max_nesting = 100;
+
+  boost::string_ref text_;
+  std::size_t pos_;
+  std::size_t nesting_; // calls of factor() on the way to the current one
+  std::vector<Instruction>& program_;
+
+  void skip_space() {
+    while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+      pos_++;
+    }
+  }
+
+  char peek() {
+    skip_space();
+    return pos_ < text_.size() ? text_[pos_] : '\0';
+  }
+
+  void emit(Op code, double value = 0, double (*function)(double) = nullptr) {
+    Instruction i = { code, value, function };
+    program_.push_back(i);
+  }
+
+  // expression = term { ("+" | "-") term }
+  void expression() {
+    term();
+    for (char c = peek(); c == '+' || c == '-'; c = peek()) {
+      pos_++;
+      term();
+      emit(c == '+' ? Op::add : Op::sub);
+    }
+  }
+
+  // term = factor { ("*" | "/") factor }
+  void term() {
+    factor();
+    for (char c = peek(); (c == '*' && !is_power()) || c == '/'; c = peek()) {
+      pos_++;
+      factor();
+      emit(c == '*' ? Op::mul : Op::div);
+    }
+  }
+
+  // factor = "-" factor | "+" factor | primary [ ("^" | "**") factor ]
+  void factor() {
+    // every nesting passes here, signs, powers and parentheses
+    if (++nesting_ > max_nesting) {
+      throw invalid_formula;
+    }
+
+    char c = peek();
+    if (c == '-' || c == '+') {
+      pos_++;
+      factor();
+      if (c == '-') {
+        emit(Op::neg);
+      }
+    } else {
+      primary();
+      if (peek() == '^') {
+        pos_++;
+        factor();
+        emit(Op::pow);
+      } else if (is_power()) {
+        pos_ += 2;
+        factor();
+        emit(Op::pow);
+      }
+    }
+    nesting_--;
+  }
+
+  bool is_power() {
+    return peek() == '*' && pos_ + 1 < text_.size() && text_[pos_ + 1] == '*';
+  }
+
+  bool is_digit(std::size_t pos) {
+    return pos < text_.size() && std::isdigit(static_cast<unsigned char>(text_[pos]));
+  }
+
+  void skip_digits() {
+    while (is_digit(pos_)) {
+      pos_++;
+    }
+  }
+
+  // number = digits [ "." digits ] [ ("e" | "E") [ "+" | "-" ] digits ],
+  // with a point always, whatever the locale of the program is
+  double number() {
+    std::size_t begin = pos_;
+    skip_digits();
+    if (pos_ < text_.size() && text_[pos_] == '.') {
+      pos_++;
+      skip_digits();
+    }
+    if (pos_ - begin == 1 && text_[begin] == '.') {
+      throw invalid_formula;
+    }
+    if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')) {
+      std::size_t digits = pos_ + 1;
+      if (digits < text_.size() && (text_[digits] == '+' || text_[digits] == '-')) {
+        digits++;
+      }
+      if (is_digit(digits)) {
+        pos_ = digits;
+        skip_digits();
+      }
+    }
+
+    std::istringstream stream(std::string(text_.data() + begin, pos_ - begin));
+    stream.imbue(std::locale::classic());
+    double value;
+    if (!(stream >> value)) {
+      throw invalid_formula;
+    }
+    return value;
+  }
+
+  void primary() {
+    char c = peek();
+    if (c == '(') {
+      pos_++;
+      expression();
+      if (peek() != ')') {
+        throw invalid_formula;
+      }
+      pos_++;
+      return;
+    }
+
+    if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+      emit(Op::constant, number());
+      return;
+    }
+
+    std::size_t begin = pos_;
+    while (pos_ < text_.size() && std::isalnum(static_cast<unsigned char>(text_[pos_]))) {
+      pos_++;
+    }
+    boost::string_ref name = text_.substr(begin, pos_ - begin);
+    if (name == "X" || name == "x" || name == "X1" || name == "x1") {
+      emit(Op::variable);
+      return;
+    }
+
+    for (const function_entry& f : functions) {
+      if (name == f.name) {
+        if (peek() != '(') {
+          throw invalid_formula;
+        }
+        pos_++;
+        expression();
+        if (peek() != ')') {
+          throw invalid_formula;
+        }
+        pos_++;
+        emit(Op::call, 0, f.function);
+        return;
+      }
+    }
+    throw invalid_formula;
+  }
+};
+
+} // namespace
+
+formula::formula(boost::string_ref text) : program_() {
+  parser<instruction, op>(text, program_).parse();
+
+  // the program must fit the stack of evaluate()
+  std::size_t depth = 0;
+  for (const instruction& i : program_) {
+    if (i.code == op::constant || i.code == op::variable) {
+      if (++depth > max_stack) {
+        throw error("formula of algebraic conversion is too complex");
+      }
+    } else if (i.code != op::neg && i.code != op::call) {
+      depth--;
+    }
+  }
+}
+
+double formula::evaluate(double x) const {
+  double stack[max_stack];
+  std::size_t n = 0;
+  for (const instruction& i : program_) {
+    switch (i.code) {
+    case op::constant: stack[n++] = i.value; break;
+    case op::variable: stack[n++] = x; break;
+    case op::add: n--; stack[n - 1] += stack[n]; break;
+    case op::sub: n--; stack[n - 1] -= stack[n]; break;
+    case op::mul: n--; stack[n - 1] *= stack[n]; break;
+    case op::div: n--; stack[n - 1] /= stack[n]; break;
+    case op::pow: n--; stack[n - 1] = std::pow(stack[n - 1], stack[n]); break;
+    case op::neg: stack[n - 1] = -stack[n - 1]; break;
+    case op::call: stack[n - 1] = i.function(stack[n - 1]); break;
+    }
+  }
+  return stack[0];
+}
+
+} // namespace mdf
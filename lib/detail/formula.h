@@ -0,0 +1,61 @@
+/*
+ * formula.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBMDF_FORMULA_H_
+#define LIBMDF_FORMULA_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <boost/utility/string_ref.hpp>
+
+namespace mdf {
+
+/// Formula of an algebraic conversion (type 3) in the variable X, compiled
+/// once into a program for a small stack machine.
+///
+/// Known are numbers, X (or X1), + - * / ^, parentheses, and the functions
+/// abs, sqrt, exp, log (natural), ln, log10, sin, cos, tan, asin, acos,
+/// atan, sinh, cosh and tanh.
+class formula {
+public:
+  /// throws error if the formula is not valid
+  explicit formula(boost::string_ref text);
+
+  double evaluate(double x) const;
+
+private:
+  enum class op : uint8_t { constant, variable, add, sub, mul, div, pow, neg, call };
+
+  struct instruction {
+    op code;
+    double value;
+    double (*function)(double);
+  };
+
+  static const std::size_t max_stack = 32;
+
+  std::vector<instruction> program_;
+};
+
+} // namespace mdf
+
+#endif // LIBMDF_FORMULA_H_
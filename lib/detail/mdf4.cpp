@@ -25,6 +25,7 @@
 #include <cstring>
 
 #include "rawfile.h"
+#include "textcache.h"
 #include "xml.h"
 
 namespace mdf {
@@ -33,9 +34,9 @@ const char* error::what() const throw () {
   return msg_;
 }
 
-block_header prase_block_header(rawfile* file, uint16_t id) {
+block_header prase_block_header(rawfile_cursor& cursor, uint16_t id) {
   block_header header;
-  file->read(header);
+  cursor.read(header);
 
   if (header.double_hash != make_id('#', '#')) {
     // not a block (or corrupted)
@@ -50,30 +51,31 @@ block_header prase_block_header(rawfile* file, uint16_t id) {
     throw error("format error: given block id is not matching readed blocks id!");
   }
 
+  cursor.get_file()->get_counters().count_block(header.id);
   return header;
 }
 
-block_header prase_block_header(rawfile* file) {
+block_header prase_block_header(rawfile_cursor& cursor) {
   block_header header;
-  file->read(header);
+  cursor.read(header);
 
   if (header.double_hash != make_id('#', '#')) {
     // not a block (or corrupted)
     throw error("format error: to read block is not a block!");
   }
 
+  cursor.get_file()->get_counters().count_block(header.id);
   return header;
 }
 
 // M4_TX Text utf8 or Metadata block (XML)
-std::string prase_tx(rawfile* file, link l) {
+std::string prase_tx(const rawfile* file, link l) {
   std::string result;
 
   if (l == 0) return result;
 
-  file->seek(l, rawfile::seek_orgin::begin);
-
-  block_header header = prase_block_header(file);
+  rawfile_cursor cursor(file, l, rawfile_cursor::read_mode::cached);
+  block_header header = prase_block_header(cursor);
   if (header.id != make_id('T', 'X') && header.id != make_id('M', 'D')) {
     throw error("format error: not a MD or TX block!");
   }
@@ -81,11 +83,19 @@ std::string prase_tx(rawfile* file, link l) {
     return result;
   }
 
-  file->read_to_container(result, header.length - sizeof(block_header));
+  cursor.read_to_container(result, header.length - sizeof(block_header));
   result.resize(strlen(result.c_str()));
   return result;
 }
 
+boost::string_ref get_tx(const rawfile* file, link l) {
+  return file->get_text_cache().get_text(l);
+}
+
+boost::string_ref get_tx_comment(const rawfile* file, link l) {
+  return file->get_text_cache().get_comment(l);
+}
+
 std::string extract_tx_from_xml(std::string xml) {
   const char tx_begin[] = "<TX>";
   const char tx_end[] = "</TX>";
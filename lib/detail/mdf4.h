@@ -86,9 +86,33 @@ struct hdblock {
   real start_distance_m;
 };
 
+// DL Data List
+struct dlblock {
+  uint8_t flags; // 1 -> equal length
+  uint8_t _reserved[3];
+  uint32_t count;
+} PACKED;
+
+// HL Header List
+struct hlblock {
+  uint16_t flags; // 1 -> equal length
+  uint8_t zip_type;
+  uint8_t _reserved[5];
+} PACKED;
+
+// DZ Compressed Data
+struct dzblock {
+  char org_block_type[2];
+  uint8_t zip_type; // 0 -> deflate, 1 -> transposition + deflate
+  uint8_t _reserved;
+  uint32_t zip_parameter; // columns for transposition
+  uint64_t org_data_length;
+  uint64_t data_length;
+} PACKED;
+
 // CG Channel Group
 struct cgblock {
-  uint64_t _unknown1;
+  uint64_t record_id; // id in front of the records of unsorted data groups
   uint64_t cycle_count;
   uint16_t flags;
   uint8_t _unknown2[6];
@@ -145,9 +169,15 @@ private:
 
 // prase blocks
 
-block_header prase_block_header(rawfile* file, uint16_t id);
-block_header prase_block_header(rawfile* file);
-std::string prase_tx(rawfile* file, link l);
+block_header prase_block_header(rawfile_cursor& cursor, uint16_t id);
+block_header prase_block_header(rawfile_cursor& cursor);
+std::string prase_tx(const rawfile* file, link l);
+
+/// cached text of TX or MD block, valid until the file is closed
+boost::string_ref get_tx(const rawfile* file, link l);
+
+/// cached text of TX block or of <TX> element in MD block
+boost::string_ref get_tx_comment(const rawfile* file, link l);
 
 std::string extract_tx_from_xml(std::string);
 
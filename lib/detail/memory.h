@@ -26,6 +26,9 @@
 
 namespace mdf {
 
+/// read-only view of bytes in memory
+typedef boost::iterator_range<const char*> byte_range;
+
 template<typename T, typename T_nonconst = T>
 class memory_iterator : public std::iterator<std::random_access_iterator_tag, T> {
 public:
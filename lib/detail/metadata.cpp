@@ -0,0 +1,116 @@
+/*
+ * metadata.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metadata.h"
+
+#include "rawfile.h"
+
+namespace mdf {
+
+void* arena::allocate(std::size_t n, std::size_t alignment) {
+  std::size_t padding = (alignment - reinterpret_cast<uintptr_t>(pos_) % alignment) % alignment;
+  if (padding + n > avail_) {
+    // large arrays get a chunk of their own, the rest of the current chunk
+    // is used further
+    std::size_t size = std::max(chunk_size, n + alignment);
+    std::unique_ptr<char[]> chunk(new char[size]);
+    char* begin = chunk.get();
+    chunks_.push_back(std::move(chunk));
+    padding = (alignment - reinterpret_cast<uintptr_t>(begin) % alignment) % alignment;
+    if (size - padding - n < avail_) {
+      return begin + padding;
+    }
+    pos_ = begin;
+    avail_ = size;
+  }
+
+  void* result = pos_ + padding;
+  pos_ += padding + n;
+  avail_ -= padding + n;
+  return result;
+}
+
+metadata_table::metadata_table(const rawfile* file) :
+    file_(file), mutex_(), arena_(), source_links_(), conversions_(), overviews_()
+{ }
+
+const link* metadata_table::store_links(const std::vector<link>& links) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return arena_.copy(links.data(), links.size());
+}
+
+channel_record* metadata_table::store_channels(const std::vector<channel_record>& records) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return arena_.copy(records.data(), records.size());
+}
+
+const link* metadata_table::get_source_links(link l) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = source_links_.find(l);
+  if (iter != source_links_.end()) {
+    return iter->second;
+  }
+
+  rawfile_cursor cursor(file_, l, rawfile_cursor::read_mode::cached);
+
+  // SI Source Information
+  block_header header = prase_block_header(cursor, make_id('S', 'I'));
+  if (header.link_count < 3) {
+    throw error("format error: too few links in SI block");
+  }
+  link links[3];
+  cursor.read(links);
+
+  const link* result = arena_.copy(links, 3);
+  source_links_.emplace(l, result);
+  return result;
+}
+
+const channel_conversation* metadata_table::get_conversion(link l) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = conversions_.find(l);
+    if (iter != conversions_.end()) {
+      return iter->second.get();
+    }
+  }
+
+  // the texts of the conversion are read without holding the lock, if
+  // another thread reads the block meanwhile its conversion is kept
+  std::unique_ptr<channel_conversation> conversion(new channel_conversation(file_, l));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  return conversions_.emplace(l, std::move(conversion)).first->second.get();
+}
+
+const std::vector<sample_summary>* metadata_table::get_overview(const channel_record* channel) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = overviews_.find(channel);
+  return iter != overviews_.end() ? &iter->second : nullptr;
+}
+
+const std::vector<sample_summary>& metadata_table::set_overview(const channel_record* channel,
+    std::vector<sample_summary> overview) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return overviews_.emplace(channel, std::move(overview)).first->second;
+}
+
+} // namespace mdf
@@ -0,0 +1,124 @@
+/*
+ * metadata.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBMDF_METADATA_H_
+#define LIBMDF_METADATA_H_
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "mdf4.h"
+#include "../channelconversation.h"
+#include "../samplesummary.h"
+
+namespace mdf {
+
+/// CN block of a channel in the metadata table
+struct channel_record {
+  cnblock cn;
+  const link* links;
+  uint32_t link_count;
+
+  // read on first use if the file was opened lazy, guarded by the metadata
+  // mutex of the channel group
+  bool references_parsed;
+  const link* source_links; // links of the SI block, nullptr if none
+  const channel_conversation* conversion; // nullptr if none
+};
+
+/// Memory for trivial records, taken from large chunks. All of it is freed
+/// at once with the arena, allocated records never move.
+class arena {
+  NOT_COPYABLE(arena);
+
+public:
+  arena() : chunks_(), pos_(nullptr), avail_(0) { }
+
+  /// copy of [first, first + n)
+  template<typename T>
+  T* copy(const T* first, std::size_t n) {
+    static_assert(std::is_trivially_copyable<T>::value, "arena holds trivial records only");
+    if (n == 0) {
+      return nullptr;
+    }
+    T* result = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+    std::copy(first, first + n, result);
+    return result;
+  }
+
+  static const std::size_t chunk_size = 64 * 1024;
+
+private:
+  std::vector<std::unique_ptr<char[]> > chunks_;
+  char* pos_;
+  std::size_t avail_;
+
+  void* allocate(std::size_t n, std::size_t alignment);
+};
+
+/// Metadata of the channels of a file. The CN records of a channel group lie
+/// in one array and the links of all blocks in a few large slabs, so the
+/// channel objects are two pointers and scanning the channels of a group
+/// touches contiguous memory. SI and CC blocks are read once per file and
+/// shared by all channels linking them.
+class metadata_table {
+  NOT_COPYABLE(metadata_table);
+
+public:
+  explicit metadata_table(const rawfile* file);
+
+  /// copy of the links of a block, stays valid until the file is closed
+  const link* store_links(const std::vector<link>& links);
+
+  /// copy of the records of the channels of a channel group
+  channel_record* store_channels(const std::vector<channel_record>& records);
+
+  /// links of the SI block at l
+  const link* get_source_links(link l);
+
+  /// conversion of the CC block at l
+  const channel_conversation* get_conversion(link l);
+
+  /// summary of the records of a channel stored with set_overview(),
+  /// nullptr if there is none yet
+  const std::vector<sample_summary>* get_overview(const channel_record* channel);
+
+  /// Store the overview of a channel and return it. If one is stored
+  /// already, that one is kept and returned.
+  const std::vector<sample_summary>& set_overview(const channel_record* channel,
+      std::vector<sample_summary> overview);
+
+private:
+  const rawfile* file_;
+  std::mutex mutex_;
+  arena arena_;
+  std::unordered_map<link, const link*> source_links_;
+  std::unordered_map<link, std::unique_ptr<channel_conversation> > conversions_;
+  std::unordered_map<const channel_record*, std::vector<sample_summary> > overviews_;
+};
+
+} // namespace mdf
+
+#endif // LIBMDF_METADATA_H_
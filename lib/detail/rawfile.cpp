@@ -20,14 +20,179 @@
  */
 
 #include "rawfile.h"
+#include "textcache.h"
+#include "metadata.h"
 
 #include <stdarg.h>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 namespace mdf {
 
 io_error::~io_error() noexcept
 { }
 
+struct rawfile::read_cache {
+  std::size_t chunk_size;
+  std::size_t max_size;
+  std::size_t size; // bytes in cache
+  uint64_t file_size;
+
+  std::mutex mutex;
+  std::unordered_map<uint64_t, std::vector<char> > chunks;
+};
+
+// chunks read at once if a chunk is missing
+static const uint64_t read_ahead_chunks = 4;
+
+void rawfile::read_cache_deleter::operator()(read_cache* cache) const {
+  delete cache;
+}
+
+void rawfile::enable_read_cache(std::size_t chunk_size, std::size_t max_size) {
+  struct stat info;
+  if (fstat(fileno(file_handle_.get()), &info) != 0) {
+    throw io_error();
+  }
+
+  read_cache_.reset(new read_cache());
+  read_cache_->chunk_size = chunk_size;
+  read_cache_->max_size = max_size;
+  read_cache_->size = 0;
+  read_cache_->file_size = info.st_size;
+}
+
+bool rawfile::load_chunks(read_cache& cache, uint64_t first, uint64_t count) const {
+  // read up to the next chunk in cache, the end of file or the size limit
+  uint64_t chunks = (cache.file_size + cache.chunk_size - 1) / cache.chunk_size;
+  count = std::min(count, (cache.max_size - cache.size) / cache.chunk_size);
+  uint64_t last = first;
+  while (last < first + count && last < chunks && !cache.chunks.count(last)) {
+    last++;
+  }
+  if (last == first) {
+    return false;
+  }
+
+  uint64_t begin = first * cache.chunk_size;
+  uint64_t end = std::min(cache.file_size, last * cache.chunk_size);
+  std::vector<char> data(end - begin);
+  file_counters::add(counters_.cache_loads);
+  read_at(begin, data.data(), data.size());
+
+  for (uint64_t i = first; i < last; i++) {
+    auto chunk_begin = data.begin() + (i - first) * cache.chunk_size;
+    auto chunk_end = i + 1 == last ? data.end() : chunk_begin + cache.chunk_size;
+    cache.chunks[i].assign(chunk_begin, chunk_end);
+  }
+  cache.size += data.size();
+  return true;
+}
+
+void rawfile::read_cached(uint64_t offset, void* buffer, std::size_t n) const {
+  read_cache* cache = read_cache_.get();
+  if (!cache || is_mapped() || n > cache->chunk_size) {
+    read_at(offset, buffer, n);
+    return;
+  }
+
+  file_counters::add(counters_.cached_reads);
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  char* ptr = static_cast<char*>(buffer);
+  uint64_t end = offset + n;
+  while (offset < end) {
+    uint64_t index = offset / cache->chunk_size;
+    auto chunk = cache->chunks.find(index);
+    if (chunk == cache->chunks.end()) {
+      if (!load_chunks(*cache, index, read_ahead_chunks)) {
+        // cache is full or read is behind end of file
+        read_at(offset, ptr, end - offset);
+        return;
+      }
+      chunk = cache->chunks.find(index);
+    }
+
+    std::size_t begin = offset - index * cache->chunk_size;
+    if (begin >= chunk->second.size()) {
+      // unexpected end of file
+      throw io_error(EIO);
+    }
+    std::size_t bytes = std::min<uint64_t>(chunk->second.size() - begin, end - offset);
+    memcpy(ptr, chunk->second.data() + begin, bytes);
+    ptr += bytes;
+    offset += bytes;
+  }
+}
+
+void rawfile::prefetch(uint64_t offset, std::size_t n) const {
+  read_cache* cache = read_cache_.get();
+  if (!cache || is_mapped() || n == 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  uint64_t first = offset / cache->chunk_size;
+  uint64_t last = (offset + n - 1) / cache->chunk_size + 1;
+  load_chunks(*cache, first, last - first);
+}
+
+void rawfile::will_need(uint64_t offset, uint64_t n) const noexcept {
+  if (n == 0) {
+    return;
+  }
+
+  // only a hint, errors do not matter
+  if (is_mapped()) {
+    if (offset >= size()) {
+      return;
+    }
+    n = std::min<uint64_t>(n, size() - offset);
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t begin = offset / page * page;
+    madvise(const_cast<char*>(data()) + begin, offset + n - begin, MADV_WILLNEED);
+  } else if (file_handle_) {
+    posix_fadvise(fileno(file_handle_.get()), offset, n, POSIX_FADV_WILLNEED);
+  }
+}
+
+void rawfile::text_cache_deleter::operator()(text_cache* cache) const {
+  delete cache;
+}
+
+text_cache& rawfile::get_text_cache() const {
+  std::lock_guard<std::mutex> lock(text_cache_mutex_);
+  if (!text_cache_) {
+    text_cache_.reset(new text_cache(this));
+  }
+  return *text_cache_;
+}
+
+void rawfile::metadata_deleter::operator()(metadata_table* metadata) const {
+  delete metadata;
+}
+
+metadata_table& rawfile::get_metadata() const {
+  std::lock_guard<std::mutex> lock(metadata_mutex_);
+  if (!metadata_) {
+    metadata_.reset(new metadata_table(this));
+  }
+  return *metadata_;
+}
+
+void rawfile::close() noexcept {
+  metadata_.reset();
+  // cached texts can point into the mapping
+  text_cache_.reset();
+  read_cache_.reset();
+  mapping_.reset(nullptr);
+  file_handle_.reset(nullptr);
+}
+
 void rawfile::open(boost::string_ref filename, boost::string_ref mode)  {
   if (*filename.end() != '\0') {
     // filename ist not null terminated
@@ -40,7 +205,69 @@ void rawfile::open(boost::string_ref filename, boost::string_ref mode)  {
   if (!file_handle_) throw io_error();
 }
 
+void rawfile::map() {
+  struct stat st;
+  if (fstat(fileno(file_handle_.get()), &st) != 0)
+    throw io_error();
+
+  std::size_t size = st.st_size;
+  if (size == 0) {
+    // nothing to map
+    return;
+  }
+
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED,
+      fileno(file_handle_.get()), 0);
+  if (data == MAP_FAILED)
+    throw io_error();
+
+  mapping_ = mapping_t(static_cast<const char*>(data), mapping_closer(size));
+}
+
+void rawfile::read_at(uint64_t offset, void* buffer, std::size_t n) const {
+  counters_.count_read(offset, n);
+  if (is_mapped()) {
+    if (offset > size() || n > size() - offset)
+      throw io_error(EIO);
+    memcpy(buffer, data() + offset, n);
+    return;
+  }
+
+  char* ptr = static_cast<char*>(buffer);
+  int fd = fileno(file_handle_.get());
+  while (n > 0) {
+    ssize_t bytes = pread(fd, ptr, n, offset);
+    if (bytes < 0) {
+      if (errno == EINTR) continue;
+      throw io_error();
+    }
+    if (bytes == 0) {
+      // unexpected end of file
+      throw io_error(EIO);
+    }
+    ptr += bytes;
+    offset += bytes;
+    n -= bytes;
+  }
+}
+
+void rawfile::write_at(uint64_t offset, const void* data, std::size_t n) {
+  const char* ptr = static_cast<const char*>(data);
+  int fd = fileno(file_handle_.get());
+  while (n > 0) {
+    ssize_t bytes = pwrite(fd, ptr, n, offset);
+    if (bytes < 0) {
+      if (errno == EINTR) continue;
+      throw io_error();
+    }
+    ptr += bytes;
+    offset += bytes;
+    n -= bytes;
+  }
+}
+
 void rawfile::read(char& t) {
+  count_stream_read(1);
   t = fgetc(file_handle_.get());
   if (t == EOF)
     throw io_error();
@@ -62,6 +289,7 @@ void rawfile::write_formated(const char* format, ...) {
 }
 
 void rawfile::seek(long int offset, seek_orgin origin) {
+  file_counters::add(counters_.seeks);
   if (fseek(file_handle_.get(), offset, static_cast<int>(origin)) != 0)
     throw io_error();
 }
@@ -23,11 +23,15 @@
 #define LIBMDF_RAWFILE_H_
 
 #include <cstdio>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <system_error>
+#include <sys/mman.h>
 
 #include <boost/utility/string_ref.hpp>
 
+#include "counters.h"
 #include "macros.h"
 
 namespace mdf {
@@ -46,6 +50,9 @@ public:
 };
 
 
+class text_cache;
+class metadata_table;
+
 class rawfile {
   NOT_COPYABLE(rawfile);
 
@@ -56,20 +63,24 @@ public:
     end = SEEK_END  // End of file
   };
 
-  constexpr rawfile() noexcept :
-    file_handle_()
+  rawfile() noexcept :
+    file_handle_(), mapping_(), read_cache_(), text_cache_(), text_cache_mutex_(),
+    metadata_(), metadata_mutex_(), counters_()
   { }
 
   rawfile(FILE* file) noexcept :
-    file_handle_(file)
+    file_handle_(file), mapping_(), read_cache_(), text_cache_(), text_cache_mutex_(),
+    metadata_(), metadata_mutex_(), counters_()
   { }
 
   rawfile(boost::string_ref filename, boost::string_ref mode) :
-    file_handle_()
+    file_handle_(), mapping_(), read_cache_(), text_cache_(), text_cache_mutex_(),
+    metadata_(), metadata_mutex_(), counters_()
   {
     open(filename, mode);
   }
 
+
   void open(boost::string_ref filename, boost::string_ref mode);
 
   void warp(FILE* file) noexcept
@@ -85,22 +96,79 @@ public:
     return file_handle_ != nullptr;
   }
 
+  /// map the whole opened file read-only into memory
+  void map();
+
+  bool is_mapped() const noexcept {
+    return mapping_ != nullptr;
+  }
+
+  /// begin of the mapped file, only valid if is_mapped()
+  const char* data() const noexcept {
+    return mapping_.get();
+  }
+
+  /// size of the mapped file, only valid if is_mapped()
+  std::size_t size() const noexcept {
+    return mapping_.get_deleter().size();
+  }
+
+  /// cache for the text blocks of the opened file, created on first use
+  text_cache& get_text_cache() const;
+
+  /// records of the channels of the opened file, created on first use
+  metadata_table& get_metadata() const;
+
+  /// Counters of the reads of this file and of the blocks parsed from it.
+  /// Data read in place from a memory mapping is not counted.
+  file_counters& get_counters() const {
+    return counters_;
+  }
+
   explicit operator bool() const noexcept {
     return is_open() && good();
   }
 
   template<typename T>
   void read(T& t) {
+    count_stream_read(sizeof(T));
     if (fread(&t, sizeof(T), 1, file_handle_.get()) != 1)
       throw io_error();
   }
   template<typename T>
   void read(T* t, std::size_t n) {
+    count_stream_read(n * sizeof(T));
     if (fread(t, sizeof(T), n, file_handle_.get()) != n)
       throw io_error();
   }
   void read(char& t);
 
+  /// read n bytes at offset without using or changing the file position.
+  /// Can be called from different threads at the same time.
+  void read_at(uint64_t offset, void* buffer, std::size_t n) const;
+
+  template<typename T>
+  void read_at(uint64_t offset, T& t) const {
+    read_at(offset, &t, sizeof(T));
+  }
+
+  /// Cache small reads done with read_cached() in aligned chunks of
+  /// chunk_size bytes, at most max_size bytes in total. A missing chunk is
+  /// read together with some following chunks, so many small reads close to
+  /// each other cost only a few large reads.
+  void enable_read_cache(std::size_t chunk_size = 64 * 1024,
+      std::size_t max_size = 64 * 1024 * 1024);
+
+  /// like read_at(), but through the read cache if enabled
+  void read_cached(uint64_t offset, void* buffer, std::size_t n) const;
+
+  /// load [offset, offset + n) into the read cache with one read
+  void prefetch(uint64_t offset, std::size_t n) const;
+
+  /// Hint that [offset, offset + n) is read soon, the system starts to read
+  /// it in background (madvise for a mapped file, posix_fadvise otherwise).
+  void will_need(uint64_t offset, uint64_t n) const noexcept;
+
   template<typename T, std::size_t N>
   std::size_t read_same(T (&t)[N]) noexcept {
     return fread(&t, sizeof(T), N, file_handle_.get());
@@ -108,11 +176,13 @@ public:
 
   template<typename T>
   void read_partial(T& t, std::size_t n) {
+    count_stream_read(n);
     if (fread(&t, sizeof(char), n, file_handle_.get()) != n)
       throw io_error();
   }
   template<typename T>
   void read_partial(T& t, std::size_t pos, std::size_t n) {
+    count_stream_read(n);
     if (fread(&t + pos, sizeof(char), n, file_handle_.get()) != n)
       throw io_error();
   }
@@ -120,6 +190,7 @@ public:
   template<typename T>
   void read_to_container(T& t, std::size_t n) {
     t.resize(n);
+    count_stream_read(n * sizeof(typename T::value_type));
     if (fread(
         const_cast<typename T::pointer>(t.data()),
         sizeof(typename T::value_type),
@@ -140,6 +211,11 @@ public:
   }
   void write(char t);
 
+  /// write n bytes at offset without using or changing the file position.
+  /// Can be called from different threads at the same time, but not mixed
+  /// with the buffered writes above.
+  void write_at(uint64_t offset, const void* data, std::size_t n);
+
   template<typename T, std::size_t N>
   std::size_t write_same(const T (&t)[N]) noexcept {
     return fwrite(&t, sizeof(T), N, file_handle_.get());
@@ -163,9 +239,7 @@ public:
     return ftell(file_handle_.get());
   }
 
-  void close() noexcept {
-    file_handle_.reset(nullptr);
-  }
+  void close() noexcept;
 
   bool eof() const noexcept {
     return feof(file_handle_.get());
@@ -193,7 +267,116 @@ private:
   };
   typedef std::unique_ptr<FILE, file_closer> file_t;
 
+  class mapping_closer
+  {
+  public:
+    constexpr mapping_closer() noexcept : size_() { }
+    constexpr mapping_closer(std::size_t size) noexcept : size_(size) { }
+
+    void
+    operator()(const char* data) const
+    {
+      munmap(const_cast<char*>(data), size_);
+    }
+
+    std::size_t size() const noexcept { return size_; }
+
+  private:
+    std::size_t size_;
+  };
+  typedef std::unique_ptr<const char, mapping_closer> mapping_t;
+
   file_t file_handle_;
+  mapping_t mapping_;
+
+  struct read_cache;
+  class read_cache_deleter
+  {
+  public:
+    void operator()(read_cache* cache) const;
+  };
+
+  std::unique_ptr<read_cache, read_cache_deleter> read_cache_;
+
+  bool load_chunks(read_cache& cache, uint64_t first, uint64_t count) const;
+
+  class text_cache_deleter
+  {
+  public:
+    void operator()(text_cache* cache) const;
+  };
+
+  mutable std::unique_ptr<text_cache, text_cache_deleter> text_cache_;
+  mutable std::mutex text_cache_mutex_;
+
+  class metadata_deleter
+  {
+  public:
+    void operator()(metadata_table* metadata) const;
+  };
+
+  mutable std::unique_ptr<metadata_table, metadata_deleter> metadata_;
+  mutable std::mutex metadata_mutex_;
+
+  mutable file_counters counters_;
+
+  void count_stream_read(std::size_t n) noexcept {
+    file_counters::add(counters_.read_calls);
+    file_counters::add(counters_.bytes_read, n);
+  }
+};
+
+/// sequential reading from a rawfile starting at a position. The position is
+/// kept in the cursor and not in the file, so different cursors on the same
+/// file can be used from different threads at the same time.
+class rawfile_cursor {
+public:
+  enum class read_mode {
+    direct, // read_at()
+    cached // read_cached(), for small metadata blocks
+  };
+
+  rawfile_cursor(const rawfile* file, uint64_t pos,
+      read_mode mode = read_mode::direct) noexcept :
+    file_(file), pos_(pos), mode_(mode)
+  { }
+
+  template<typename T>
+  void read(T& t) {
+    read(&t, sizeof(T));
+  }
+
+  template<typename T>
+  void read_to_container(T& t, std::size_t n) {
+    t.resize(n);
+    read(const_cast<typename T::pointer>(t.data()), n * sizeof(typename T::value_type));
+  }
+
+  void read(void* buffer, std::size_t n) {
+    if (mode_ == read_mode::cached) {
+      file_->read_cached(pos_, buffer, n);
+    } else {
+      file_->read_at(pos_, buffer, n);
+    }
+    pos_ += n;
+  }
+
+  void skip(std::size_t n) noexcept {
+    pos_ += n;
+  }
+
+  uint64_t tell() const noexcept {
+    return pos_;
+  }
+
+  const rawfile* get_file() const noexcept {
+    return file_;
+  }
+
+private:
+  const rawfile* file_;
+  uint64_t pos_;
+  read_mode mode_;
 };
 
 } // namespace mdf
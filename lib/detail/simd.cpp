@@ -0,0 +1,426 @@
+/*
+ * simd.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "simd.h"
+#include "bits.h"
+
+#include <climits>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define LIBMDF_SIMD_X86 1
+// the gather intrinsics of gcc 12 use an undefined source register
+# pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+# define LIBMDF_SIMD_NEON 1
+#endif
+
+namespace mdf {
+
+namespace {
+
+// scalar decoding of one value, used for the remaining records
+
+template<typename Raw, bool Linear>
+inline double decode_one(const char* ptr, const double* c) {
+  Raw raw;
+  memcpy(&raw, ptr, sizeof(Raw));
+  double value = raw;
+  return Linear ? c[1] * value + c[0] : value;
+}
+
+template<bool BigEndian, bool Signed, bool Linear>
+inline double decode_field_one(const char* ptr, unsigned bit_offset,
+    unsigned bit_count, const double* c) {
+  uint64_t raw = bits::load_field(ptr, bit_offset, bit_count, BigEndian);
+  double value = Signed ? double(bits::sign_extend(raw, bit_count)) : double(raw);
+  return Linear ? c[1] * value + c[0] : value;
+}
+
+// raw values are loaded in vectors of 4 or 8 records. Values smaller than
+// 4 bytes are loaded as 32 bit, so the last record is always decoded scalar
+// to not read beyond the end of the batch.
+template<typename Raw>
+inline std::size_t vector_records(std::size_t count, std::size_t width) {
+  std::size_t safe = sizeof(Raw) < 4 && count > 0 ? count - 1 : count;
+  return safe - safe % width;
+}
+
+#ifdef LIBMDF_SIMD_X86
+
+template<typename Raw>
+struct avx2_load;
+
+template<>
+struct avx2_load<int16_t> {
+  __attribute__((target("avx2")))
+  static __m256d load(const char* ptr, __m128i index) {
+    __m128i v = _mm_i32gather_epi32(reinterpret_cast<const int*>(ptr), index, 1);
+    v = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+    return _mm256_cvtepi32_pd(v);
+  }
+};
+
+template<>
+struct avx2_load<uint16_t> {
+  __attribute__((target("avx2")))
+  static __m256d load(const char* ptr, __m128i index) {
+    __m128i v = _mm_i32gather_epi32(reinterpret_cast<const int*>(ptr), index, 1);
+    v = _mm_and_si128(v, _mm_set1_epi32(0xFFFF));
+    return _mm256_cvtepi32_pd(v);
+  }
+};
+
+template<>
+struct avx2_load<int32_t> {
+  __attribute__((target("avx2")))
+  static __m256d load(const char* ptr, __m128i index) {
+    __m128i v = _mm_i32gather_epi32(reinterpret_cast<const int*>(ptr), index, 1);
+    return _mm256_cvtepi32_pd(v);
+  }
+};
+
+template<>
+struct avx2_load<float> {
+  __attribute__((target("avx2")))
+  static __m256d load(const char* ptr, __m128i index) {
+    __m128 v = _mm_i32gather_ps(reinterpret_cast<const float*>(ptr), index, 1);
+    return _mm256_cvtps_pd(v);
+  }
+};
+
+template<>
+struct avx2_load<double> {
+  __attribute__((target("avx2")))
+  static __m256d load(const char* ptr, __m128i index) {
+    return _mm256_i32gather_pd(reinterpret_cast<const double*>(ptr), index, 1);
+  }
+};
+
+template<typename Raw, bool Linear>
+__attribute__((target("avx2")))
+void decode_avx2(const decoder<double>& d, const record_batch& batch, double* out) {
+  const char* ptr = batch.data + d.get_byte_offset();
+  const double* c = d.get_coefficients();
+  if (batch.record_size > INT_MAX / 8) {
+    for (std::size_t i = 0; i < batch.count; i++) {
+      out[i] = decode_one<Raw, Linear>(ptr + i * batch.record_size, c);
+    }
+    return;
+  }
+  int stride = batch.record_size;
+
+  __m128i index = _mm_setr_epi32(0, stride, 2 * stride, 3 * stride);
+  __m256d factor = _mm256_set1_pd(c[1]);
+  __m256d offset = _mm256_set1_pd(c[0]);
+
+  std::size_t n = vector_records<Raw>(batch.count, 4);
+  std::size_t i = 0;
+  for (; i < n; i += 4) {
+    __m256d value = avx2_load<Raw>::load(ptr, index);
+    if (Linear) {
+      value = _mm256_add_pd(_mm256_mul_pd(factor, value), offset);
+    }
+    _mm256_storeu_pd(out + i, value);
+    ptr += 4 * stride;
+  }
+
+  for (; i < batch.count; i++) {
+    out[i] = decode_one<Raw, Linear>(ptr, c);
+    ptr += stride;
+  }
+}
+
+// Bit fields of up to 32 bits (31 bits unsigned, so the values fit into
+// int32): a word of 8 bytes is gathered for each record, byte swapped for
+// big endian, shifted and masked. The field is then narrowed to 32 bit,
+// sign extended and converted to double.
+template<bool BigEndian, bool Signed, bool Linear>
+__attribute__((target("avx2")))
+void decode_bits_avx2(const decoder<double>& d, const record_batch& batch, double* out) {
+  const char* ptr = batch.data + d.get_byte_offset();
+  const double* c = d.get_coefficients();
+  unsigned bit_offset = d.get_bit_offset();
+  unsigned bit_count = d.get_bit_count();
+
+  std::size_t i = 0;
+  if (batch.record_size <= INT_MAX / 8) {
+    int stride = batch.record_size;
+
+    __m128i index = _mm_setr_epi32(0, stride, 2 * stride, 3 * stride);
+    __m128i shift = _mm_cvtsi32_si128(bits::word_shift(bit_offset, bit_count, BigEndian));
+    __m128i extend = _mm_cvtsi32_si128(32 - bit_count);
+    __m256i mask = _mm256_set1_epi64x(bits::field_mask(bit_count));
+    __m256i swap = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    __m256i low = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+    __m256d factor = _mm256_set1_pd(c[1]);
+    __m256d offset = _mm256_set1_pd(c[0]);
+
+    std::size_t n = bits::word_records(batch.count, batch.record_size, d.get_byte_offset());
+    n -= n % 4;
+    for (; i < n; i += 4) {
+      __m256i word = _mm256_i32gather_epi64(reinterpret_cast<const long long*>(ptr), index, 1);
+      if (BigEndian) {
+        word = _mm256_shuffle_epi8(word, swap);
+      }
+      word = _mm256_and_si256(_mm256_srl_epi64(word, shift), mask);
+
+      __m128i v = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(word, low));
+      if (Signed) {
+        v = _mm_sra_epi32(_mm_sll_epi32(v, extend), extend);
+      }
+
+      __m256d value = _mm256_cvtepi32_pd(v);
+      if (Linear) {
+        value = _mm256_add_pd(_mm256_mul_pd(factor, value), offset);
+      }
+      _mm256_storeu_pd(out + i, value);
+      ptr += 4 * stride;
+    }
+  }
+
+  for (; i < batch.count; i++) {
+    out[i] = decode_field_one<BigEndian, Signed, Linear>(ptr, bit_offset, bit_count, c);
+    ptr += batch.record_size;
+  }
+}
+
+template<typename Raw>
+struct avx512_load;
+
+template<>
+struct avx512_load<int16_t> {
+  __attribute__((target("avx512f")))
+  static __m512d load(const char* ptr, __m256i index) {
+    __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(ptr), index, 1);
+    v = _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+    return _mm512_cvtepi32_pd(v);
+  }
+};
+
+template<>
+struct avx512_load<uint16_t> {
+  __attribute__((target("avx512f")))
+  static __m512d load(const char* ptr, __m256i index) {
+    __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(ptr), index, 1);
+    v = _mm256_and_si256(v, _mm256_set1_epi32(0xFFFF));
+    return _mm512_cvtepi32_pd(v);
+  }
+};
+
+template<>
+struct avx512_load<int32_t> {
+  __attribute__((target("avx512f")))
+  static __m512d load(const char* ptr, __m256i index) {
+    __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(ptr), index, 1);
+    return _mm512_cvtepi32_pd(v);
+  }
+};
+
+template<>
+struct avx512_load<float> {
+  __attribute__((target("avx512f")))
+  static __m512d load(const char* ptr, __m256i index) {
+    __m256 v = _mm256_i32gather_ps(reinterpret_cast<const float*>(ptr), index, 1);
+    return _mm512_cvtps_pd(v);
+  }
+};
+
+template<>
+struct avx512_load<double> {
+  __attribute__((target("avx512f")))
+  static __m512d load(const char* ptr, __m256i index) {
+    return _mm512_i32gather_pd(index, ptr, 1);
+  }
+};
+
+template<typename Raw, bool Linear>
+__attribute__((target("avx512f")))
+void decode_avx512(const decoder<double>& d, const record_batch& batch, double* out) {
+  const char* ptr = batch.data + d.get_byte_offset();
+  const double* c = d.get_coefficients();
+  if (batch.record_size > INT_MAX / 8) {
+    for (std::size_t i = 0; i < batch.count; i++) {
+      out[i] = decode_one<Raw, Linear>(ptr + i * batch.record_size, c);
+    }
+    return;
+  }
+  int stride = batch.record_size;
+
+  __m256i index = _mm256_setr_epi32(0, stride, 2 * stride, 3 * stride,
+      4 * stride, 5 * stride, 6 * stride, 7 * stride);
+  __m512d factor = _mm512_set1_pd(c[1]);
+  __m512d offset = _mm512_set1_pd(c[0]);
+
+  std::size_t n = vector_records<Raw>(batch.count, 8);
+  std::size_t i = 0;
+  for (; i < n; i += 8) {
+    __m512d value = avx512_load<Raw>::load(ptr, index);
+    if (Linear) {
+      value = _mm512_add_pd(_mm512_mul_pd(factor, value), offset);
+    }
+    _mm512_storeu_pd(out + i, value);
+    ptr += 8 * stride;
+  }
+
+  for (; i < batch.count; i++) {
+    out[i] = decode_one<Raw, Linear>(ptr, c);
+    ptr += stride;
+  }
+}
+
+#endif // LIBMDF_SIMD_X86
+
+#ifdef LIBMDF_SIMD_NEON
+
+template<typename Raw, bool Linear>
+void decode_neon(const decoder<double>& d, const record_batch& batch, double* out) {
+  const char* ptr = batch.data + d.get_byte_offset();
+  const double* c = d.get_coefficients();
+  std::size_t stride = batch.record_size;
+
+  float64x2_t factor = vdupq_n_f64(c[1]);
+  float64x2_t offset = vdupq_n_f64(c[0]);
+
+  std::size_t n = batch.count - batch.count % 2;
+  std::size_t i = 0;
+  for (; i < n; i += 2) {
+    float64x2_t value = vdupq_n_f64(decode_one<Raw, false>(ptr, c));
+    value = vsetq_lane_f64(decode_one<Raw, false>(ptr + stride, c), value, 1);
+    if (Linear) {
+      value = vaddq_f64(vmulq_f64(factor, value), offset);
+    }
+    vst1q_f64(out + i, value);
+    ptr += 2 * stride;
+  }
+
+  for (; i < batch.count; i++) {
+    out[i] = decode_one<Raw, Linear>(ptr, c);
+    ptr += stride;
+  }
+}
+
+#endif // LIBMDF_SIMD_NEON
+
+template<typename Raw, bool Linear>
+decoder<double>::kernel_func select_isa() {
+#if defined(LIBMDF_SIMD_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return decode_avx512<Raw, Linear>;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return decode_avx2<Raw, Linear>;
+  }
+  return nullptr;
+#elif defined(LIBMDF_SIMD_NEON)
+  return decode_neon<Raw, Linear>;
+#else
+  return nullptr;
+#endif
+}
+
+template<bool Linear>
+decoder<double>::kernel_func select_type(const cnblock& cn) {
+  switch (cn.data_type) {
+  case 0: // unsigned int, little endian
+    switch (cn.bit_count) {
+    case 16: return select_isa<uint16_t, Linear>();
+    default: return nullptr;
+    }
+
+  case 2: // int, little endian
+    switch (cn.bit_count) {
+    case 16: return select_isa<int16_t, Linear>();
+    case 32: return select_isa<int32_t, Linear>();
+    default: return nullptr;
+    }
+
+  case 4: // real, little endian
+    switch (cn.bit_count) {
+    case 32: return select_isa<float, Linear>();
+    case 64: return select_isa<double, Linear>();
+    default: return nullptr;
+    }
+
+  default:
+    return nullptr;
+  }
+}
+
+template<bool Linear>
+decoder<double>::kernel_func select_bit_field(const cnblock& cn) {
+#if defined(LIBMDF_SIMD_X86)
+  bool is_signed = cn.data_type == 2 || cn.data_type == 3;
+  if (cn.bit_offset > 7 || cn.bit_count == 0 || cn.bit_count > (is_signed ? 32u : 31u)) {
+    return nullptr;
+  }
+
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("avx2")) {
+    return nullptr;
+  }
+
+  switch (cn.data_type) {
+  case 0: return decode_bits_avx2<false, false, Linear>;
+  case 1: return decode_bits_avx2<true, false, Linear>;
+  case 2: return decode_bits_avx2<false, true, Linear>;
+  case 3: return decode_bits_avx2<true, true, Linear>;
+  default: return nullptr;
+  }
+#else
+  return nullptr;
+#endif
+}
+
+template<bool Linear>
+decoder<double>::kernel_func select_kernel(const cnblock& cn) {
+  decoder<double>::kernel_func kernel = nullptr;
+  if (cn.bit_offset == 0) {
+    kernel = select_type<Linear>(cn);
+  }
+
+  // bit fields and the remaining small integers
+  if (!kernel && cn.data_type <= 3) {
+    kernel = select_bit_field<Linear>(cn);
+  }
+  return kernel;
+}
+
+} // namespace
+
+decoder<double>::kernel_func select_simd_kernel(const cnblock& cn,
+    unsigned conversion_type) {
+  if (cn.type == 3) {
+    return nullptr;
+  }
+
+  switch (conversion_type) {
+  case 0: return select_kernel<false>(cn);
+  case 1: return select_kernel<true>(cn);
+  default: return nullptr;
+  }
+}
+
+} // namespace mdf
@@ -0,0 +1,42 @@
+/*
+ * simd.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBMDF_SIMD_H_
+#define LIBMDF_SIMD_H_
+
+#include "decoder.h"
+
+namespace mdf {
+
+/// Vectorized kernel for decoding to double, selected by the features of
+/// the running cpu. Supported are little endian int16, uint16, int32, float
+/// and double at a byte offset without or with a linear conversion
+/// (conversion_type 0 or 1), and integer bit fields of up to 32 bits with
+/// AVX2. Returns nullptr if there is no vectorized kernel for the channel or
+/// the cpu.
+///
+/// The results are bit-identical to the scalar kernels.
+decoder<double>::kernel_func select_simd_kernel(const cnblock& cn,
+    unsigned conversion_type);
+
+} // namespace mdf
+
+#endif // LIBMDF_SIMD_H_
@@ -0,0 +1,90 @@
+/*
+ * textcache.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "textcache.h"
+
+#include <cstring>
+
+#include "rawfile.h"
+
+namespace mdf {
+
+text_cache::text_cache(const rawfile* file) :
+    file_(file), mutex_(), entries_(), strings_()
+{ }
+
+boost::string_ref text_cache::intern(std::string text) {
+  // elements of an unordered_set are never moved
+  return *strings_.insert(std::move(text)).first;
+}
+
+text_cache::entry& text_cache::get_entry(link l) {
+  file_counters& counters = file_->get_counters();
+  auto found = entries_.find(l);
+  if (found != entries_.end()) {
+    file_counters::add(counters.text_hits);
+    return found->second;
+  }
+
+  entry e = { boost::string_ref(), false, false, boost::string_ref() };
+  if (l != 0) {
+    file_counters::add(counters.text_misses);
+    rawfile_cursor cursor(file_, l, rawfile_cursor::read_mode::cached);
+    block_header header = prase_block_header(cursor);
+    if (header.id != make_id('T', 'X') && header.id != make_id('M', 'D')) {
+      throw error("format error: not a MD or TX block!");
+    }
+    e.xml = header.id == make_id('M', 'D');
+
+    if (header.length > sizeof(block_header)) {
+      std::size_t length = header.length - sizeof(block_header);
+      if (file_->is_mapped() && cursor.tell() <= file_->size()
+          && length <= file_->size() - cursor.tell()) {
+        const char* text = file_->data() + cursor.tell();
+        e.text = boost::string_ref(text, strnlen(text, length));
+      } else {
+        std::string text;
+        cursor.read_to_container(text, length);
+        text.resize(strlen(text.c_str()));
+        e.text = intern(std::move(text));
+      }
+    }
+  }
+
+  return entries_.emplace(l, e).first->second;
+}
+
+boost::string_ref text_cache::get_text(link l) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return get_entry(l).text;
+}
+
+boost::string_ref text_cache::get_comment(link l) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entry& e = get_entry(l);
+  if (!e.comment_decoded) {
+    e.comment = e.xml ? intern(extract_tx_from_xml(e.text.to_string())) : e.text;
+    e.comment_decoded = true;
+  }
+  return e.comment;
+}
+
+} // namespace mdf
@@ -0,0 +1,71 @@
+/*
+ * textcache.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBMDF_TEXTCACHE_H_
+#define LIBMDF_TEXTCACHE_H_
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/utility/string_ref.hpp>
+
+#include "mdf4.h"
+
+namespace mdf {
+
+/// Texts of the TX and MD blocks of a file. Every block is read only once
+/// and equal texts are stored only once. In a memory mapped file the texts
+/// point into the mapping. Returned strings stay valid until the file is
+/// closed.
+class text_cache {
+  NOT_COPYABLE(text_cache);
+
+public:
+  explicit text_cache(const rawfile* file);
+
+  /// text of TX or MD block, empty for link 0
+  boost::string_ref get_text(link l);
+
+  /// text of TX block or of <TX> element in MD block, decoded on first call
+  boost::string_ref get_comment(link l);
+
+private:
+  struct entry {
+    boost::string_ref text;
+    bool xml;
+    bool comment_decoded;
+    boost::string_ref comment;
+  };
+
+  const rawfile* file_;
+  std::mutex mutex_;
+  std::unordered_map<link, entry> entries_;
+  std::unordered_set<std::string> strings_;
+
+  entry& get_entry(link l);
+  boost::string_ref intern(std::string text);
+};
+
+} // namespace mdf
+
+#endif // LIBMDF_TEXTCACHE_H_
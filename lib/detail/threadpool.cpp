@@ -0,0 +1,129 @@
+/*
+ * threadpool.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "threadpool.h"
+
+#include <algorithm>
+
+namespace mdf {
+
+namespace {
+
+// pool and queue index of the worker running on this thread
+thread_local const thread_pool* current_pool = nullptr;
+thread_local std::size_t current_queue = 0;
+
+}
+
+thread_pool::thread_pool(std::size_t threads) :
+    queues_(), workers_(), next_queue_(0), mutex_(), cv_(), queued_(0), stop_(false)
+{
+  threads = std::max<std::size_t>(1, threads);
+  for (std::size_t i = 0; i < threads; i++) {
+    queues_.emplace_back(new queue());
+  }
+  for (std::size_t i = 0; i < threads; i++) {
+    workers_.emplace_back(&thread_pool::run, this, i);
+  }
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+thread_pool& thread_pool::get_default() {
+  static thread_pool pool;
+  return pool;
+}
+
+void thread_pool::push(std::function<void()> task) {
+  std::size_t index;
+  if (current_pool == this) {
+    index = current_queue;
+  } else {
+    index = next_queue_++ % queues_.size();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_++;
+  }
+  cv_.notify_one();
+}
+
+bool thread_pool::pop(std::size_t index, std::function<void()>& task) {
+  {
+    queue& own = *queues_[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      queued_--;
+      return true;
+    }
+  }
+
+  for (std::size_t i = 1; i < queues_.size(); i++) {
+    queue& other = *queues_[(index + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (!other.tasks.empty()) {
+      task = std::move(other.tasks.front());
+      other.tasks.pop_front();
+      queued_--;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void thread_pool::run(std::size_t index) {
+  current_pool = this;
+  current_queue = index;
+
+  while (true) {
+    std::function<void()> task;
+    if (pop(index, task)) {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return stop_ || queued_ != 0; });
+    if (stop_ && queued_ == 0) {
+      return;
+    }
+  }
+}
+
+} // namespace mdf
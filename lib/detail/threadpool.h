@@ -0,0 +1,148 @@
+/*
+ * threadpool.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBMDF_THREADPOOL_H_
+#define LIBMDF_THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "macros.h"
+
+namespace mdf {
+
+/// Work-stealing thread pool.
+///
+/// Every worker has its own task queue. Tasks submitted by a worker go to its
+/// own queue and are executed last in first out, other tasks are distributed
+/// over the queues. Idle workers steal the oldest tasks of other queues.
+class thread_pool {
+  NOT_COPYABLE(thread_pool);
+
+public:
+  explicit thread_pool(std::size_t threads = std::thread::hardware_concurrency());
+  ~thread_pool();
+
+  std::size_t size() const { return workers_.size(); }
+
+  template<typename F>
+  std::future<typename std::result_of<F()>::type> submit(F f) {
+    typedef typename std::result_of<F()>::type result_type;
+
+    auto task = std::make_shared<std::packaged_task<result_type()> >(std::move(f));
+    std::future<result_type> result = task->get_future();
+    push([task]() { (*task)(); });
+    return result;
+  }
+
+  /// Call f(i) for all i in [0, n) and return when all calls are finished.
+  /// The calling thread takes part, so it is safe to call from a task of the
+  /// pool. The first exception thrown by f is rethrown.
+  template<typename F>
+  void parallel_for(std::size_t n, F f);
+
+  /// pool used by the library if no other one is given
+  static thread_pool& get_default();
+
+private:
+  struct queue {
+    std::mutex mutex;
+    std::deque<std::function<void()> > tasks;
+  };
+
+  std::vector<std::unique_ptr<queue> > queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<std::size_t> next_queue_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::atomic<std::size_t> queued_;
+  bool stop_;
+
+  void push(std::function<void()> task);
+  bool pop(std::size_t index, std::function<void()>& task);
+  void run(std::size_t index);
+};
+
+template<typename F>
+void thread_pool::parallel_for(std::size_t n, F f) {
+  struct state {
+    F f;
+    std::size_t n;
+    std::atomic<std::size_t> next;
+    std::size_t done;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    state(F f, std::size_t n) : f(std::move(f)), n(n), next(0), done(0) { }
+
+    // process items until none are left
+    void work() {
+      std::size_t i;
+      while ((i = next++) < n) {
+        std::exception_ptr e;
+        try {
+          f(i);
+        } catch (...) {
+          e = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (e && !error) {
+          error = e;
+        }
+        if (++done == n) {
+          cv.notify_all();
+        }
+      }
+    }
+  };
+
+  if (n == 0) {
+    return;
+  }
+
+  auto s = std::make_shared<state>(std::move(f), n);
+  std::size_t helpers = std::min(n - 1, size());
+  for (std::size_t i = 0; i < helpers; i++) {
+    push([s]() { s->work(); });
+  }
+  s->work();
+
+  std::unique_lock<std::mutex> lock(s->mutex);
+  s->cv.wait(lock, [&s]() { return s->done == s->n; });
+  if (s->error) {
+    std::rethrow_exception(s->error);
+  }
+}
+
+} // namespace mdf
+
+#endif // LIBMDF_THREADPOOL_H_
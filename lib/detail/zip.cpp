@@ -0,0 +1,93 @@
+/*
+ * zip.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "zip.h"
+
+#include <algorithm>
+#include <zlib.h>
+
+#include "rawfile.h"
+
+namespace mdf {
+
+static void transpose_back(std::vector<char>& data, std::size_t columns) {
+  // data is a matrix of rows x columns bytes stored column by column, bytes
+  // after the last complete row are not transposed
+  std::size_t rows = data.size() / columns;
+  if (columns <= 1 || rows <= 1) {
+    return;
+  }
+
+  std::vector<char> result(data.size());
+  for (std::size_t column = 0; column < columns; column++) {
+    const char* src = data.data() + column * rows;
+    char* dest = &result[column];
+    for (std::size_t row = 0; row < rows; row++) {
+      *dest = src[row];
+      dest += columns;
+    }
+  }
+  std::copy(data.begin() + rows * columns, data.end(), result.begin() + rows * columns);
+
+  data.swap(result);
+}
+
+std::vector<char> read_dz(const rawfile* file, link l, const char* org_type) {
+  rawfile_cursor cursor(file, l);
+  block_header header = prase_block_header(cursor, make_id('D', 'Z'));
+  cursor.skip(header.link_count * sizeof(link));
+
+  dzblock dz;
+  cursor.read(dz);
+  if (dz.org_block_type[0] != org_type[0] || dz.org_block_type[1] != org_type[1]) {
+    throw error("format error: unexpected block type in DZ block");
+  }
+  if (dz.zip_type > 1) {
+    throw error("zip type of DZ block not supported");
+  }
+
+  std::string compressed;
+  const Bytef* src;
+  if (file->is_mapped()) {
+    if (cursor.tell() > file->size() || dz.data_length > file->size() - cursor.tell()) {
+      throw error("format error: data block exceeds file size");
+    }
+    src = reinterpret_cast<const Bytef*>(file->data() + cursor.tell());
+  } else {
+    cursor.read_to_container(compressed, dz.data_length);
+    src = reinterpret_cast<const Bytef*>(compressed.data());
+  }
+
+  std::vector<char> data(dz.org_data_length);
+  uLongf length = data.size();
+  if (uncompress(reinterpret_cast<Bytef*>(data.data()), &length, src, dz.data_length) != Z_OK
+      || length != data.size()) {
+    throw error("format error: corrupted data in DZ block");
+  }
+
+  if (dz.zip_type == 1) {
+    transpose_back(data, dz.zip_parameter);
+  }
+
+  return data;
+}
+
+} // namespace mdf
@@ -0,0 +1,38 @@
+/*
+ * zip.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBMDF_ZIP_H_
+#define LIBMDF_ZIP_H_
+
+#include <vector>
+
+#include "mdf4.h"
+
+namespace mdf {
+
+/// read a DZ block and return its decompressed data. Transposed data is
+/// transposed back, so the result is the data of the original block, which
+/// must have the block type org_type ("DT", "SD", ...).
+std::vector<char> read_dz(const rawfile* file, link l, const char* org_type = "DT");
+
+} // namespace mdf
+
+#endif // LIBMDF_ZIP_H_
@@ -22,29 +22,38 @@
 #include "file.h"
 
 #include <cstring>
-#include <cassert>
 #include <boost/optional.hpp>
 
 #include "detail/mdf4.h"
 
 namespace mdf {
 
-void file::open(const char* filename) {
+// bytes read at once on open if the read cache is used
+static const std::size_t metadata_prefetch_size = 1024 * 1024;
+
+void file::open(const char* filename, const open_options& options) {
   handle_ = std::make_shared<rawfile>();
   handle_->open(filename, "r");
+  handle_->get_counters().timing = options.timing;
+  phase_timer timer(handle_->get_counters(), file_counters::open_phase);
+
+  if (options.memory_map) {
+    handle_->map();
+  } else if (options.read_cache) {
+    // most writers put the metadata in front of the data
+    handle_->enable_read_cache();
+    handle_->prefetch(0, metadata_prefetch_size);
+  }
 
   prase_idblock();
   prase_basic_hdblock();
-  prase_groups();
+  prase_groups(options.lazy);
 }
 
 void file::prase_idblock() {
   // prase IDBLOCK
-  // not needed (hopefully): handle_.seek(64, rawfile::seek_orgin::begin);
-  assert(handle_->tell() == 0);
-
   idblock id;
-  handle_->read(id);
+  handle_->read_cached(0, &id, sizeof(id));
 
   if (!std::equal(id.file_id, id.file_id + 8, "MDF     ")) {
     std::string e(id.file_id, 8);
@@ -107,10 +116,8 @@ std::string file::get_mdf_version_string() const {
 }
 
 std::string file::get_generator_name() const {
-  handle_->seek(0, rawfile::seek_orgin::begin);
-
   idblock id;
-  handle_->read(id);
+  handle_->read_cached(0, &id, sizeof(id));
 
   std::string result(8, '\0');
   std::copy(id.program_id, id.program_id + 8, result.begin());
@@ -119,33 +126,69 @@ std::string file::get_generator_name() const {
 
 void file::prase_basic_hdblock() {
   // prase HDBLOCK
-  handle_->seek(64, rawfile::seek_orgin::begin);
+  rawfile_cursor cursor(handle_.get(), 64, rawfile_cursor::read_mode::cached);
 
   // read header
-  block_header header = prase_block_header(handle_.get(), make_id('H', 'D'));
+  block_header header = prase_block_header(cursor, make_id('H', 'D'));
 
   // read links
-  handle_->read_to_container(links_, header.link_count);
+  cursor.read_to_container(links_, header.link_count);
+}
+
+boost::string_ref file::get_metadata_comment_ref() const {
+  return get_tx(handle_.get(), links_[5]);
 }
 
-std::string file::get_metadata_comment() const {
-  return prase_tx(handle_.get(), links_[5]);
+boost::string_ref file::get_comment_ref() const {
+  return get_tx_comment(handle_.get(), links_[5]);
 }
 
-std::string file::get_comment() const {
-  return extract_tx_from_xml(get_metadata_comment());
+file_stats file::get_stats() const {
+  const file_counters& counters = handle_->get_counters();
+  file_stats stats;
+  stats.read_calls = counters.read_calls;
+  stats.bytes_read = counters.bytes_read;
+  stats.seeks = counters.seeks;
+  stats.cached_reads = counters.cached_reads;
+  stats.cache_loads = counters.cache_loads;
+  stats.text_hits = counters.text_hits;
+  stats.text_misses = counters.text_misses;
+
+  for (std::size_t i = 0; i <= file_counters::block_types; i++) {
+    uint64_t n = counters.blocks[i];
+    if (n != 0) {
+      uint16_t id = i < file_counters::block_types ? file_counters::block_ids[i] : 0;
+      std::string name = id ? std::string(reinterpret_cast<const char*>(&id), 2) : "??";
+      stats.blocks[name] = n;
+    }
+  }
+
+  stats.open_seconds = counters.phase_ns[file_counters::open_phase] * 1e-9;
+  stats.metadata_seconds = counters.phase_ns[file_counters::metadata_phase] * 1e-9;
+  stats.decode_seconds = counters.phase_ns[file_counters::decode_phase] * 1e-9;
+  return stats;
+}
+
+void file::reset_stats() {
+  handle_->get_counters().reset();
 }
 
-void file::prase_groups() {
+void file::prase_groups(bool lazy) {
   // for all data groups
   // groups_.clear();
+  phase_timer timer(handle_->get_counters(), file_counters::metadata_phase);
 
   link next = links_[0];
   while (next) {
     // DG Data group
-    data_groups_.emplace_back(handle_, next);
+    data_groups_.emplace_back(handle_, next, lazy);
     next = data_groups_.back().get_next_group();
   }
+
+  // groups were moved while the vector grew
+  for (data_group& dg : data_groups_) {
+    dg.relink();
+  }
 }
 
 } // namespace mdf
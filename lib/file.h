@@ -23,6 +23,8 @@
 #define LIBMDF_FILE_H_
 
 #include <cstdio>
+#include <map>
+#include <string>
 #include <vector>
 #include <memory>
 
@@ -33,6 +35,63 @@
 
 namespace mdf {
 
+/// options for opening a mdf file
+struct open_options {
+  open_options() :
+    memory_map(false), read_cache(true), lazy(false), timing(false)
+  { }
+
+  /// map the whole file into memory, data blocks are read in place
+  bool memory_map;
+
+  /// Read metadata blocks in large chunks and keep them in memory, the head
+  /// of the file is read at once on open. Saves many small reads, mostly on
+  /// network file systems. Not used with memory_map.
+  bool read_cache;
+
+  /// Read only data groups and channel groups on open. Channels and their
+  /// source information and conversion are read on first access.
+  bool lazy;
+
+  /// take the time spent in the phases of file_stats
+  bool timing;
+};
+
+/// Counters of the work done on an opened file, see file::get_stats()
+struct file_stats {
+  /// Reads of the file and bytes read, data read in place from a memory
+  /// mapping is not counted
+  uint64_t read_calls;
+  uint64_t bytes_read;
+
+  /// reads not starting at the end of the read before
+  uint64_t seeks;
+
+  /// small metadata reads through the read cache, and the reads of the file
+  /// done for the ones not in the cache
+  uint64_t cached_reads;
+  uint64_t cache_loads;
+
+  /// lookups of TX and MD blocks in the text cache
+  uint64_t text_hits;
+  uint64_t text_misses;
+
+  /// block headers parsed, by block id like "CN", "??" for unknown ids
+  std::map<std::string, uint64_t> blocks;
+
+  /// Seconds spent in open(), in reading data groups, channel groups and
+  /// channels (also lazily after open) and in decoding samples. Only taken
+  /// with open_options::timing, decoding in parallel counts once.
+  double open_seconds;
+  double metadata_seconds;
+  double decode_seconds;
+};
+
+/// A mdf file and its data groups.
+///
+/// All reading is done with positional reads, so a const mdf::file (and all
+/// data groups, channel groups and channels of it) can be used from many
+/// threads at the same time.
 class file {
 public:
   file() :
@@ -40,25 +99,25 @@ public:
     links_(), data_groups_()
   { }
 
-  file(const std::string& filename) :
+  file(const std::string& filename, const open_options& options = open_options()) :
     handle_(), file_version_(),
     links_(), data_groups_()
   {
-    open(filename);
+    open(filename, options);
   }
 
-  file(const char* filename) :
+  file(const char* filename, const open_options& options = open_options()) :
     handle_(), file_version_(),
     links_(), data_groups_()
   {
-    open(filename);
+    open(filename, options);
   }
 
-  void open(const std::string& filename) {
-    open(filename.c_str());
+  void open(const std::string& filename, const open_options& options = open_options()) {
+    open(filename.c_str(), options);
   }
 
-  void open(const char* filename);
+  void open(const char* filename, const open_options& options = open_options());
 
   explicit operator bool() const {
     return good();
@@ -68,8 +127,12 @@ public:
     return handle_ && handle_->is_open() && handle_->good();
   }
 
-  std::string get_metadata_comment() const;
-  std::string get_comment() const;
+  std::string get_metadata_comment() const { return get_metadata_comment_ref().to_string(); }
+  std::string get_comment() const { return get_comment_ref().to_string(); }
+
+  // texts are cached, references stay valid while the file is open
+  boost::string_ref get_metadata_comment_ref() const;
+  boost::string_ref get_comment_ref() const;
 
   uint16_t get_mdf_version() const { return file_version_; }
   std::string get_mdf_version_string() const;
@@ -78,6 +141,10 @@ public:
 
   const std::vector<data_group>& get_data_groups() const { return data_groups_; }
 
+  /// counters since open or the last reset_stats()
+  file_stats get_stats() const;
+  void reset_stats();
+
 private:
   // file itself
   mutable std::shared_ptr<rawfile> handle_;
@@ -91,7 +158,7 @@ private:
 
   void prase_idblock();
   void prase_basic_hdblock();
-  void prase_groups();
+  void prase_groups(bool lazy);
 };
 
 } // namespace mdf
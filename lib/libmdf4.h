@@ -26,6 +26,8 @@
 #include "channel.h"
 #include "channelgroup.h"
 #include "datagroup.h"
+#include "recordcursor.h"
+#include "writer.h"
 
 namespace mdf {
 
@@ -0,0 +1,512 @@
+/*
+ * recordcursor.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recordcursor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "channelgroup.h"
+#include "datagroup.h"
+#include "detail/rawfile.h"
+#include "detail/threadpool.h"
+#include "detail/zip.h"
+
+namespace mdf {
+
+record_cursor::record_cursor(const channel_group* cg, std::size_t buffer_size) :
+    record_cursor(cg, 0, cg->get_cycle_count(), buffer_size)
+{ }
+
+record_cursor::record_cursor(const channel_group* cg, uint64_t first, uint64_t last,
+    std::size_t buffer_size) :
+    record_cursor(cg->get_data_group(), cg->get_data_bytes() + cg->get_inval_bytes(),
+        0, 0, buffer_size)
+{
+  last = std::min(last, cg->get_cycle_count());
+  if (dg_->is_sorted()) {
+    start(first, last);
+    return;
+  }
+
+  record_offsets_ = &dg_->get_record_offsets(cg);
+  record_end_ = std::min<uint64_t>(last, record_offsets_->size());
+  first_record_ = record_ = std::min(first, record_end_);
+}
+
+record_cursor::record_cursor(const data_group* dg, std::size_t record_size,
+    uint64_t first, uint64_t last, std::size_t buffer_size) :
+    dg_(dg), file_(dg->get_file().get()),
+    blocks_(&dg->get_data_blocks()),
+    record_size_(record_size),
+    buffer_records_(std::max<std::size_t>(1, buffer_size / std::max<std::size_t>(1, record_size_))),
+    first_record_(), record_(), record_end_(),
+    block_(0), block_data_(nullptr), block_begin_(0), block_pos_(0), block_end_(0),
+    skip_(0),
+    aligned_length_(0), buffer_(), carry_(),
+    inflated_(), pending_(), prefetch_block_(0),
+    prefetch_count_(thread_pool::get_default().size()),
+    read_ahead_mode_(read_ahead_mode::undecided), read_ahead_blocks_(4),
+    read_ahead_bytes_(16 << 20), block_offsets_(nullptr), data_end_(0),
+    ahead_block_(0), ahead_offset_(0), advised_pos_(0), pieces_(),
+    piece_data_(), spare_data_(),
+    record_offsets_(nullptr), stream_(), stream_data_(nullptr), stream_avail_(0),
+    stream_pos_(0)
+{
+  uint64_t equal_length = dg->get_equal_length();
+  if (record_size_ != 0 && equal_length % record_size_ == 0 && !dg->is_compressed()) {
+    aligned_length_ = equal_length;
+  }
+
+  start(first, last);
+}
+
+void record_cursor::start(uint64_t first, uint64_t last) {
+  record_end_ = last;
+  first_record_ = record_ = std::min(first, record_end_);
+  if (record_ != 0 && record_ < record_end_ && record_size_ != 0) {
+    seek(record_ * record_size_);
+  }
+}
+
+void record_cursor::seek(uint64_t offset) {
+  if (blocks_->empty()) {
+    return;
+  }
+
+  if (aligned_length_ != 0) {
+    block_ = std::min<uint64_t>(offset / aligned_length_, blocks_->size() - 1);
+    skip_ = offset - block_ * aligned_length_;
+    return;
+  }
+
+  // last block which starts at or before offset
+  const std::vector<uint64_t>& offsets = dg_->get_block_offsets();
+  block_ = std::upper_bound(offsets.begin(), offsets.end() - 1, offset) - offsets.begin() - 1;
+  skip_ = offset - offsets[block_];
+}
+
+record_cursor::~record_cursor() {
+  // tasks still read from the file
+  for (auto& block : pending_) {
+    block.wait();
+  }
+  for (auto& p : pieces_) {
+    p.ready.wait();
+  }
+}
+
+record_cursor::prefetched_block record_cursor::read_block(const rawfile* file, link l) {
+  prefetched_block result;
+
+  rawfile_cursor cursor(file, l);
+  block_header header = prase_block_header(cursor);
+  if (header.id == make_id('D', 'Z')) {
+    result.compressed = true;
+    result.data = read_dz(file, l);
+    result.pos = 0;
+    result.end = result.data.size();
+  } else if (header.id == make_id('D', 'T')) {
+    cursor.skip(header.link_count * sizeof(link));
+    result.compressed = false;
+    result.pos = cursor.tell();
+    result.end = l + header.length;
+  } else {
+    throw error("format error: expected DT or DZ block");
+  }
+
+  return result;
+}
+
+void record_cursor::prefetch() {
+  while (pending_.size() < prefetch_count_ && prefetch_block_ < blocks_->size()) {
+    const rawfile* file = file_;
+    link l = (*blocks_)[prefetch_block_++];
+    pending_.push_back(thread_pool::get_default().submit([file, l]() {
+      return read_block(file, l);
+    }));
+  }
+}
+
+void record_cursor::read_piece(const rawfile* file, link l, uint64_t offset,
+    std::vector<char>& data) {
+  if (offset == 0) {
+    rawfile_cursor cursor(file, l);
+    block_header header = prase_block_header(cursor, make_id('D', 'T'));
+    if (header.link_count != 0) {
+      throw error("format error: links in DT block");
+    }
+  }
+  file->read_at(l + sizeof(block_header) + offset, data.data(), data.size());
+}
+
+void record_cursor::start_read_ahead() {
+  read_ahead_mode_ = read_ahead_mode::none;
+  if (read_ahead_blocks_ == 0 || read_ahead_bytes_ == 0 || record_size_ == 0 ||
+      blocks_->empty() || dg_->is_compressed()) {
+    return;
+  }
+
+  try {
+    block_offsets_ = &dg_->get_block_offsets();
+  } catch (const error&) {
+    // the blocks are still read one after the other
+    return;
+  }
+
+  data_end_ = std::numeric_limits<uint64_t>::max();
+  if (record_end_ < data_end_ / record_size_) {
+    data_end_ = record_end_ * record_size_;
+  }
+  ahead_block_ = block_;
+  if (file_->is_mapped() || prefetch_count_ == 0) {
+    read_ahead_mode_ = read_ahead_mode::advise;
+    return;
+  }
+
+  // the first piece starts behind the skipped bytes
+  read_ahead_mode_ = read_ahead_mode::background;
+  ahead_offset_ = skip_;
+  skip_ = 0;
+  read_ahead();
+}
+
+void record_cursor::read_ahead() {
+  const std::vector<uint64_t>& offsets = *block_offsets_;
+  std::size_t piece_size = buffer_records_ * record_size_;
+  std::size_t depth = std::max<std::size_t>(1,
+      std::min(read_ahead_blocks_, read_ahead_bytes_ / piece_size));
+
+  while (pieces_.size() < depth && ahead_block_ < blocks_->size()) {
+    uint64_t begin = offsets[ahead_block_];
+    uint64_t length = offsets[ahead_block_ + 1] - begin;
+    uint64_t end = data_end_ > begin ? std::min(length, data_end_ - begin) : 0;
+    if (ahead_offset_ >= end) {
+      // no more records in this block, or none behind it
+      ahead_block_ = end < length ? blocks_->size() : ahead_block_ + 1;
+      ahead_offset_ = 0;
+      continue;
+    }
+
+    piece p;
+    p.data = spare_data_ ? std::move(spare_data_)
+        : std::unique_ptr<std::vector<char> >(new std::vector<char>());
+    p.data->resize(std::min<uint64_t>(piece_size, end - ahead_offset_));
+
+    const rawfile* file = file_;
+    link l = (*blocks_)[ahead_block_];
+    uint64_t offset = ahead_offset_;
+    std::vector<char>* data = p.data.get();
+    p.ready = thread_pool::get_default().submit([file, l, offset, data]() {
+      read_piece(file, l, offset, *data);
+    });
+    ahead_offset_ += data->size();
+    pieces_.push_back(std::move(p));
+  }
+}
+
+bool record_cursor::next_piece() {
+  while (!pieces_.empty()) {
+    piece p = std::move(pieces_.front());
+    pieces_.pop_front();
+    p.ready.get();
+
+    // the data of the piece before is not used anymore
+    spare_data_ = std::move(piece_data_);
+    piece_data_ = std::move(p.data);
+    read_ahead();
+
+    block_data_ = piece_data_->data();
+    block_pos_ = 0;
+    block_end_ = piece_data_->size();
+    if (enter_block()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void record_cursor::advise() {
+  // records left behind the bytes to skip, a hint for a few pages is not
+  // worth the system call
+  const std::vector<uint64_t>& offsets = *block_offsets_;
+  uint64_t pos = block_pos_ + std::min(skip_, block_end_ - block_pos_);
+  uint64_t offset = offsets[block_ - 1] + (pos - block_begin_);
+  uint64_t remaining = data_end_ > offset ? data_end_ - offset : 0;
+  if (remaining < min_advise_bytes) {
+    advised_pos_ = block_end_;
+    return;
+  }
+
+  // the next bytes of the current block, advised again when half of them
+  // are read
+  uint64_t n = std::min<uint64_t>(read_ahead_bytes_, block_end_ - pos);
+  n = std::min(n, remaining);
+  file_->will_need(pos, n);
+  if (n < block_end_ - pos) {
+    advised_pos_ = n < remaining ? pos + n / 2 : block_end_;
+    return;
+  }
+  advised_pos_ = block_end_;
+
+  // and the beginning of the following blocks
+  uint64_t bytes = read_ahead_bytes_ - n;
+  std::size_t last = std::min(blocks_->size(), block_ + read_ahead_blocks_);
+  ahead_block_ = std::max(ahead_block_, block_);
+  while (ahead_block_ < last && bytes != 0 && offsets[ahead_block_] < data_end_) {
+    uint64_t length = std::min(bytes, offsets[ahead_block_ + 1] - offsets[ahead_block_]);
+    length = std::min(length, data_end_ - offsets[ahead_block_]);
+    file_->will_need((*blocks_)[ahead_block_] + sizeof(block_header), length);
+    bytes -= length;
+    ahead_block_++;
+  }
+}
+
+bool record_cursor::is_mapped_dt_block(link l) const {
+  // the header is read anyway if the file is not mapped
+  if (!file_->is_mapped() || l > file_->size() ||
+      file_->size() - l < sizeof(block_header)) {
+    return false;
+  }
+
+  block_header header;
+  std::memcpy(&header, file_->data() + l, sizeof(header));
+  return header.double_hash == make_id('#', '#') && header.id == make_id('D', 'T') &&
+      header.link_count == 0;
+}
+
+void record_cursor::set_block(uint64_t pos, uint64_t end) {
+  if (file_->is_mapped()) {
+    if (end > file_->size()) {
+      throw error("format error: data block exceeds file size");
+    }
+    block_data_ = file_->data();
+  } else {
+    block_data_ = nullptr;
+  }
+  block_begin_ = pos;
+  block_pos_ = pos;
+  block_end_ = end;
+
+  if (read_ahead_mode_ == read_ahead_mode::advise) {
+    advise();
+  }
+}
+
+bool record_cursor::next_block() {
+  if (read_ahead_mode_ == read_ahead_mode::undecided) {
+    start_read_ahead();
+  }
+  if (read_ahead_mode_ == read_ahead_mode::background) {
+    return next_piece();
+  }
+
+  while (block_ < blocks_->size()) {
+    std::size_t index = block_++;
+    link l = (*blocks_)[index];
+
+    if (pending_.empty() && aligned_length_ != 0 && block_ != blocks_->size() &&
+        is_mapped_dt_block(l)) {
+      // length is known from the DL block
+      set_block(l + sizeof(block_header), l + sizeof(block_header) + aligned_length_);
+
+    } else {
+      if (pending_.empty()) {
+        rawfile_cursor cursor(file_, l);
+        block_header header = prase_block_header(cursor);
+        if (header.id == make_id('D', 'T')) {
+          cursor.skip(header.link_count * sizeof(link));
+          set_block(cursor.tell(), l + header.length);
+          if (enter_block()) {
+            return true;
+          }
+          continue;
+        }
+
+        // decompress this and the following blocks in background
+        prefetch_block_ = index;
+        prefetch();
+      }
+
+      prefetched_block block;
+      if (prefetch_count_ == 0) {
+        block = read_block(file_, l);
+      } else {
+        block = pending_.front().get();
+        pending_.pop_front();
+        prefetch();
+      }
+
+      if (block.compressed) {
+        inflated_.swap(block.data);
+        block_data_ = inflated_.data();
+        block_pos_ = block.pos;
+        block_end_ = block.end;
+      } else {
+        set_block(block.pos, block.end);
+      }
+    }
+
+    if (enter_block()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool record_cursor::enter_block() {
+  if (block_end_ <= block_pos_) {
+    return false;
+  }
+
+  uint64_t n = std::min(skip_, block_end_ - block_pos_);
+  block_pos_ += n;
+  skip_ -= n;
+  return block_end_ > block_pos_;
+}
+
+bool record_cursor::read_straddling(record_batch& batch) {
+  carry_.resize(record_size_);
+
+  std::size_t filled = 0;
+  while (filled < record_size_) {
+    if (block_pos_ == block_end_ && !next_block()) {
+      // last record is incomplete
+      record_ = record_end_;
+      return false;
+    }
+
+    std::size_t n = std::min<uint64_t>(block_end_ - block_pos_, record_size_ - filled);
+    if (block_data_) {
+      std::copy(block_data_ + block_pos_, block_data_ + block_pos_ + n, &carry_[filled]);
+    } else {
+      file_->read_at(block_pos_, &carry_[filled], n);
+    }
+    filled += n;
+    block_pos_ += n;
+  }
+
+  batch.data = carry_.data();
+  batch.count = 1;
+  batch.record_size = record_size_;
+  batch.first_record = record_;
+
+  record_ += 1;
+  return true;
+}
+
+void record_cursor::read_stream(uint64_t offset, char* buffer, std::size_t n) {
+  uint64_t buffer_size = buffer_records_ * record_size_;
+  if (!stream_ || offset < stream_pos_ || offset - stream_pos_ > buffer_size) {
+    // start over at the record instead of reading the data in between
+    stream_.reset(new record_cursor(dg_, 1, offset,
+        std::numeric_limits<uint64_t>::max(), buffer_size));
+    stream_->set_prefetch(prefetch_count_);
+    stream_->set_read_ahead(read_ahead_blocks_, read_ahead_bytes_);
+    stream_avail_ = 0;
+    stream_pos_ = offset;
+  }
+
+  while (n != 0) {
+    if (stream_avail_ == 0) {
+      record_batch batch;
+      if (!stream_->next(batch)) {
+        throw error("format error: record exceeds data of data group");
+      }
+      stream_data_ = batch.data;
+      stream_avail_ = batch.count;
+    }
+
+    uint64_t k;
+    if (stream_pos_ < offset) {
+      k = std::min(offset - stream_pos_, stream_avail_);
+    } else {
+      k = std::min<uint64_t>(n, stream_avail_);
+      std::copy(stream_data_, stream_data_ + k, buffer);
+      buffer += k;
+      offset += k;
+      n -= k;
+    }
+    stream_data_ += k;
+    stream_avail_ -= k;
+    stream_pos_ += k;
+  }
+}
+
+bool record_cursor::gather(record_batch& batch) {
+  uint64_t count = std::min<uint64_t>(buffer_records_, record_end_ - record_);
+  buffer_.resize(count * record_size_);
+  for (uint64_t i = 0; i < count; i++) {
+    read_stream((*record_offsets_)[record_ + i], &buffer_[i * record_size_], record_size_);
+  }
+
+  batch.data = buffer_.data();
+  batch.count = count;
+  batch.record_size = record_size_;
+  batch.first_record = record_;
+
+  record_ += count;
+  return true;
+}
+
+bool record_cursor::next(record_batch& batch) {
+  if (record_ >= record_end_ || record_size_ == 0) {
+    return false;
+  }
+
+  if (record_offsets_) {
+    return gather(batch);
+  }
+
+  if (block_pos_ == block_end_ && !next_block()) {
+    return false;
+  }
+
+  uint64_t block_records = (block_end_ - block_pos_) / record_size_;
+  if (block_records == 0) {
+    return read_straddling(batch);
+  }
+
+  uint64_t count = std::min(block_records, record_end_ - record_);
+  if (block_data_) {
+    batch.data = block_data_ + block_pos_;
+  } else {
+    count = std::min<uint64_t>(count, buffer_records_);
+    buffer_.resize(count * record_size_);
+    file_->read_at(block_pos_, &buffer_[0], buffer_.size());
+    batch.data = buffer_.data();
+  }
+
+  batch.count = count;
+  batch.record_size = record_size_;
+  batch.first_record = record_;
+
+  record_ += count;
+  block_pos_ += count * record_size_;
+  if (read_ahead_mode_ == read_ahead_mode::advise && block_pos_ >= advised_pos_ &&
+      block_pos_ < block_end_) {
+    advise();
+  }
+  return true;
+}
+
+} // namespace mdf
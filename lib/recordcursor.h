@@ -0,0 +1,219 @@
+/*
+ * recordcursor.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDCURSOR_H_
+#define RECORDCURSOR_H_
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "detail/mdf4.h"
+
+namespace mdf {
+
+class channel_group;
+class data_group;
+class thread_pool;
+
+/// options for decoding the samples of channels
+struct decode_options {
+  decode_options() : parallel(false), pool(nullptr), read_ahead_blocks(4),
+      read_ahead_bytes(16 << 20) { }
+
+  /// Split the records into ranges and decode them concurrently. For
+  /// compressed data groups the ranges follow block boundaries.
+  bool parallel;
+
+  /// pool for parallel decoding, nullptr for the default pool of the library
+  thread_pool* pool;
+
+  /// read ahead of uncompressed data, see record_cursor::set_read_ahead()
+  std::size_t read_ahead_blocks;
+  std::size_t read_ahead_bytes;
+};
+
+/// consecutive records of a channel group in memory
+struct record_batch {
+  /// begin of the first record
+  const char* data;
+
+  /// number of records in batch
+  std::size_t count;
+
+  /// bytes between the begin of two records
+  std::size_t record_size;
+
+  /// index of the first record in the channel group
+  uint64_t first_record;
+};
+
+/// Reads the records of a channel group block by block.
+///
+/// If the file is memory mapped, the batches point straight into the
+/// mapping. Otherwise at most buffer_size bytes of records are read at once,
+/// and the following pieces of the DT blocks are read in background while
+/// the records before are decoded (see set_read_ahead()).
+///
+/// DT blocks do not need to end at record boundaries. A record which
+/// straddles two blocks is put together in a side buffer and returned as a
+/// batch of its own, all other records are returned in place.
+///
+/// DZ blocks are decompressed on the default thread pool. While the records
+/// of one block are read, the following blocks are already decompressed,
+/// one for every worker thread.
+///
+/// The records of an unsorted data group are gathered into the buffer with
+/// the record offsets of the data group, the data between them is skipped.
+class record_cursor {
+public:
+  static const std::size_t default_buffer_size = 1 << 20;
+
+  /// smallest range of the file to advise the kernel about
+  static const uint64_t min_advise_bytes = 2 * 4096;
+
+  record_cursor(const channel_group* cg,
+      std::size_t buffer_size = default_buffer_size);
+
+  /// read only the records [first, last)
+  record_cursor(const channel_group* cg, uint64_t first, uint64_t last,
+      std::size_t buffer_size = default_buffer_size);
+
+  /// read the data of dg as records of record_size bytes [first, last)
+  record_cursor(const data_group* dg, std::size_t record_size,
+      uint64_t first, uint64_t last,
+      std::size_t buffer_size = default_buffer_size);
+
+  record_cursor(record_cursor&&) = default;
+  ~record_cursor();
+
+  /// read next batch of records, return false if there are no more records
+  bool next(record_batch& batch);
+
+  /// number of records the cursor reads at most
+  uint64_t get_record_count() const { return record_end_ - first_record_; }
+
+  /// Number of DZ blocks decompressed in background. With 0 blocks are
+  /// decompressed by next(), use this if the cursor is used inside a task of
+  /// the default thread pool.
+  void set_prefetch(std::size_t blocks) { prefetch_count_ = blocks; }
+
+  /// Read ahead of uncompressed data: at most `blocks` pieces of up to
+  /// buffer_size bytes and at most `bytes` bytes in total are read on the
+  /// default thread pool. If the file is memory mapped or nothing is done in
+  /// background (see set_prefetch()), the system is only told what is read
+  /// next. With 0 there is no read ahead. Call before the first next().
+  void set_read_ahead(std::size_t blocks, std::size_t bytes) {
+    read_ahead_blocks_ = blocks;
+    read_ahead_bytes_ = bytes;
+  }
+
+private:
+  const data_group* dg_;
+  const rawfile* file_;
+  const std::vector<link>* blocks_;
+  std::size_t record_size_;
+  std::size_t buffer_records_;
+
+  uint64_t first_record_;
+  uint64_t record_;
+  uint64_t record_end_;
+
+  std::size_t block_;
+  const char* block_data_; // current block in memory, nullptr to read from file
+  uint64_t block_begin_; // position of the data of the current block
+  uint64_t block_pos_; // position of next record in current block
+  uint64_t block_end_; // position of end of current block
+  uint64_t skip_; // bytes before the first record
+
+  // data length of all blocks except the last one if it is a multiple of
+  // the record size, so no record can straddle two blocks
+  uint64_t aligned_length_;
+
+  std::string buffer_;
+  std::string carry_; // record straddling two blocks
+
+  struct prefetched_block {
+    bool compressed;
+    std::vector<char> data; // decompressed data of DZ block
+    uint64_t pos; // file position of data of DT block
+    uint64_t end;
+  };
+
+  std::vector<char> inflated_; // data of current DZ block
+  std::deque<std::future<prefetched_block> > pending_;
+  std::size_t prefetch_block_; // next block to prefetch
+  std::size_t prefetch_count_;
+
+  enum class read_ahead_mode { undecided, none, advise, background };
+
+  read_ahead_mode read_ahead_mode_;
+  std::size_t read_ahead_blocks_;
+  std::size_t read_ahead_bytes_;
+  const std::vector<uint64_t>* block_offsets_; // of the data group
+  uint64_t data_end_; // end of the records in the data of the data group
+  std::size_t ahead_block_; // block of next piece, first block not advised
+  uint64_t ahead_offset_; // offset of next piece in the data of ahead_block_
+  uint64_t advised_pos_; // file position to advise the next bytes at
+
+  struct piece {
+    std::unique_ptr<std::vector<char> > data;
+    std::future<void> ready;
+  };
+
+  std::deque<piece> pieces_;
+  std::unique_ptr<std::vector<char> > piece_data_; // data of current piece
+  std::unique_ptr<std::vector<char> > spare_data_; // for the next piece
+
+  // unsorted data group: offsets of the records, nullptr if sorted
+  const std::vector<uint64_t>* record_offsets_;
+  std::unique_ptr<record_cursor> stream_; // bytes of the data group
+  const char* stream_data_;
+  uint64_t stream_avail_;
+  uint64_t stream_pos_; // offset of stream_data_ in the data group
+
+  static prefetched_block read_block(const rawfile* file, link l);
+  void prefetch();
+
+  static void read_piece(const rawfile* file, link l, uint64_t offset,
+      std::vector<char>& data);
+  void start_read_ahead();
+  void read_ahead();
+  bool next_piece();
+  void advise();
+
+  void start(uint64_t first, uint64_t last);
+  void seek(uint64_t offset);
+  bool next_block();
+  bool enter_block();
+  bool is_mapped_dt_block(link l) const;
+  void set_block(uint64_t pos, uint64_t end);
+  bool read_straddling(record_batch& batch);
+  bool gather(record_batch& batch);
+  void read_stream(uint64_t offset, char* buffer, std::size_t n);
+};
+
+} // namespace mdf
+
+#endif // RECORDCURSOR_H_
@@ -0,0 +1,89 @@
+/*
+ * samplesummary.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAMPLESUMMARY_H_
+#define SAMPLESUMMARY_H_
+
+#include <cstdint>
+#include <limits>
+
+namespace mdf {
+
+/// Aggregate of the valid samples of a channel in a range of records.
+struct sample_summary {
+  sample_summary() :
+      first_record(0), records(0), count(0),
+      min(std::numeric_limits<double>::infinity()),
+      max(-std::numeric_limits<double>::infinity()),
+      first(std::numeric_limits<double>::quiet_NaN()),
+      last(std::numeric_limits<double>::quiet_NaN()), sum(0)
+  { }
+
+  /// first record of the range and count of records, 0 for an empty range
+  uint64_t first_record;
+  uint64_t records;
+
+  /// count of valid samples, the values below are only meaningful if not 0
+  uint64_t count;
+
+  double min;
+  double max;
+  double first;
+  double last;
+  double sum;
+
+  double mean() const { return sum / count; }
+
+  void add(double value) {
+    if (count == 0) {
+      first = value;
+    }
+    last = value;
+    min = value < min ? value : min;
+    max = value > max ? value : max;
+    sum += value;
+    count++;
+  }
+
+  /// add the summary of the records following the records of this one
+  void merge(const sample_summary& next) {
+    if (records == 0) {
+      first_record = next.first_record;
+    }
+    records += next.records;
+
+    if (next.count == 0) {
+      return;
+    }
+    if (count == 0) {
+      first = next.first;
+    }
+    last = next.last;
+    min = next.min < min ? next.min : min;
+    max = next.max > max ? next.max : max;
+    sum += next.sum;
+    count += next.count;
+  }
+};
+
+} // namespace mdf
+
+#endif // SAMPLESUMMARY_H_
@@ -24,26 +24,16 @@
 
 namespace mdf {
 
-source_information::source_information(const block* parent, uint64_t l)  :
-  block(parent, l), links_()
-{
-  file_->seek(l);
-
-  // CN Channel
-  block_header header = prase_block_header(file_.get(), make_id('S', 'I'));
-  file_->read_to_container(links_, header.link_count);
-}
-
-std::string source_information::get_name() const {
-  return prase_tx(file_.get(), links_[0]);
+boost::string_ref source_information::get_name_ref() const {
+  return get_tx(file_, links_[0]);
 }
 
-std::string source_information::get_path() const {
-  return prase_tx(file_.get(), links_[1]);
+boost::string_ref source_information::get_path_ref() const {
+  return get_tx(file_, links_[1]);
 }
 
-std::string source_information::get_metadata_comment() const {
-  return prase_tx(file_.get(), links_[2]);
+boost::string_ref source_information::get_metadata_comment_ref() const {
+  return get_tx(file_, links_[2]);
 }
 
 } // namespace mdf
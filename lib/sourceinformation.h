@@ -22,23 +22,31 @@
 #ifndef SOURCEINFORMATION_H_
 #define SOURCEINFORMATION_H_
 
-#include <vector>
-#include <memory>
+#include <boost/utility/string_ref.hpp>
 
-#include "block.h"
+#include "detail/mdf4.h"
 
 namespace mdf {
 
-class source_information : block {
+/// SI block, a handle to the links stored in the metadata table of the file
+class source_information {
 public:
-  source_information(const block* parent, uint64_t l);
+  source_information(const rawfile* file, const link* links) :
+    file_(file), links_(links)
+  { }
 
-  std::string get_name() const;
-  std::string get_path() const;
-  std::string get_metadata_comment() const;
+  std::string get_name() const { return get_name_ref().to_string(); }
+  std::string get_path() const { return get_path_ref().to_string(); }
+  std::string get_metadata_comment() const { return get_metadata_comment_ref().to_string(); }
+
+  // texts are cached per file, references stay valid while the file is open
+  boost::string_ref get_name_ref() const;
+  boost::string_ref get_path_ref() const;
+  boost::string_ref get_metadata_comment_ref() const;
 
 private:
-  std::vector<uint64_t> links_;
+  const rawfile* file_;
+  const link* links_;
 };
 
 } // namespace mdf
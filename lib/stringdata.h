@@ -0,0 +1,76 @@
+/*
+ * stringdata.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STRINGDATA_H_
+#define STRINGDATA_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <boost/utility/string_ref.hpp>
+
+namespace mdf {
+
+class rawfile;
+
+/// Samples of a string or byte array channel.
+///
+/// All samples are in one buffer: Sample i is get_lengths()[i] bytes at
+/// get_offsets()[i] of data(). Strings are in the encoding of the data type
+/// of the channel and end at the first zero character. The VLSD samples of a
+/// memory mapped file are not copied, data() points into the mapping then.
+class string_data {
+public:
+  string_data() : file_(), mapped_(nullptr), buffer_(), offsets_(), lengths_() { }
+
+  std::size_t size() const { return offsets_.size(); }
+  bool empty() const { return offsets_.empty(); }
+
+  boost::string_ref operator[](std::size_t i) const {
+    return boost::string_ref(data() + offsets_[i], lengths_[i]);
+  }
+
+  const char* data() const { return mapped_ ? mapped_ : buffer_.data(); }
+  const std::vector<uint64_t>& get_offsets() const { return offsets_; }
+  const std::vector<uint32_t>& get_lengths() const { return lengths_; }
+
+  void clear() {
+    file_.reset();
+    mapped_ = nullptr;
+    buffer_.clear();
+    offsets_.clear();
+    lengths_.clear();
+  }
+
+private:
+  std::shared_ptr<rawfile> file_; // keeps the mapping alive
+  const char* mapped_;
+  std::vector<char> buffer_;
+  std::vector<uint64_t> offsets_;
+  std::vector<uint32_t> lengths_;
+
+  friend class channel;
+};
+
+} // namespace mdf
+
+#endif // STRINGDATA_H_
@@ -0,0 +1,515 @@
+/*
+ * writer.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "writer.h"
+
+#include "detail/bits.h"
+#include "detail/threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <zlib.h>
+
+namespace mdf {
+
+namespace {
+
+// links in one DL block
+const std::size_t dl_links = 1024;
+
+/// bytes of one element of the column of a channel in append_columns()
+std::size_t element_size(const cnblock& cn) {
+  if (cn.bit_count <= 8) return 1;
+  if (cn.bit_count <= 16) return 2;
+  if (cn.bit_count <= 32) return 4;
+  return 8;
+}
+
+inline uint8_t byte_swap(uint8_t v) { return v; }
+inline uint16_t byte_swap(uint16_t v) { return __builtin_bswap16(v); }
+inline uint32_t byte_swap(uint32_t v) { return __builtin_bswap32(v); }
+inline uint64_t byte_swap(uint64_t v) { return __builtin_bswap64(v); }
+
+template<typename T>
+void scatter(const char* src, char* dest, std::size_t stride, std::size_t n, bool swap) {
+  T value;
+  if (swap) {
+    for (std::size_t i = 0; i < n; i++) {
+      std::memcpy(&value, src + i * sizeof(T), sizeof(T));
+      value = byte_swap(value);
+      std::memcpy(dest + i * stride, &value, sizeof(T));
+    }
+  } else {
+    for (std::size_t i = 0; i < n; i++) {
+      std::memcpy(&value, src + i * sizeof(T), sizeof(T));
+      std::memcpy(dest + i * stride, &value, sizeof(T));
+    }
+  }
+}
+
+/// or the little endian bit field into records, which are zero there
+void scatter_bits(const cnblock& cn, const char* src, char* dest, std::size_t stride,
+    std::size_t n) {
+  std::size_t size = element_size(cn);
+  uint64_t mask = bits::field_mask(cn.bit_count);
+  unsigned shift = cn.bit_offset;
+  unsigned bytes = bits::field_bytes(cn.bit_offset, cn.bit_count);
+  unsigned low_bytes = std::min(bytes, 8u);
+  for (std::size_t i = 0; i < n; i++) {
+    uint64_t value = 0;
+    std::memcpy(&value, src + i * size, size);
+    value &= mask;
+
+    unsigned char* out = reinterpret_cast<unsigned char*>(dest + i * stride);
+    uint64_t low = value << shift;
+    for (unsigned k = 0; k < low_bytes; k++) {
+      out[k] |= static_cast<unsigned char>(low >> (8 * k));
+    }
+    if (bytes > 8) {
+      out[8] |= static_cast<unsigned char>(value >> (64 - shift));
+    }
+  }
+}
+
+/// copy the column of a channel into count records at dest
+void interleave(const cnblock& cn, const char* src, char* dest, std::size_t stride,
+    std::size_t n) {
+  dest += cn.byte_offset;
+  if (cn.bit_offset != 0 || element_size(cn) * 8 != cn.bit_count) {
+    scatter_bits(cn, src, dest, stride, n);
+    return;
+  }
+
+  bool swap = (cn.data_type & 1) != 0; // big endian
+  switch (cn.bit_count) {
+  case 8: scatter<uint8_t>(src, dest, stride, n, swap); break;
+  case 16: scatter<uint16_t>(src, dest, stride, n, swap); break;
+  case 32: scatter<uint32_t>(src, dest, stride, n, swap); break;
+  default: scatter<uint64_t>(src, dest, stride, n, swap); break;
+  }
+}
+
+/// records of columns bytes stored column by column
+void transpose(const char* data, std::size_t size, std::size_t columns, char* out) {
+  std::size_t rows = size / columns;
+  for (std::size_t column = 0; column < columns; column++) {
+    const char* src = data + column;
+    char* dest = out + column * rows;
+    for (std::size_t row = 0; row < rows; row++) {
+      dest[row] = *src;
+      src += columns;
+    }
+  }
+  std::copy(data + rows * columns, data + size, out + rows * columns);
+}
+
+} // namespace
+
+group_writer::group_writer(file_writer* writer, const std::string& acquisition_name) :
+    writer_(writer), acquisition_name_(acquisition_name), channels_(),
+    bit_position_(0), has_bit_fields_(false), block_records_(0), buffer_(),
+    buffered_(0), record_count_(0), blocks_()
+{ }
+
+std::size_t group_writer::add_channel(const std::string& name, channel::data_type type,
+    unsigned bit_count, const std::string& unit) {
+  if (block_records_ != 0) {
+    throw error("channels must be added before the first record");
+  }
+
+  bool real = type == channel::data_type::real_le || type == channel::data_type::real_be;
+  bool big_endian = type == channel::data_type::unsigned_be ||
+      type == channel::data_type::signed_be || type == channel::data_type::real_be;
+  if (!real && type > channel::data_type::signed_be) {
+    throw error("only integer and real channels can be written");
+  }
+  if (real && bit_count != 32 && bit_count != 64) {
+    throw error("real channels have 32 or 64 bits");
+  }
+  if (bit_count == 0 || bit_count > 64) {
+    throw error("integer channels have 1 to 64 bits");
+  }
+
+  bool byte_aligned = bit_count == 8 || bit_count == 16 || bit_count == 32 || bit_count == 64;
+  if (byte_aligned) {
+    bit_position_ = (bit_position_ + 7) / 8 * 8;
+  } else if (big_endian) {
+    throw error("bit fields must be little endian");
+  } else {
+    has_bit_fields_ = true;
+  }
+
+  channel_info info = { name, unit, cnblock(), false, 0.0, 1.0 };
+  info.cn.data_type = static_cast<uint8_t>(type);
+  info.cn.byte_offset = bit_position_ / 8;
+  info.cn.bit_offset = bit_position_ % 8;
+  info.cn.bit_count = bit_count;
+  channels_.push_back(info);
+
+  bit_position_ += bit_count;
+  return channels_.size() - 1;
+}
+
+std::size_t group_writer::add_master_channel(const std::string& name, const std::string& unit) {
+  std::size_t index = add_channel(name, channel::data_type::real_le, 64, unit);
+  channels_[index].cn.type = 2;
+  channels_[index].cn.sync_type = 1;
+  return index;
+}
+
+void group_writer::set_linear_conversion(std::size_t channel, double offset, double factor) {
+  channel_info& info = channels_.at(channel);
+  info.linear = true;
+  info.offset = offset;
+  info.factor = factor;
+}
+
+void group_writer::fix_layout() {
+  if (!writer_->is_open()) {
+    throw error("file is closed");
+  }
+  if (block_records_ != 0) {
+    return;
+  }
+
+  std::size_t record_size = get_record_size();
+  if (record_size == 0) {
+    throw error("no channels in group");
+  }
+  block_records_ = std::max<std::size_t>(1, writer_->options_.block_size / record_size);
+}
+
+char* group_writer::reserve(std::size_t& count) {
+  std::size_t record_size = get_record_size();
+  if (buffer_.empty()) {
+    buffer_ = writer_->get_buffer(sizeof(block_header) + block_records_ * record_size + 7);
+  }
+  count = std::min(count, block_records_ - buffered_);
+  return buffer_.data() + sizeof(block_header) + buffered_ * record_size;
+}
+
+void group_writer::commit(std::size_t count) {
+  buffered_ += count;
+  record_count_ += count;
+  if (buffered_ == block_records_) {
+    writer_->submit(*this, std::move(buffer_), buffered_ * get_record_size());
+    buffer_ = std::vector<char>();
+    buffered_ = 0;
+  }
+}
+
+void group_writer::append_records(const void* records, std::size_t count) {
+  fix_layout();
+
+  std::size_t record_size = get_record_size();
+  const char* src = static_cast<const char*>(records);
+  while (count != 0) {
+    std::size_t n = count;
+    char* dest = reserve(n);
+    std::memcpy(dest, src, n * record_size);
+    src += n * record_size;
+    count -= n;
+    commit(n);
+  }
+}
+
+void group_writer::append_columns(const void* const* columns, std::size_t count) {
+  fix_layout();
+
+  std::size_t record_size = get_record_size();
+  for (std::size_t done = 0; done < count;) {
+    std::size_t n = count - done;
+    char* dest = reserve(n);
+    if (has_bit_fields_) {
+      std::memset(dest, 0, n * record_size);
+    }
+    for (std::size_t i = 0; i < channels_.size(); i++) {
+      const cnblock& cn = channels_[i].cn;
+      const char* src = static_cast<const char*>(columns[i]) + done * element_size(cn);
+      interleave(cn, src, dest, record_size, n);
+    }
+    done += n;
+    commit(n);
+  }
+}
+
+file_writer::file_writer(const std::string& filename, const write_options& options) :
+    file_(filename, "wb"), options_(options),
+    pool_(options.pool ? options.pool : &thread_pool::get_default()),
+    header_(), groups_(), pending_(), max_pending_(2 * pool_->size() + 1),
+    spare_buffers_(), end_(0), end_mutex_()
+{
+  idblock id = idblock();
+  std::memcpy(id.file_id, "MDF     ", 8);
+  std::memcpy(id.format_id, "4.10    ", 8);
+  std::memcpy(id.program_id, "libmdf4 ", 8);
+  id.version_number = 410;
+  char head[64] = { };
+  std::memcpy(head, &id, sizeof(id));
+  file_.write_at(allocate(sizeof(head)), head, sizeof(head));
+
+  hdblock hd = hdblock();
+  hd.start_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  header_ = write_block(make_id('H', 'D'), std::vector<link>(6, 0), &hd, sizeof(hd));
+}
+
+file_writer::~file_writer() {
+  try {
+    close();
+  } catch (...) {
+  }
+}
+
+group_writer& file_writer::add_group(const std::string& acquisition_name) {
+  if (!is_open()) {
+    throw error("file is closed");
+  }
+  groups_.emplace_back(new group_writer(this, acquisition_name));
+  return *groups_.back();
+}
+
+uint64_t file_writer::allocate(uint64_t n) {
+  std::lock_guard<std::mutex> lock(end_mutex_);
+  uint64_t position = end_;
+  end_ += (n + 7) / 8 * 8;
+  return position;
+}
+
+link file_writer::write_block(uint16_t id, const std::vector<link>& links,
+    const void* data, std::size_t n) {
+  block_header header = { make_id('#', '#'), id, 0,
+      sizeof(header) + links.size() * sizeof(link) + n, links.size() };
+
+  std::vector<char> block((header.length + 7) / 8 * 8);
+  std::memcpy(block.data(), &header, sizeof(header));
+  std::memcpy(block.data() + sizeof(header), links.data(), links.size() * sizeof(link));
+  std::memcpy(block.data() + sizeof(header) + links.size() * sizeof(link), data, n);
+
+  link position = allocate(block.size());
+  file_.write_at(position, block.data(), block.size());
+  return position;
+}
+
+link file_writer::write_text(const std::string& text) {
+  return write_block(make_id('T', 'X'), std::vector<link>(), text.c_str(), text.size() + 1);
+}
+
+std::vector<char> file_writer::get_buffer(std::size_t size) {
+  if (spare_buffers_.empty()) {
+    return std::vector<char>(size);
+  }
+  std::vector<char> buffer = std::move(spare_buffers_.back());
+  spare_buffers_.pop_back();
+  buffer.resize(size);
+  return buffer;
+}
+
+void file_writer::submit(group_writer& group, std::vector<char> buffer,
+    std::size_t data_length) {
+  while (pending_.size() >= max_pending_) {
+    finish_pending();
+  }
+
+  auto data = std::make_shared<std::vector<char> >(std::move(buffer));
+  std::size_t record_size = group.get_record_size();
+  pending_block pending = { &group, group.blocks_.size(),
+      pool_->submit([this, data, data_length, record_size]() {
+        return write_data_block(std::move(*data), data_length, record_size);
+      }) };
+  group.blocks_.push_back(0);
+  pending_.push_back(std::move(pending));
+}
+
+void file_writer::finish_pending() {
+  pending_block pending = std::move(pending_.front());
+  pending_.pop_front();
+
+  written_block written = pending.result.get();
+  pending.group->blocks_[pending.index] = written.position;
+  if (spare_buffers_.size() < max_pending_) {
+    spare_buffers_.push_back(std::move(written.buffer));
+  }
+}
+
+file_writer::written_block file_writer::write_data_block(std::vector<char> buffer,
+    std::size_t data_length, std::size_t record_size) {
+  // buffer has space for the block header in front of the records and 7
+  // bytes of padding behind them
+  if (!options_.compress) {
+    block_header header = { make_id('#', '#'), make_id('D', 'T'), 0,
+        sizeof(header) + data_length, 0 };
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    std::size_t size = (header.length + 7) / 8 * 8;
+    std::fill(buffer.begin() + header.length, buffer.begin() + size, 0);
+
+    written_block result = { allocate(size), std::move(buffer) };
+    file_.write_at(result.position, result.buffer.data(), size);
+    return result;
+  }
+
+  const char* data = buffer.data() + sizeof(block_header);
+  dzblock dz = { { 'D', 'T' }, 0, 0, 0, data_length, 0 };
+  std::vector<char> transposed;
+  if (options_.transpose && record_size > 1 && data_length / record_size > 1) {
+    transposed.resize(data_length);
+    transpose(data, data_length, record_size, transposed.data());
+    data = transposed.data();
+    dz.zip_type = 1;
+    dz.zip_parameter = record_size;
+  }
+
+  const std::size_t offset = sizeof(block_header) + sizeof(dz);
+  uLongf length = compressBound(data_length);
+  std::vector<char> block(offset + length + 7);
+  if (compress2(reinterpret_cast<Bytef*>(block.data() + offset), &length,
+      reinterpret_cast<const Bytef*>(data), data_length,
+      options_.compression_level) != Z_OK) {
+    throw error("compression of data block failed");
+  }
+  dz.data_length = length;
+
+  block_header header = { make_id('#', '#'), make_id('D', 'Z'), 0, offset + length, 0 };
+  std::memcpy(block.data(), &header, sizeof(header));
+  std::memcpy(block.data() + sizeof(header), &dz, sizeof(dz));
+  std::size_t size = (header.length + 7) / 8 * 8;
+  std::fill(block.begin() + header.length, block.begin() + size, 0);
+
+  written_block result = { allocate(size), std::move(buffer) };
+  file_.write_at(result.position, block.data(), size);
+  return result;
+}
+
+link file_writer::write_data_list(const group_writer& group) {
+  const std::vector<link>& blocks = group.blocks_;
+  if (blocks.size() <= 1) {
+    return blocks.empty() ? 0 : blocks[0];
+  }
+
+  // all blocks but the last one are full, chain of DL blocks is written from
+  // the last one
+  uint64_t length = group.block_records_ * group.get_record_size();
+  link next = 0;
+  for (std::size_t end = blocks.size(); end > 0;) {
+    std::size_t begin = (end - 1) / dl_links * dl_links;
+    std::vector<link> links(1, next);
+    links.insert(links.end(), blocks.begin() + begin, blocks.begin() + end);
+
+    char data[sizeof(dlblock) + sizeof(length)];
+    dlblock dl = { 1, { }, uint32_t(end - begin) };
+    std::memcpy(data, &dl, sizeof(dl));
+    std::memcpy(data + sizeof(dl), &length, sizeof(length));
+    next = write_block(make_id('D', 'L'), links, data, sizeof(data));
+    end = begin;
+  }
+
+  if (!options_.compress) {
+    return next;
+  }
+  hlblock hl = { 1, uint8_t(options_.transpose ? 1 : 0), { } };
+  return write_block(make_id('H', 'L'), std::vector<link>(1, next), &hl, sizeof(hl));
+}
+
+link file_writer::write_group(const group_writer& group, link next) {
+  // channels from the last one, so the next link is known
+  link channel = 0;
+  for (std::size_t i = group.channels_.size(); i-- > 0;) {
+    const group_writer::channel_info& info = group.channels_[i];
+
+    link conversion = 0;
+    if (info.linear) {
+      ccblock cc = ccblock();
+      cc.type = 1;
+      cc.val_count = 2;
+      char data[sizeof(cc) + 2 * sizeof(double)];
+      std::memcpy(data, &cc, sizeof(cc));
+      std::memcpy(data + sizeof(cc), &info.offset, sizeof(info.offset));
+      std::memcpy(data + sizeof(cc) + sizeof(double), &info.factor, sizeof(info.factor));
+      conversion = write_block(make_id('C', 'C'), std::vector<link>(4, 0), data, sizeof(data));
+    }
+
+    link name = write_text(info.name);
+    link unit = info.unit.empty() ? 0 : write_text(info.unit);
+    std::vector<link> links = { channel, 0, name, 0, conversion, 0, unit, 0 };
+    channel = write_block(make_id('C', 'N'), links, &info.cn, sizeof(info.cn));
+  }
+
+  cgblock cg = cgblock();
+  cg.cycle_count = group.record_count_;
+  cg.data_bytes = group.get_record_size();
+  link acquisition_name = group.acquisition_name_.empty() ? 0 :
+      write_text(group.acquisition_name_);
+  std::vector<link> cg_links = { 0, channel, acquisition_name, 0, 0, 0 };
+  link channel_group = write_block(make_id('C', 'G'), cg_links, &cg, sizeof(cg));
+
+  uint8_t dg[8] = { }; // record id size 0, sorted
+  std::vector<link> dg_links = { next, channel_group, write_data_list(group), 0 };
+  return write_block(make_id('D', 'G'), dg_links, dg, sizeof(dg));
+}
+
+void file_writer::close() {
+  if (!is_open()) {
+    return;
+  }
+
+  // all blocks written in the background are waited for, even after an error
+  std::exception_ptr failure;
+  try {
+    for (auto& group : groups_) {
+      if (group->buffered_ != 0) {
+        submit(*group, std::move(group->buffer_), group->buffered_ * group->get_record_size());
+        group->buffer_ = std::vector<char>();
+        group->buffered_ = 0;
+      }
+    }
+  } catch (...) {
+    failure = std::current_exception();
+  }
+  while (!pending_.empty()) {
+    try {
+      finish_pending();
+    } catch (...) {
+      if (!failure) {
+        failure = std::current_exception();
+      }
+    }
+  }
+  if (failure) {
+    file_.close();
+    std::rethrow_exception(failure);
+  }
+
+  try {
+    link next = 0;
+    for (std::size_t i = groups_.size(); i-- > 0;) {
+      next = write_group(*groups_[i], next);
+    }
+    file_.write_at(header_ + sizeof(block_header), &next, sizeof(next));
+  } catch (...) {
+    file_.close();
+    throw;
+  }
+  file_.close();
+}
+
+} // namespace mdf
@@ -0,0 +1,212 @@
+/*
+ * writer.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBMDF_WRITER_H_
+#define LIBMDF_WRITER_H_
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "channel.h"
+#include "detail/mdf4.h"
+#include "detail/macros.h"
+#include "detail/rawfile.h"
+
+namespace mdf {
+
+class file_writer;
+class thread_pool;
+
+/// options for writing a mdf file
+struct write_options {
+  write_options() :
+    block_size(4 << 20), compress(false), transpose(true),
+    compression_level(1), pool(nullptr)
+  { }
+
+  /// bytes of record data per data block, rounded down to whole records
+  std::size_t block_size;
+
+  /// write DZ blocks with deflate instead of DT blocks
+  bool compress;
+
+  /// transpose the bytes of the records before deflate (zip type 1), gives
+  /// much smaller blocks if the samples change slowly
+  bool transpose;
+
+  /// zlib level from 1 (fastest) to 9 (smallest)
+  int compression_level;
+
+  /// Full blocks are compressed and written by tasks of this pool, the
+  /// default pool of the library if null
+  thread_pool* pool;
+};
+
+/// Writes the records of a sorted data group with one channel group.
+///
+/// All channels are added before the first record, which fixes the record
+/// layout. Records are collected in a buffer of one data block, full blocks
+/// are written in the background. The metadata is written by
+/// file_writer::close().
+class group_writer {
+  NOT_COPYABLE(group_writer);
+
+public:
+  /// Add a channel behind the channels before and return its index.
+  /// Integers of 8, 16, 32 or 64 bits and reals of 32 or 64 bits start at a
+  /// byte, other integers are little endian bit fields packed without gap.
+  std::size_t add_channel(const std::string& name, channel::data_type type,
+      unsigned bit_count, const std::string& unit = std::string());
+
+  /// add a master channel of doubles with time as sync type
+  std::size_t add_master_channel(const std::string& name = "time",
+      const std::string& unit = "s");
+
+  /// physical value = offset + factor * raw value
+  void set_linear_conversion(std::size_t channel, double offset, double factor);
+
+  std::size_t get_channel_count() const { return channels_.size(); }
+
+  /// bytes of one record
+  std::size_t get_record_size() const { return (bit_position_ + 7) / 8; }
+
+  uint64_t get_record_count() const { return record_count_; }
+
+  /// append count records of get_record_size() bytes each
+  void append_records(const void* records, std::size_t count);
+
+  /// Append count records from one array per channel, in host byte order.
+  /// The elements have the native type of the channel: int8_t ... uint64_t
+  /// for integers, for bit fields the smallest of them with at least bit
+  /// count bits, float or double for reals.
+  void append_columns(const void* const* columns, std::size_t count);
+
+  void append_columns(const std::vector<const void*>& columns, std::size_t count) {
+    append_columns(columns.data(), count);
+  }
+
+private:
+  struct channel_info {
+    std::string name;
+    std::string unit;
+    cnblock cn;
+    bool linear;
+    double offset;
+    double factor;
+  };
+
+  file_writer* writer_;
+  std::string acquisition_name_;
+  std::vector<channel_info> channels_;
+  uint64_t bit_position_;
+  bool has_bit_fields_;
+
+  std::size_t block_records_; // 0 until the layout is fixed
+  std::vector<char> buffer_; // block header and records of the current block
+  std::size_t buffered_; // records in buffer_
+  uint64_t record_count_;
+  std::vector<link> blocks_; // data blocks, 0 while written in the background
+
+  group_writer(file_writer* writer, const std::string& acquisition_name);
+
+  void fix_layout();
+  char* reserve(std::size_t& count);
+  void commit(std::size_t count);
+
+  friend class file_writer;
+};
+
+/// Writes a mdf 4.1 file of sorted data groups.
+///
+/// The data blocks of all groups are appended as they get full. Data groups,
+/// channel groups and channels are written behind the data at close(), when
+/// the record counts are known. The writer and its groups must be used from
+/// one thread only.
+class file_writer {
+  NOT_COPYABLE(file_writer);
+
+public:
+  explicit file_writer(const std::string& filename,
+      const write_options& options = write_options());
+
+  /// close() the file if still open, errors are ignored then
+  ~file_writer();
+
+  /// Add a data group with one channel group. The reference is valid until
+  /// the writer is destroyed.
+  group_writer& add_group(const std::string& acquisition_name = std::string());
+
+  /// Write the last blocks of all groups and the metadata and close the
+  /// file. Errors of blocks written in the background are thrown here at the
+  /// latest.
+  void close();
+
+  bool is_open() const { return file_.is_open(); }
+
+private:
+  struct written_block {
+    link position;
+    std::vector<char> buffer; // for reuse
+  };
+
+  struct pending_block {
+    group_writer* group;
+    std::size_t index;
+    std::future<written_block> result;
+  };
+
+  rawfile file_;
+  write_options options_;
+  thread_pool* pool_;
+  link header_; // HD block
+  std::vector<std::unique_ptr<group_writer> > groups_;
+
+  std::deque<pending_block> pending_;
+  std::size_t max_pending_;
+  std::vector<std::vector<char> > spare_buffers_;
+
+  uint64_t end_; // end of the file
+  std::mutex end_mutex_; // guards end_
+
+  uint64_t allocate(uint64_t n);
+  link write_block(uint16_t id, const std::vector<link>& links, const void* data, std::size_t n);
+  link write_text(const std::string& text);
+
+  std::vector<char> get_buffer(std::size_t size);
+  void submit(group_writer& group, std::vector<char> buffer, std::size_t data_length);
+  written_block write_data_block(std::vector<char> buffer, std::size_t data_length,
+      std::size_t record_size);
+  void finish_pending();
+
+  link write_data_list(const group_writer& group);
+  link write_group(const group_writer& group, link next);
+
+  friend class group_writer;
+};
+
+} // namespace mdf
+
+#endif // LIBMDF_WRITER_H_
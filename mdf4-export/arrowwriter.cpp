@@ -0,0 +1,352 @@
+/*
+ * arrowwriter.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "arrowwriter.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/// Minimal flatbuffer builder. Like the reference implementation the
+/// buffer is built back to front, objects are referred to by their distance
+/// from the end of the buffer. The bytes are kept in reverse order.
+class flatbuffer_builder {
+public:
+  typedef uint32_t offset;
+
+  flatbuffer_builder() : bytes_(), fields_(), table_start_() { }
+
+  std::size_t size() const { return bytes_.size(); }
+
+  offset create_string(const std::string& str) {
+    pad((4 - (size() + str.size() + 1) % 4) % 4);
+    bytes_.push_back(0);
+    prepend_bytes(str.data(), str.size());
+    prepend_bytes(static_cast<uint32_t>(str.size()));
+    return size();
+  }
+
+  offset create_vector(const std::vector<offset>& elements) {
+    align(sizeof(uint32_t));
+    for (std::size_t i = elements.size(); i-- > 0;) {
+      prepend_offset(elements[i]);
+    }
+    prepend_bytes(static_cast<uint32_t>(elements.size()));
+    return size();
+  }
+
+  /// vector of structs with an alignment of 8 bytes
+  template<typename T>
+  offset create_struct_vector(const std::vector<T>& elements) {
+    pad((8 - (size() + elements.size() * sizeof(T)) % 8) % 8);
+    for (std::size_t i = elements.size(); i-- > 0;) {
+      prepend_bytes(&elements[i], sizeof(T));
+    }
+    prepend_bytes(static_cast<uint32_t>(elements.size()));
+    return size();
+  }
+
+  void start_table() {
+    fields_.clear();
+    table_start_ = size();
+  }
+
+  template<typename T>
+  void add_field(uint16_t id, T value) {
+    align(sizeof(T));
+    prepend_bytes(value);
+    fields_.push_back(field { id, offset(size()) });
+  }
+
+  void add_offset(uint16_t id, offset o) {
+    prepend_offset(o);
+    fields_.push_back(field { id, offset(size()) });
+  }
+
+  offset end_table() {
+    align(sizeof(int32_t));
+    prepend_bytes(int32_t(0));
+    offset table = size();
+
+    uint16_t count = 0;
+    for (const field& f : fields_) {
+      count = std::max<uint16_t>(count, f.id + 1);
+    }
+    std::vector<uint16_t> vtable(count, 0);
+    for (const field& f : fields_) {
+      vtable[f.id] = table - f.position;
+    }
+    for (std::size_t i = count; i-- > 0;) {
+      prepend_bytes(vtable[i]);
+    }
+    prepend_bytes(static_cast<uint16_t>(table - table_start_));
+    prepend_bytes(static_cast<uint16_t>(4 + 2 * count));
+
+    // the vtable is in front of the table
+    int32_t soffset = size() - table;
+    for (std::size_t i = 0; i < sizeof(soffset); i++) {
+      bytes_[table - 1 - i] = reinterpret_cast<const uint8_t*>(&soffset)[i];
+    }
+    return table;
+  }
+
+  /// buffer with the root table, size is a multiple of 8
+  std::vector<uint8_t> finish(offset root) {
+    pad((8 - (size() + sizeof(uint32_t)) % 8) % 8);
+    prepend_offset(root);
+    return std::vector<uint8_t>(bytes_.rbegin(), bytes_.rend());
+  }
+
+private:
+  struct field {
+    uint16_t id;
+    offset position;
+  };
+
+  std::vector<uint8_t> bytes_;
+  std::vector<field> fields_;
+  std::size_t table_start_;
+
+  void pad(std::size_t n) { bytes_.insert(bytes_.end(), n, 0); }
+  void align(std::size_t n) { pad((n - size() % n) % n); }
+
+  void prepend_bytes(const void* data, std::size_t n) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (std::size_t i = n; i-- > 0;) {
+      bytes_.push_back(p[i]);
+    }
+  }
+
+  template<typename T>
+  void prepend_bytes(T value) { prepend_bytes(&value, sizeof(value)); }
+
+  void prepend_offset(offset o) {
+    align(sizeof(uint32_t));
+    prepend_bytes(static_cast<uint32_t>(size() + sizeof(uint32_t) - o));
+  }
+};
+
+// Arrow format constants (Schema.fbs, Message.fbs, File.fbs)
+const int16_t metadata_v5 = 4;
+const uint8_t header_schema = 1;
+const uint8_t header_record_batch = 3;
+const uint8_t type_int = 2;
+const uint8_t type_floating_point = 3;
+const int16_t precision_single = 1;
+const int16_t precision_double = 2;
+
+struct field_node {
+  int64_t length;
+  int64_t null_count;
+};
+
+struct buffer {
+  int64_t offset;
+  int64_t length;
+};
+
+struct file_block {
+  int64_t offset;
+  int32_t metadata_length;
+  int32_t padding;
+  int64_t body_length;
+};
+
+const char magic[8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+
+std::size_t padded(std::size_t n) {
+  return (n + 7) & ~std::size_t(7);
+}
+
+flatbuffer_builder::offset add_type(flatbuffer_builder& fb, column_type type) {
+  fb.start_table();
+  if (type == column_type::float32 || type == column_type::float64) {
+    fb.add_field<int16_t>(0, type == column_type::float32 ? precision_single : precision_double);
+  } else {
+    fb.add_field<int32_t>(0, 8 * type_size(type));
+    bool is_signed = type == column_type::int8 || type == column_type::int16 ||
+        type == column_type::int32 || type == column_type::int64;
+    fb.add_field<uint8_t>(1, is_signed);
+  }
+  return fb.end_table();
+}
+
+flatbuffer_builder::offset add_schema(flatbuffer_builder& fb,
+    const std::vector<column_info>& columns) {
+  std::vector<flatbuffer_builder::offset> fields;
+  for (const column_info& column : columns) {
+    flatbuffer_builder::offset name = fb.create_string(column.name);
+    flatbuffer_builder::offset type = add_type(fb, column.type);
+    flatbuffer_builder::offset children = fb.create_vector({});
+
+    flatbuffer_builder::offset key = fb.create_string("unit");
+    flatbuffer_builder::offset value = fb.create_string(column.unit);
+    fb.start_table();
+    fb.add_offset(0, key);
+    fb.add_offset(1, value);
+    flatbuffer_builder::offset unit = fb.end_table();
+    flatbuffer_builder::offset metadata = fb.create_vector({ unit });
+
+    fb.start_table();
+    fb.add_offset(0, name);
+    fb.add_field<uint8_t>(1, true);
+    bool real = column.type == column_type::float32 || column.type == column_type::float64;
+    fb.add_field<uint8_t>(2, real ? type_floating_point : type_int);
+    fb.add_offset(3, type);
+    fb.add_offset(5, children);
+    fb.add_offset(6, metadata);
+    fields.push_back(fb.end_table());
+  }
+  flatbuffer_builder::offset field_vector = fb.create_vector(fields);
+
+  fb.start_table();
+  fb.add_field<int16_t>(0, 0); // little endian
+  fb.add_offset(1, field_vector);
+  return fb.end_table();
+}
+
+std::vector<uint8_t> message(flatbuffer_builder& fb, uint8_t header_type,
+    flatbuffer_builder::offset header, int64_t body_length) {
+  fb.start_table();
+  fb.add_field<int64_t>(3, body_length);
+  fb.add_offset(2, header);
+  fb.add_field<int16_t>(0, metadata_v5);
+  fb.add_field<uint8_t>(1, header_type);
+  return fb.finish(fb.end_table());
+}
+
+int64_t null_count(const uint8_t* validity, std::size_t rows) {
+  int64_t valid = 0;
+  for (std::size_t i = 0; i < rows / 8; i++) {
+    valid += __builtin_popcount(validity[i]);
+  }
+  if (rows % 8 != 0) {
+    valid += __builtin_popcount(validity[rows / 8] & ((1u << (rows % 8)) - 1));
+  }
+  return rows - valid;
+}
+
+} // namespace
+
+arrow_writer::arrow_writer(mdf::rawfile& output) :
+    output_(output), columns_(), position_(0), blocks_()
+{ }
+
+void arrow_writer::write_bytes(const void* data, std::size_t n) {
+  if (n != 0) {
+    output_.write(static_cast<const char*>(data), n);
+    position_ += n;
+  }
+}
+
+void arrow_writer::write_padding(std::size_t n) {
+  static const char zeros[8] = { };
+  write_bytes(zeros, n);
+}
+
+int32_t arrow_writer::write_message(const std::vector<uint8_t>& message) {
+  // encapsulated message: continuation marker, metadata length, flatbuffer
+  // (its size is a multiple of 8)
+  int32_t prefix[2] = { -1, int32_t(message.size()) };
+  write_bytes(prefix, sizeof(prefix));
+  write_bytes(message.data(), message.size());
+  return sizeof(prefix) + message.size();
+}
+
+void arrow_writer::begin(const std::vector<column_info>& columns) {
+  columns_ = columns;
+  write_bytes(magic, sizeof(magic));
+
+  flatbuffer_builder fb;
+  write_message(message(fb, header_schema, add_schema(fb, columns_), 0));
+}
+
+void arrow_writer::write(const table_chunk& chunk) {
+  std::vector<field_node> nodes;
+  std::vector<buffer> buffers;
+  int64_t body_length = 0;
+  for (std::size_t i = 0; i < columns_.size(); i++) {
+    const uint8_t* validity = chunk.validity[i];
+    field_node node = { int64_t(chunk.rows), validity ? null_count(validity, chunk.rows) : 0 };
+    nodes.push_back(node);
+
+    // without nulls the validity bitmap can be left out
+    std::size_t validity_length = node.null_count != 0 ? (chunk.rows + 7) / 8 : 0;
+    buffers.push_back(buffer { body_length, int64_t(validity_length) });
+    body_length += padded(validity_length);
+
+    std::size_t length = chunk.rows * type_size(columns_[i].type);
+    buffers.push_back(buffer { body_length, int64_t(length) });
+    body_length += padded(length);
+  }
+
+  flatbuffer_builder fb;
+  flatbuffer_builder::offset buffer_vector = fb.create_struct_vector(buffers);
+  flatbuffer_builder::offset node_vector = fb.create_struct_vector(nodes);
+  fb.start_table();
+  fb.add_field<int64_t>(0, chunk.rows);
+  fb.add_offset(1, node_vector);
+  fb.add_offset(2, buffer_vector);
+  flatbuffer_builder::offset batch = fb.end_table();
+
+  block b = { position_, 0, uint64_t(body_length) };
+  b.metadata_length = write_message(message(fb, header_record_batch, batch, body_length));
+  blocks_.push_back(b);
+
+  for (std::size_t i = 0; i < columns_.size(); i++) {
+    const buffer& validity = buffers[2 * i];
+    write_bytes(chunk.validity[i], validity.length);
+    write_padding(padded(validity.length) - validity.length);
+
+    const buffer& values = buffers[2 * i + 1];
+    write_bytes(chunk.values[i], values.length);
+    write_padding(padded(values.length) - values.length);
+  }
+}
+
+void arrow_writer::end() {
+  // end of stream marker
+  int32_t eos[2] = { -1, 0 };
+  write_bytes(eos, sizeof(eos));
+
+  std::vector<file_block> batches;
+  for (const block& b : blocks_) {
+    batches.push_back(file_block { int64_t(b.offset), b.metadata_length, 0,
+        int64_t(b.body_length) });
+  }
+
+  flatbuffer_builder fb;
+  flatbuffer_builder::offset schema = add_schema(fb, columns_);
+  flatbuffer_builder::offset batch_vector = fb.create_struct_vector(batches);
+  flatbuffer_builder::offset dictionaries = fb.create_struct_vector(std::vector<file_block>());
+  fb.start_table();
+  fb.add_offset(1, schema);
+  fb.add_offset(2, dictionaries);
+  fb.add_offset(3, batch_vector);
+  fb.add_field<int16_t>(0, metadata_v5);
+  std::vector<uint8_t> footer = fb.finish(fb.end_table());
+
+  write_bytes(footer.data(), footer.size());
+  int32_t footer_length = footer.size();
+  write_bytes(&footer_length, sizeof(footer_length));
+  write_bytes(magic, 6);
+}
@@ -0,0 +1,60 @@
+/*
+ * arrowwriter.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MDF4_EXPORT_ARROWWRITER_H_
+#define MDF4_EXPORT_ARROWWRITER_H_
+
+#include <vector>
+
+#include "detail/rawfile.h"
+#include "table.h"
+
+/// Writes columns in the Apache Arrow IPC file format (Feather V2).
+///
+/// Every chunk becomes a record batch, the body buffers are written
+/// directly from the decoded columns. The channel unit is stored in the
+/// field metadata with key "unit".
+class arrow_writer : public table_writer {
+public:
+  explicit arrow_writer(mdf::rawfile& output);
+
+  void begin(const std::vector<column_info>& columns) override;
+  void write(const table_chunk& chunk) override;
+  void end() override;
+
+private:
+  struct block {
+    uint64_t offset;
+    int32_t metadata_length;
+    uint64_t body_length;
+  };
+
+  mdf::rawfile& output_;
+  std::vector<column_info> columns_;
+  uint64_t position_;
+  std::vector<block> blocks_;
+
+  void write_bytes(const void* data, std::size_t n);
+  void write_padding(std::size_t n);
+  int32_t write_message(const std::vector<uint8_t>& message);
+};
+
+#endif // MDF4_EXPORT_ARROWWRITER_H_
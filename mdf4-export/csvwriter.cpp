@@ -0,0 +1,205 @@
+/*
+ * csvwriter.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "csvwriter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <stdexcept>
+
+#include "detail/threadpool.h"
+#include "dtoa.h"
+
+csv_writer::csv_writer(mdf::rawfile& output, const std::string& column_delimiter,
+    const std::string& row_delimiter, int precision) :
+    output_(output), column_delimiter_(column_delimiter),
+    row_delimiter_(row_delimiter), precision_(precision), pool_(nullptr),
+    names_(true), units_(true),
+    buffer_(2 * buffer_size), used_(0), writing_(), pending_()
+{ }
+
+csv_writer::~csv_writer() {
+  try {
+    flush();
+    wait();
+  } catch (...) {
+    // errors are reported by end()
+  }
+}
+
+void csv_writer::wait() {
+  if (pending_.valid()) {
+    pending_.get();
+  }
+}
+
+void csv_writer::write_buffer(std::vector<char>& data, std::size_t n) {
+  if (n == 0) {
+    return;
+  }
+
+  // the buffer written before is handed back to the caller for reuse
+  wait();
+  std::swap(data, writing_);
+  pending_ = std::async(std::launch::async, [this, n]() {
+    output_.write(writing_.data(), n);
+  });
+}
+
+void csv_writer::flush() {
+  write_buffer(buffer_, used_);
+  buffer_.resize(std::max(buffer_.size(), 2 * buffer_size));
+  used_ = 0;
+}
+
+void csv_writer::end() {
+  flush();
+  wait();
+}
+
+void csv_writer::write_row(const std::vector<std::string>& cells) {
+  for (std::size_t i = 0; i < cells.size(); i++) {
+    std::size_t n = cells[i].size() + column_delimiter_.size() + row_delimiter_.size();
+    if (buffer_.size() - used_ < n) {
+      flush();
+      buffer_.resize(std::max(buffer_.size(), n));
+    }
+
+    if (i != 0) {
+      used_ = std::copy(column_delimiter_.begin(), column_delimiter_.end(),
+          buffer_.begin() + used_) - buffer_.begin();
+    }
+    used_ = std::copy(cells[i].begin(), cells[i].end(), buffer_.begin() + used_) - buffer_.begin();
+  }
+  used_ = std::copy(row_delimiter_.begin(), row_delimiter_.end(),
+      buffer_.begin() + used_) - buffer_.begin();
+}
+
+void csv_writer::format_rows(const std::vector<const double*>& columns,
+    std::size_t first, std::size_t last, std::vector<char>& buffer,
+    std::size_t& used) const {
+  std::size_t cell_size = precision_ < 0 ? shortest_max_length : fixed_max_length(precision_);
+  std::size_t row_size = columns.size() * (cell_size + column_delimiter_.size()) +
+      row_delimiter_.size();
+
+  for (std::size_t row = first; row < last; row++) {
+    if (buffer.size() - used < row_size) {
+      buffer.resize(std::max(2 * buffer.size(), used + row_size));
+    }
+
+    char* ptr = buffer.data() + used;
+    for (std::size_t i = 0; i < columns.size(); i++) {
+      if (i != 0) {
+        memcpy(ptr, column_delimiter_.data(), column_delimiter_.size());
+        ptr += column_delimiter_.size();
+      }
+      double value = columns[i][row];
+      ptr = precision_ < 0 ? format_shortest(value, ptr) : format_fixed(value, precision_, ptr);
+    }
+    memcpy(ptr, row_delimiter_.data(), row_delimiter_.size());
+    ptr += row_delimiter_.size();
+
+    used = ptr - buffer.data();
+  }
+}
+
+void csv_writer::begin(const std::vector<column_info>& columns) {
+  std::vector<std::string> names;
+  std::vector<std::string> units;
+  for (const column_info& column : columns) {
+    if (column.type != column_type::float64) {
+      throw std::invalid_argument("csv_writer needs float64 columns");
+    }
+    names.push_back(column.name);
+    units.push_back(column.unit);
+  }
+
+  if (names_) {
+    write_row(names);
+  }
+  if (units_) {
+    write_row(units);
+  }
+}
+
+void csv_writer::write(const table_chunk& chunk) {
+  if (chunk.values.empty()) {
+    return;
+  }
+
+  std::vector<const double*> data;
+  for (const void* column : chunk.values) {
+    data.push_back(static_cast<const double*>(column));
+  }
+  std::size_t rows = chunk.rows;
+
+  // rows of about buffer_size bytes
+  std::size_t block_rows = std::max<std::size_t>(1, buffer_size / (data.size() * 12));
+
+  if (!pool_ || pool_->size() <= 1 || rows <= block_rows) {
+    for (std::size_t first = 0; first < rows; first += block_rows) {
+      format_rows(data, first, std::min(rows, first + block_rows), buffer_, used_);
+      if (used_ >= buffer_size) {
+        flush();
+      }
+    }
+    return;
+  }
+
+  flush();
+
+  // a window of blocks is formatted ahead, the oldest one is written next
+  struct formatted {
+    std::vector<char> data;
+    std::size_t size;
+  };
+  std::deque<std::future<formatted> > pending;
+  std::size_t next = 0;
+  auto submit = [&]() {
+    std::size_t first = next;
+    std::size_t last = std::min(rows, first + block_rows);
+    next = last;
+    pending.push_back(pool_->submit([this, &data, first, last]() {
+      formatted block = { std::vector<char>(buffer_size + buffer_size / 2), 0 };
+      format_rows(data, first, last, block.data, block.size);
+      return block;
+    }));
+  };
+
+  try {
+    while (next < rows || !pending.empty()) {
+      while (next < rows && pending.size() < 2 * pool_->size()) {
+        submit();
+      }
+      formatted block = pending.front().get();
+      pending.pop_front();
+      write_buffer(block.data, block.size);
+    }
+  } catch (...) {
+    // the tasks reference data
+    for (auto& block : pending) {
+      block.wait();
+    }
+    throw;
+  }
+}
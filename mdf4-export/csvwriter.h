@@ -0,0 +1,88 @@
+/*
+ * csvwriter.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MDF4_EXPORT_CSVWRITER_H_
+#define MDF4_EXPORT_CSVWRITER_H_
+
+#include <future>
+#include <string>
+#include <vector>
+
+#include "detail/rawfile.h"
+#include "table.h"
+
+namespace mdf {
+class thread_pool;
+}
+
+/// Writes rows of numbers as CSV, all columns must be of type float64.
+///
+/// Rows are rendered into a buffer, which is written to the output in
+/// chunks of buffer_size bytes by a writer thread while the next chunk is
+/// formatted. With a thread pool, blocks of rows are formatted concurrently
+/// and written in order.
+class csv_writer : public table_writer {
+public:
+  static const std::size_t buffer_size = 1 << 20;
+
+  /// precision < 0 for the shortest representation of each value,
+  /// otherwise the count of digits after the decimal point
+  csv_writer(mdf::rawfile& output, const std::string& column_delimiter,
+      const std::string& row_delimiter, int precision = -1);
+  ~csv_writer();
+
+  /// format blocks of rows on pool, nullptr to format on the calling thread
+  void set_pool(mdf::thread_pool* pool) { pool_ = pool; }
+
+  /// rows with the names and units of the columns written by begin()
+  void set_header_rows(bool names, bool units) { names_ = names; units_ = units; }
+
+  void begin(const std::vector<column_info>& columns) override;
+  void write(const table_chunk& chunk) override;
+  void end() override;
+
+  void write_row(const std::vector<std::string>& cells);
+
+  /// start writing the buffered rows
+  void flush();
+
+private:
+  mdf::rawfile& output_;
+  std::string column_delimiter_;
+  std::string row_delimiter_;
+  int precision_;
+  mdf::thread_pool* pool_;
+  bool names_;
+  bool units_;
+
+  std::vector<char> buffer_;
+  std::size_t used_;
+
+  std::vector<char> writing_; // buffer written by the writer thread
+  std::future<void> pending_;
+
+  void format_rows(const std::vector<const double*>& columns, std::size_t first,
+      std::size_t last, std::vector<char>& buffer, std::size_t& used) const;
+  void write_buffer(std::vector<char>& data, std::size_t n);
+  void wait();
+};
+
+#endif // MDF4_EXPORT_CSVWRITER_H_
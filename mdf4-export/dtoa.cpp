@@ -0,0 +1,386 @@
+/*
+ * dtoa.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dtoa.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// Grisu2 after Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+// Accurately with Integers", 2010.
+
+const int significand_size = 52;
+const uint64_t hidden_bit = uint64_t(1) << significand_size;
+const uint64_t significand_mask = hidden_bit - 1;
+const int exponent_bias = 0x3FF + significand_size;
+
+// floating point number f * 2^e with 64 bit significand
+struct diy_fp {
+  diy_fp() : f(), e() { }
+  diy_fp(uint64_t f, int e) : f(f), e(e) { }
+
+  explicit diy_fp(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    int biased_exponent = static_cast<int>((bits >> significand_size) & 0x7FF);
+    uint64_t significand = bits & significand_mask;
+    if (biased_exponent != 0) {
+      f = significand + hidden_bit;
+      e = biased_exponent - exponent_bias;
+    } else {
+      f = significand;
+      e = 1 - exponent_bias;
+    }
+  }
+
+  diy_fp operator-(const diy_fp& rhs) const {
+    return diy_fp(f - rhs.f, e);
+  }
+
+  diy_fp operator*(const diy_fp& rhs) const {
+    unsigned __int128 p = static_cast<unsigned __int128>(f) * rhs.f;
+    uint64_t h = static_cast<uint64_t>(p >> 64);
+    uint64_t l = static_cast<uint64_t>(p);
+    if (l & (uint64_t(1) << 63)) {
+      h++; // rounding
+    }
+    return diy_fp(h, e + rhs.e + 64);
+  }
+
+  diy_fp normalize() const {
+    int shift = __builtin_clzll(f);
+    return diy_fp(f << shift, e - shift);
+  }
+
+  // boundaries m- and m+ of the interval of numbers rounding to this, both
+  // with the exponent of the normalized m+
+  void normalized_boundaries(diy_fp& minus, diy_fp& plus) const {
+    plus = diy_fp((f << 1) + 1, e - 1).normalize();
+    minus = f == hidden_bit ? diy_fp((f << 2) - 1, e - 2) : diy_fp((f << 1) - 1, e - 1);
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+  }
+
+  uint64_t f;
+  int e;
+};
+
+// normalized 10^k for k = -348, -340, ..., 340
+const uint64_t cached_powers_f[] = {
+    0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76,
+    0xcf42894a5dce35ea, 0x9a6bb0aa55653b2d, 0xe61acf033d1a45df,
+    0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f, 0xbe5691ef416bd60c,
+    0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+    0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57,
+    0xc21094364dfb5637, 0x9096ea6f3848984f, 0xd77485cb25823ac7,
+    0xa086cfcd97bf97f4, 0xef340a98172aace5, 0xb23867fb2a35b28e,
+    0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+    0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126,
+    0xb5b5ada8aaff80b8, 0x87625f056c7c4a8b, 0xc9bcff6034c13053,
+    0x964e858c91ba2655, 0xdff9772470297ebd, 0xa6dfbd9fb8e5b88f,
+    0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+    0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06,
+    0xaa242499697392d3, 0xfd87b5f28300ca0e, 0xbce5086492111aeb,
+    0x8cbccc096f5088cc, 0xd1b71758e219652c, 0x9c40000000000000,
+    0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+    0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068,
+    0x9f4f2726179a2245, 0xed63a231d4c4fb27, 0xb0de65388cc8ada8,
+    0x83c7088e1aab65db, 0xc45d1df942711d9a, 0x924d692ca61be758,
+    0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+    0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d,
+    0x952ab45cfa97a0b3, 0xde469fbd99a05fe3, 0xa59bc234db398c25,
+    0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece, 0x88fcf317f22241e2,
+    0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+    0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410,
+    0x8bab8eefb6409c1a, 0xd01fef10a657842c, 0x9b10a4e5e9913129,
+    0xe7109bfba19c0c9d, 0xac2820d9623bf429, 0x80444b5e7aa7cf85,
+    0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+    0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b
+};
+
+const int16_t cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066
+};
+
+// c_k with binary exponent so that the product with a number of exponent e
+// is in [-60, -32], k is returned in decimal_exponent
+diy_fp cached_power(int e, int& decimal_exponent) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int k = static_cast<int>(dk);
+  if (dk - k > 0.0) {
+    k++;
+  }
+
+  unsigned index = static_cast<unsigned>((k >> 3) + 1);
+  decimal_exponent = -(-348 + static_cast<int>(index << 3));
+  return diy_fp(cached_powers_f[index], cached_powers_e[index]);
+}
+
+const uint64_t pow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+inline int count_decimal_digits(uint32_t n) {
+  int digits = 1;
+  while (digits < 10 && n >= pow10[digits]) {
+    digits++;
+  }
+  return digits;
+}
+
+inline void grisu_round(char* buffer, int length, uint64_t delta, uint64_t rest,
+    uint64_t ten_kappa, uint64_t wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+      (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    buffer[length - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+void digit_gen(const diy_fp& w, const diy_fp& mp, uint64_t delta,
+    char* buffer, int& length, int& k) {
+  const diy_fp one(uint64_t(1) << -mp.e, mp.e);
+  const diy_fp wp_w = mp - w;
+  uint32_t p1 = static_cast<uint32_t>(mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = count_decimal_digits(p1);
+  length = 0;
+
+  // integral part
+  while (kappa > 0) {
+    uint32_t divisor = static_cast<uint32_t>(pow10[kappa - 1]);
+    uint32_t d = p1 / divisor;
+    p1 %= divisor;
+    if (d || length) {
+      buffer[length++] = static_cast<char>('0' + d);
+    }
+    kappa--;
+
+    uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;
+    if (rest <= delta) {
+      k += kappa;
+      grisu_round(buffer, length, delta, rest, pow10[kappa] << -one.e, wp_w.f);
+      return;
+    }
+  }
+
+  // fractional part
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    char d = static_cast<char>(p2 >> -one.e);
+    if (d || length) {
+      buffer[length++] = static_cast<char>('0' + d);
+    }
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      k += kappa;
+      int index = -kappa;
+      grisu_round(buffer, length, delta, p2, one.f, wp_w.f * (index < 20 ? pow10[index] : 0));
+      return;
+    }
+  }
+}
+
+// digits of value > 0, value = digits * 10^k
+void grisu2(double value, char* buffer, int& length, int& k) {
+  const diy_fp v(value);
+  diy_fp w_m, w_p;
+  v.normalized_boundaries(w_m, w_p);
+
+  const diy_fp c_mk = cached_power(w_p.e, k);
+  const diy_fp w = v.normalize() * c_mk;
+  diy_fp wp = w_p * c_mk;
+  diy_fp wm = w_m * c_mk;
+  wm.f++;
+  wp.f--;
+  digit_gen(w, wp, wp.f - wm.f, buffer, length, k);
+}
+
+const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// decimal digits of n with at least min_digits digits
+char* format_integer(uint64_t n, int min_digits, char* buffer) {
+  char digits[24];
+  char* end = digits + sizeof(digits);
+  char* p = end;
+  while (n >= 100) {
+    p -= 2;
+    memcpy(p, digit_pairs + (n % 100) * 2, 2);
+    n /= 100;
+  }
+  if (n >= 10) {
+    p -= 2;
+    memcpy(p, digit_pairs + n * 2, 2);
+  } else {
+    *--p = static_cast<char>('0' + n);
+  }
+  while (end - p < min_digits) {
+    *--p = '0';
+  }
+
+  memcpy(buffer, p, end - p);
+  return buffer + (end - p);
+}
+
+char* format_exponent(int k, char* buffer) {
+  *buffer++ = 'e';
+  if (k < 0) {
+    *buffer++ = '-';
+    k = -k;
+  } else {
+    *buffer++ = '+';
+  }
+  return format_integer(k, 2, buffer);
+}
+
+// place decimal point into the digits, value = digits * 10^k
+char* prettify(char* buffer, int length, int k) {
+  const int kk = length + k; // 10^(kk-1) <= value < 10^kk
+
+  if (k >= 0 && kk <= 21) {
+    // integer: 1234e7 -> 12340000000
+    memset(buffer + length, '0', k);
+    return buffer + kk;
+  }
+
+  if (kk > 0 && kk <= 21) {
+    // 1234e-2 -> 12.34
+    memmove(buffer + kk + 1, buffer + kk, length - kk);
+    buffer[kk] = '.';
+    return buffer + length + 1;
+  }
+
+  if (kk > -6 && kk <= 0) {
+    // 1234e-6 -> 0.001234
+    int offset = 2 - kk;
+    memmove(buffer + offset, buffer, length);
+    buffer[0] = '0';
+    buffer[1] = '.';
+    memset(buffer + 2, '0', offset - 2);
+    return buffer + length + offset;
+  }
+
+  if (length == 1) {
+    // 1e30
+    return format_exponent(kk - 1, buffer + 1);
+  }
+
+  // 1234e30 -> 1.234e33
+  memmove(buffer + 2, buffer + 1, length - 1);
+  buffer[1] = '.';
+  return format_exponent(kk - 1, buffer + length + 1);
+}
+
+} // namespace
+
+char* format_shortest(double value, char* buffer) {
+  if (std::isnan(value)) {
+    memcpy(buffer, "nan", 3);
+    return buffer + 3;
+  }
+
+  if (std::signbit(value)) {
+    *buffer++ = '-';
+    value = -value;
+  }
+
+  if (std::isinf(value)) {
+    memcpy(buffer, "inf", 3);
+    return buffer + 3;
+  }
+
+  if (value == 0) {
+    *buffer = '0';
+    return buffer + 1;
+  }
+
+  int length, k;
+  grisu2(value, buffer, length, k);
+  return prettify(buffer, length, k);
+}
+
+char* format_fixed(double value, int precision, char* buffer) {
+  // value * 10^precision is rounded exactly to an integer if the product
+  // is below 2^52 and 10^precision is exact
+  double magnitude = std::fabs(value);
+  double scale = 1.0;
+  for (int i = 0; i < precision && i < 22; i++) {
+    scale *= 10.0;
+  }
+  double p = magnitude * scale;
+
+  if (precision >= 0 && precision <= 22 && std::isfinite(value) && p < 4503599627370496.0) {
+    double error = std::fma(magnitude, scale, -p); // magnitude * scale = p + error
+    double q = std::nearbyint(p); // ties to even
+    double d = p - q;
+    if (d == 0.5 || d == -0.5) {
+      // p is a tie, but the exact product may not be
+      if (error > 0) {
+        q = d > 0 ? q + 1 : q;
+      } else if (error < 0) {
+        q = d > 0 ? q : q - 1;
+      }
+    }
+
+    if (std::signbit(value)) {
+      *buffer++ = '-';
+    }
+    uint64_t n = static_cast<uint64_t>(q);
+    if (precision == 0) {
+      return format_integer(n, 1, buffer);
+    }
+
+    char* end = format_integer(n, precision + 1, buffer);
+    memmove(end - precision + 1, end - precision, precision);
+    end[-precision] = '.';
+    return end + 1;
+  }
+
+  return buffer + snprintf(buffer, fixed_max_length(precision), "%.*f", precision, value);
+}
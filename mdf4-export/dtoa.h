@@ -0,0 +1,44 @@
+/*
+ * dtoa.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MDF4_EXPORT_DTOA_H_
+#define MDF4_EXPORT_DTOA_H_
+
+#include <cstddef>
+
+/// Characters format_shortest() writes at most.
+static const std::size_t shortest_max_length = 32;
+
+/// Shortest decimal representation of value which reads back as value
+/// (Grisu2, which finds the shortest digits for almost all values). Written
+/// without exponent if the decimal point is near the digits, otherwise like
+/// 1.25e-07. Returns the end of the written characters.
+char* format_shortest(double value, char* buffer);
+
+/// Characters format_fixed() writes at most.
+inline std::size_t fixed_max_length(int precision) { return 320 + precision; }
+
+/// value with precision digits after the decimal point, exactly like
+/// printf("%.*f", precision, value). Returns the end of the written
+/// characters.
+char* format_fixed(double value, int precision, char* buffer);
+
+#endif // MDF4_EXPORT_DTOA_H_
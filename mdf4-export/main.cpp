@@ -20,13 +20,18 @@
  */
 
 #include <getopt.h>
+#include <unistd.h>
 #include <sys/signal.h>
+#include <sys/stat.h>
+#include <stdarg.h>
+#include <thread>
 
 #include <cstdio>
 #include <cerrno>
 #include <cstring>
 #include <cstdlib>
 #include <vector>
+#include <memory>
 #include <string>
 #include <exception>
 
@@ -36,6 +41,12 @@
 #include <boost/utility/string_ref.hpp>
 
 #include "libmdf4.h"
+#include "batch.h"
+#include "detail/threadpool.h"
+#include "arrowwriter.h"
+#include "csvwriter.h"
+#include "rawwriter.h"
+#include "table.h"
 #include "../config.h"
 
 // GETTEXT
@@ -60,8 +71,16 @@ static int data_group_index = -1;
 static int channel_group_index = -1;
 static std::string channel_ranges;
 static std::string output_file = "-";
-
-static const char short_options[] = "sSuUd:r:g:p:c:o:hV";
+static bool memory_map = false;
+static bool parallel = false;
+static int precision = -1;
+static std::string output_format = "csv";
+static std::size_t memory_limit = 256 << 20;
+static std::size_t read_ahead = 16 << 20;
+static std::size_t jobs = std::thread::hardware_concurrency();
+static bool batch_mode = false;
+
+static const char short_options[] = "sSuUd:r:g:p:c:o:mPn:F:M:R:j:hV";
 static const struct option long_options[] = {
     {"column-header", 0, 0, 's'},
     {"no-column-header", 0, 0, 'S'},
@@ -73,6 +92,13 @@ static const struct option long_options[] = {
     {"channel-group", required_argument, 0, 'p'},
     {"channels", required_argument, 0, 'c'},
     {"output", required_argument, 0, 'o'},
+    {"mmap", 0, 0, 'm'},
+    {"parallel", 0, 0, 'P'},
+    {"precision", required_argument, 0, 'n'},
+    {"format", required_argument, 0, 'F'},
+    {"memory-limit", required_argument, 0, 'M'},
+    {"read-ahead", required_argument, 0, 'R'},
+    {"jobs", required_argument, 0, 'j'},
     {"help", 0, 0, 'h'},
     {"version", 0, 0, 'V'},
     {0, 0, 0, 0}
@@ -80,8 +106,8 @@ static const struct option long_options[] = {
 
 static void usage() {
   puts(
-      _("Usage: mdf4-export [OPTION]... [FILE]\n"
-        "Export data channels from a mdf4 file to csv format."
+      _("Usage: mdf4-export [OPTION]... FILE...\n"
+        "Export data channels from mdf4 files to csv or a binary format."
         "\n"
         "Mandatory arguments to long options are mandatory for short options too.\n"
         "  -s, --column-header     print column header with channel name (default)\n"
@@ -94,12 +120,34 @@ static void usage() {
         "  -p, --channel-group=GROUP use only this channel group\n"
         "  -c, --channels=LIST     print only channels in LIST\n"
         "  -o, --output=FILE       writes output to FILE (default is stdout)\n"
+        "  -m, --mmap              map input file into memory instead of reading it\n"
+        "  -P, --parallel          decode data and format rows on all processor cores\n"
+        "  -n, --precision=N       print N digits after the decimal point instead of\n"
+        "                          the shortest representation of each value\n"
+        "  -F, --format=FORMAT     output format: csv (default), arrow for the\n"
+        "                          Apache Arrow IPC file format or raw for column\n"
+        "                          files FILE.N.bin described by FILE.json\n"
+        "  -M, --memory-limit=SIZE decode at most SIZE bytes of samples at once,\n"
+        "                          SIZE may have a suffix K, M or G (default 256M)\n"
+        "  -R, --read-ahead=SIZE   read up to SIZE bytes of uncompressed data ahead\n"
+        "                          while decoding, 0 turns it off (default 16M)\n"
+        "  -j, --jobs=N            export N files at the same time in batch mode\n"
+        "                          (default is the count of processor cores)\n"
         "  -h, --help              print this help\n"
         "      --version           print current version\n"
         "\n"
         "The channel LIST is made up of one range, or many ranges separated\n"
         "by commas. Selected input is written in the same order that it is\n"
         "read.\n"
+        "\n"
+        "With more than one FILE, a directory or a pattern like 'logs/*.mf4' the\n"
+        "files are exported in a batch, largest files first. Every file goes to\n"
+        "FILE.csv, FILE.arrow or the raw prefix FILE without extension, in the\n"
+        "directory given with `-o' or next to FILE. The memory limit is shared by\n"
+        "all files exported at the same time. An error in one file does not stop\n"
+        "the batch. Files which would be exported to the same output are refused\n"
+        "before the batch starts.\n"
+        "\n"
         "Each range is one of:\n"
         "\n"
         "  N     N'th channel, counted from 0\n"
@@ -206,11 +254,43 @@ static std::string unescape(boost::string_ref str)
   return result;
 }
 
+static std::size_t parse_size(boost::string_ref str)
+{
+  std::size_t factor = 1;
+  if (!str.empty()) {
+    switch (str.back()) {
+    case 'K': factor = std::size_t(1) << 10; break;
+    case 'M': factor = std::size_t(1) << 20; break;
+    case 'G': factor = std::size_t(1) << 30; break;
+    }
+    if (factor != 1) {
+      str.remove_suffix(1);
+    }
+  }
+  return boost::lexical_cast<std::size_t>(str.data(), str.size()) * factor;
+}
+
+/// error message, with the name of the file in batch mode
+static void report(const std::string& input, const char* format, ...)
+{
+  char message[1024];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+
+  if (batch_mode) {
+    fprintf(stderr, "%s: %s", input.c_str(), message);
+  } else {
+    fputs(message, stderr);
+  }
+}
+
 static void check_channel_bounds(int n, int channel_count)
 {
   if (n >= channel_count || n < 0) {
     fprintf(stderr, _("Channel %d does not exist.\n"), n);
-    exit(EXIT_FAILURE);
+    throw std::exception();
   }
 }
 
@@ -270,6 +350,146 @@ static std::vector<int> parse_ranges(boost::string_ref str_ranges, int channel_c
   return result;
 }
 
+/// export input to the file or raw prefix target, errors are printed
+static bool export_file(const std::string& input, const std::string& target,
+    std::size_t memory)
+{
+  int dg_index = data_group_index;
+  int cg_index = channel_group_index;
+
+  try {
+    mdf::file mdf_file;
+    try {
+      mdf::open_options options;
+      options.memory_map = memory_map;
+      mdf_file.open(input.c_str(), options);
+
+    } catch (const mdf::io_error& e) {
+      report(input, _("Error while opening input file %s: %s\n"),
+          input.c_str(), e.what());
+      return false;
+    }
+
+    // choose data group
+    const auto& data_groups = mdf_file.get_data_groups();
+    if (dg_index == -1) {
+      if (data_groups.size() > 1) {
+        report(input, _("More than one data group in file. Use `-g' option to choose data group.\n"));
+        return false;
+      } else {
+        dg_index = 0;
+      }
+    }
+    if (dg_index >= static_cast<int>(data_groups.size())) {
+      report(input, _("Data group %d is not existing in file.\n"), dg_index);
+      return false;
+    }
+    const auto& data_group = data_groups[dg_index];
+
+    // choose channel group
+    const auto& channel_groups = data_group.get_channel_groups();
+    if (cg_index == -1) {
+      if (channel_groups.size() > 1) {
+        report(input, _("More than one channel group in file. Use `-g' option to choose channel group.\n"));
+        return false;
+      } else {
+        cg_index = 0;
+      }
+    }
+    if (cg_index >= static_cast<int>(channel_groups.size())) {
+      report(input, _("Channel group %d does not exist in file.\n"), cg_index);
+      return false;
+    }
+    const auto& channel_group = channel_groups[cg_index];
+    const auto& channels = channel_group.get_channels();
+
+    // parse channel ranges
+    std::vector<int> channel_list;
+    if (!channel_ranges.empty()) {
+      try
+      {
+        channel_list = parse_ranges(channel_ranges, channels.size());
+      }
+      catch (const std::exception&)
+      {
+        fputs(_("Argument for channel list is invalid\n"), stderr);
+        fputs(_("Try `mdf4-export --help' for more information."), stderr);
+        return false;
+      }
+    }
+    else
+    {
+      for (std::size_t i = 0; i < channels.size(); i++)
+      {
+        channel_list.push_back(i);
+      }
+    }
+
+    if (channel_list.empty()) {
+      return true;
+    }
+
+    // binary formats keep the native type and validity of the samples
+    bool csv = output_format == "csv";
+    std::vector<const mdf::channel*> selected_channels;
+    std::vector<column_info> columns;
+    for (int channel_index : channel_list) {
+      const mdf::channel& ch = channels[channel_index];
+      column_info column = { ch.get_name(), ch.get_metadata_unit(),
+          csv ? column_type::float64 : native_type(ch),
+          !csv && !ch.get_validity_decoder().is_all_valid() };
+      columns.push_back(column);
+      selected_channels.push_back(&ch);
+    }
+
+    // open output file
+    mdf::rawfile output;
+    if (output_format != "raw") {
+      if (target == "-") {
+        output.warp(stdout);
+      } else {
+        try {
+          output.open(target, "w");
+
+        } catch (const mdf::io_error& e) {
+          report(input, _("Error while opening output file %s: %s\n"),
+              target.c_str(), e.what());
+          return false;
+        }
+      }
+    }
+
+    std::unique_ptr<table_writer> writer;
+    if (csv) {
+      csv_writer* csv_output = new csv_writer(output, column_delimiter, row_delimiter, precision);
+      writer.reset(csv_output);
+      csv_output->set_header_rows(print_column_header, print_unit_row);
+      if (parallel) {
+        csv_output->set_pool(&mdf::thread_pool::get_default());
+      }
+    } else if (output_format == "arrow") {
+      writer.reset(new arrow_writer(output));
+    } else {
+      writer.reset(new raw_writer(target));
+    }
+
+    mdf::decode_options decode_options;
+    decode_options.parallel = parallel;
+    decode_options.read_ahead_bytes = read_ahead;
+    write_table(channel_group, selected_channels, columns, decode_options,
+        chunk_rows(columns, memory), *writer);
+
+  } catch (const mdf::io_error& e) {
+    report(input, _("Error while reading or writing: %s\n"), e.what());
+    return false;
+  } catch (const mdf::error& e) {
+    report(input, _("Error in input file: %s\n"), e.what());
+    return false;
+  }
+
+  return true;
+}
+
 int main(int argc, char *argv[]) {
   int option_index = 1;
   int c;
@@ -339,162 +559,160 @@ int main(int argc, char *argv[]) {
       output_file.assign(optarg);
       break;
 
-    case 'h':
-      usage();
-      return EXIT_SUCCESS;
-
-    case 'V':
-      version();
-      return EXIT_SUCCESS;
-
-    default:
-      fputs(_("Try `mdf4-export --help' for more information."), stderr);
-      return EXIT_FAILURE;
-    }
-  }
-
-  if (argc - optind != 1) {
-    fprintf(stderr, _("No or more than one file is given.\n"));
-    fprintf(stderr, _("Try `mdf4-export --help' for help.\n"));
-    return EXIT_FAILURE;
-  }
-
-  try {
-    mdf::file mdf_file;
-    try {
-      mdf_file.open(argv[optind]);
-
-    } catch (const mdf::io_error& e) {
-      fprintf(stderr, _("Error while opening input file %s: %s\n"),
-          argv[optind], e.what());
-      return EXIT_FAILURE;
-    }
+    case 'm':
+      memory_map = true;
+      break;
 
-    std::vector<std::vector<double> > data;
-    std::vector<std::string> column_names;
-    std::vector<std::string> column_units;
+    case 'P':
+      parallel = true;
+      break;
 
-    // choose data group
-    const auto& data_groups = mdf_file.get_data_groups();
-    if (data_group_index == -1) {
-      if (data_groups.size() > 1) {
-        fprintf(stderr, _("More than one data group in file. Use `-g' option to choose data group.\n"));
+    case 'n':
+      try
+      {
+        precision = boost::lexical_cast<unsigned>(optarg);
+      }
+      catch (const boost::bad_lexical_cast&)
+      {
+        fputs(_("Argument for precision is invalid\n"), stderr);
+        fputs(_("Try `mdf4-export --help' for more information."), stderr);
         return EXIT_FAILURE;
-      } else {
-        data_group_index = 0;
       }
-    }
-    if (data_group_index >= static_cast<int>(data_groups.size())) {
-      fprintf(stderr, _("Data group %d is not existing in file.\n"), data_group_index);
-      return EXIT_FAILURE;
-    }
-    const auto& data_group = data_groups[data_group_index];
+      break;
 
-    // choose channel group
-    const auto& channel_groups = data_group.get_channel_groups();
-    if (channel_group_index == -1) {
-      if (channel_groups.size() > 1) {
-        fprintf(stderr, _("More than one channel group in file. Use `-g' option to choose channel group.\n"));
+    case 'F':
+      output_format.assign(optarg);
+      if (output_format != "csv" && output_format != "arrow" && output_format != "raw") {
+        fputs(_("Argument for format is invalid\n"), stderr);
+        fputs(_("Try `mdf4-export --help' for more information."), stderr);
         return EXIT_FAILURE;
-      } else {
-        channel_group_index = 0;
       }
-    }
-    if (channel_group_index > static_cast<int>(channel_groups.size())) {
-      fprintf(stderr, _("Channel group %d does not exist in file.\n"), channel_group_index);
-      return EXIT_FAILURE;
-    }
-    const auto& channel_group = channel_groups[channel_group_index];
-    const auto& channels = channel_group.get_channels();
+      break;
 
-    // parse channel ranges
-    std::vector<int> channel_list;
-    if (!channel_ranges.empty()) {
+    case 'M':
       try
       {
-        channel_list = parse_ranges(channel_ranges, channels.size());
+        memory_limit = parse_size(optarg);
       }
-      catch (const std::exception&)
+      catch (const boost::bad_lexical_cast&)
       {
-        fputs(_("Argument for channel list is invalid\n"), stderr);
+        fputs(_("Argument for memory limit is invalid\n"), stderr);
         fputs(_("Try `mdf4-export --help' for more information."), stderr);
         return EXIT_FAILURE;
       }
-    }
-    else
-    {
-      for (std::size_t i = 0; i < channels.size(); i++)
+      break;
+
+    case 'R':
+      try
       {
-        channel_list.push_back(i);
+        read_ahead = parse_size(optarg);
       }
-    }
-
-    if (channel_list.empty()) {
-      return EXIT_SUCCESS;
-    }
-
-    // open output file
-    mdf::rawfile output;
-    if (output_file == "-")
-    {
-      output.warp(stdout);
-    }
-    else
-    {
-      try {
-        output.open(output_file, "w");
+      catch (const boost::bad_lexical_cast&)
+      {
+        fputs(_("Argument for read ahead is invalid\n"), stderr);
+        fputs(_("Try `mdf4-export --help' for more information."), stderr);
+        return EXIT_FAILURE;
+      }
+      break;
 
-      } catch (const mdf::io_error& e) {
-        fprintf(stderr, _("Error while opening output file %s: %s\n"),
-            output_file.c_str(), e.what());
+    case 'j':
+      try
+      {
+        jobs = boost::lexical_cast<unsigned>(optarg);
+      }
+      catch (const boost::bad_lexical_cast&)
+      {
+        fputs(_("Argument for jobs is invalid\n"), stderr);
+        fputs(_("Try `mdf4-export --help' for more information."), stderr);
         return EXIT_FAILURE;
       }
-    }
+      break;
 
-    // build table
-    for (int channel_index : channel_list) {
-      const mdf::channel& ch = channels[channel_index];
-      column_names.emplace_back(ch.get_name());
-      column_units.emplace_back(ch.get_metadata_unit());
+    case 'h':
+      usage();
+      return EXIT_SUCCESS;
 
-      data.emplace_back();
-      ch.get_data_real(data.back());
-    }
+    case 'V':
+      version();
+      return EXIT_SUCCESS;
 
-    // print column header
-    if (print_column_header) {
-      output.write_text(column_names[0]);
-      for (std::size_t i = 1; i < column_names.size(); i++) {
-        output.write_text(column_delimiter);
-        output.write_text(column_names[i]);
-      }
-      output.write_text(row_delimiter);
+    default:
+      fputs(_("Try `mdf4-export --help' for more information."), stderr);
+      return EXIT_FAILURE;
     }
+  }
 
-    // print unit row
-    if (print_unit_row) {
-      output.write_text(column_units[0]);
-      for (std::size_t i = 1; i < column_units.size(); i++) {
-        output.write_text(column_delimiter);
-        output.write_text(column_units[i]);
-      }
-      output.write_text(row_delimiter);
-    }
+  std::vector<std::string> args(argv + optind, argv + argc);
+  if (args.empty()) {
+    fprintf(stderr, _("No file is given.\n"));
+    fprintf(stderr, _("Try `mdf4-export --help' for help.\n"));
+    return EXIT_FAILURE;
+  }
 
-    // print data
-    for (std::size_t i = 1; i < data[0].size(); i++) {
-      output.write_formated("%lf", data[0][i]);
-      for (std::size_t j = 1; j < data.size(); j++) {
-        output.write_text(column_delimiter);
-        output.write_formated("%lf", data[j][i]);
-      }
-      output.write_text(row_delimiter);
+  std::vector<mdf::batch_file> files = mdf::find_batch_files(args);
+  batch_mode = args.size() != 1 || files.size() != 1 || files[0].name != args[0];
+  if (!batch_mode) {
+    if (output_format == "raw" && output_file == "-") {
+      fputs(_("Format raw needs an output file prefix given with `-o'.\n"), stderr);
+      return EXIT_FAILURE;
     }
+    return export_file(args[0], output_file, memory_limit) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
 
-  } catch (const mdf::io_error& e) {
-    fprintf(stderr, _("Error while reading or writing: %s\n"), e.what());
+  // -o is the output directory in batch mode
+  std::string directory = output_file == "-" ? std::string() : output_file;
+  if (!directory.empty() && mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+    fprintf(stderr, _("Error while creating output directory %s: %s\n"),
+        directory.c_str(), strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  std::string suffix = output_format == "raw" ? "" : "." + output_format;
+  auto conflict = mdf::find_output_conflict(files, directory, suffix);
+  if (conflict.first) {
+    fprintf(stderr, _("%s and %s would be exported to the same file %s.\n"),
+        conflict.first->name.c_str(), conflict.second->name.c_str(),
+        mdf::batch_output_path(conflict.second->name, directory, suffix).c_str());
     return EXIT_FAILURE;
   }
 
+  jobs = std::max<std::size_t>(1, std::min(jobs, files.size()));
+  std::size_t failed = mdf::run_batch(files, jobs,
+      [&](const mdf::batch_file& file) {
+        std::string path = mdf::batch_output_path(file.name, directory, suffix);
+        if (output_format == "raw") {
+          return export_file(file.name, path, memory_limit / jobs);
+        }
+
+        // no partial output is left of a failed file, and no other export
+        // writes to the same temporary file
+        std::string part = path + "." + std::to_string(getpid()) + "-" +
+            std::to_string(&file - files.data()) + ".part";
+        bool ok = false;
+        try {
+          ok = export_file(file.name, part, memory_limit / jobs);
+        } catch (...) {
+          unlink(part.c_str());
+          throw;
+        }
+        if (!ok) {
+          unlink(part.c_str());
+          return false;
+        }
+        if (rename(part.c_str(), path.c_str()) != 0) {
+          report(file.name, _("Error while renaming %s: %s\n"), part.c_str(), strerror(errno));
+          unlink(part.c_str());
+          return false;
+        }
+        return true;
+      },
+      [](const mdf::batch_file& file, const char* what) {
+        report(file.name, _("Error while exporting: %s\n"), what);
+      });
+
+  if (failed != 0) {
+    fprintf(stderr, _("%zu of %zu files could not be exported.\n"), failed, files.size());
+    return EXIT_FAILURE;
+  }
   return EXIT_SUCCESS;
 }
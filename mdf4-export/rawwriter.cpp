@@ -0,0 +1,158 @@
+/*
+ * rawwriter.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rawwriter.h"
+
+#include <algorithm>
+
+#include <boost/lexical_cast.hpp>
+
+namespace {
+
+std::string json_string(const std::string& str) {
+  static const char hex[] = "0123456789abcdef";
+
+  std::string result = "\"";
+  for (char c : str) {
+    switch (c) {
+    case '"': result += "\\\""; break;
+    case '\\': result += "\\\\"; break;
+    case '\n': result += "\\n"; break;
+    case '\r': result += "\\r"; break;
+    case '\t': result += "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        result += "\\u00";
+        result.push_back(hex[c >> 4]);
+        result.push_back(hex[c & 0xf]);
+      } else {
+        result.push_back(c);
+      }
+    }
+  }
+  result.push_back('"');
+  return result;
+}
+
+std::string base_name(const std::string& path) {
+  std::size_t slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+} // namespace
+
+struct raw_writer::column_output {
+  std::string values_name;
+  std::string validity_name;
+  mdf::rawfile values;
+  mdf::rawfile validity;
+
+  // bits of the validity bitmap not yet written, chunks need not to start
+  // at a byte boundary
+  std::vector<uint8_t> bitmap;
+  unsigned pending;
+  unsigned pending_bits;
+
+  void append_bits(const uint8_t* bits, std::size_t rows) {
+    bitmap.clear();
+    if (pending_bits == 0) {
+      bitmap.assign(bits, bits + rows / 8);
+      if (rows % 8 != 0) {
+        pending = bits[rows / 8] & ((1u << (rows % 8)) - 1);
+        pending_bits = rows % 8;
+      }
+    } else {
+      for (std::size_t i = 0; i < rows; i += 8) {
+        unsigned n = std::min<std::size_t>(8, rows - i);
+        pending |= (bits[i / 8] & ((1u << n) - 1)) << pending_bits;
+        pending_bits += n;
+        if (pending_bits >= 8) {
+          bitmap.push_back(pending & 0xff);
+          pending >>= 8;
+          pending_bits -= 8;
+        }
+      }
+    }
+    validity.write(bitmap.data(), bitmap.size());
+  }
+};
+
+raw_writer::raw_writer(const std::string& prefix) :
+    prefix_(prefix), columns_(), outputs_(), rows_(0)
+{ }
+
+raw_writer::~raw_writer() { }
+
+void raw_writer::begin(const std::vector<column_info>& columns) {
+  columns_ = columns;
+  for (std::size_t i = 0; i < columns.size(); i++) {
+    std::unique_ptr<column_output> output(new column_output());
+    std::string name = prefix_ + "." + boost::lexical_cast<std::string>(i);
+    output->values_name = name + ".bin";
+    output->values.open(output->values_name, "w");
+    if (columns[i].nullable) {
+      output->validity_name = name + ".valid";
+      output->validity.open(output->validity_name, "w");
+    }
+    output->pending = 0;
+    output->pending_bits = 0;
+    outputs_.push_back(std::move(output));
+  }
+}
+
+void raw_writer::write(const table_chunk& chunk) {
+  for (std::size_t i = 0; i < columns_.size(); i++) {
+    column_output& output = *outputs_[i];
+    output.values.write(static_cast<const char*>(chunk.values[i]),
+        chunk.rows * type_size(columns_[i].type));
+    if (columns_[i].nullable) {
+      output.append_bits(chunk.validity[i], chunk.rows);
+    }
+  }
+  rows_ += chunk.rows;
+}
+
+void raw_writer::end() {
+  for (const auto& output : outputs_) {
+    if (output->pending_bits != 0) {
+      output->validity.write(static_cast<uint8_t>(output->pending));
+    }
+    output->values.close();
+    output->validity.close();
+  }
+
+  mdf::rawfile sidecar(prefix_ + ".json", "w");
+  sidecar.write_text("{\n  \"rows\": " + boost::lexical_cast<std::string>(rows_) +
+      ",\n  \"byte_order\": \"little\",\n  \"columns\": [");
+  for (std::size_t i = 0; i < columns_.size(); i++) {
+    const column_output& output = *outputs_[i];
+    std::string validity = columns_[i].nullable ?
+        json_string(base_name(output.validity_name)) : "null";
+    sidecar.write_text(std::string(i == 0 ? "\n" : ",\n") +
+        "    {\"name\": " + json_string(columns_[i].name) +
+        ", \"unit\": " + json_string(columns_[i].unit) +
+        ", \"type\": \"" + type_name(columns_[i].type) +
+        "\", \"data\": " + json_string(base_name(output.values_name)) +
+        ", \"validity\": " + validity + "}");
+  }
+  sidecar.write_text("\n  ]\n}\n");
+  sidecar.close();
+}
@@ -0,0 +1,55 @@
+/*
+ * rawwriter.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MDF4_EXPORT_RAWWRITER_H_
+#define MDF4_EXPORT_RAWWRITER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "detail/rawfile.h"
+#include "table.h"
+
+/// Writes every column into a file of raw little endian values.
+///
+/// Column i goes to PREFIX.i.bin, the validity bitmap of a nullable column
+/// to PREFIX.i.valid (bit k of byte k / 8 for row k, LSB first, set if
+/// valid). PREFIX.json describes the columns and the count of rows.
+class raw_writer : public table_writer {
+public:
+  explicit raw_writer(const std::string& prefix);
+  ~raw_writer();
+
+  void begin(const std::vector<column_info>& columns) override;
+  void write(const table_chunk& chunk) override;
+  void end() override;
+
+private:
+  struct column_output;
+
+  std::string prefix_;
+  std::vector<column_info> columns_;
+  std::vector<std::unique_ptr<column_output> > outputs_;
+  uint64_t rows_;
+};
+
+#endif // MDF4_EXPORT_RAWWRITER_H_
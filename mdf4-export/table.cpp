@@ -0,0 +1,198 @@
+/*
+ * table.cpp
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "table.h"
+
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+
+std::size_t type_size(column_type type) {
+  switch (type) {
+  case column_type::int8: case column_type::uint8: return 1;
+  case column_type::int16: case column_type::uint16: return 2;
+  case column_type::int32: case column_type::uint32: case column_type::float32: return 4;
+  default: return 8;
+  }
+}
+
+const char* type_name(column_type type) {
+  switch (type) {
+  case column_type::int8: return "int8";
+  case column_type::uint8: return "uint8";
+  case column_type::int16: return "int16";
+  case column_type::uint16: return "uint16";
+  case column_type::int32: return "int32";
+  case column_type::uint32: return "uint32";
+  case column_type::int64: return "int64";
+  case column_type::uint64: return "uint64";
+  case column_type::float32: return "float32";
+  default: return "float64";
+  }
+}
+
+column_type native_type(const mdf::channel& ch) {
+  if (ch.has_conversion()) {
+    return column_type::float64;
+  }
+  if (ch.get_type() == 3) {
+    // record index
+    return column_type::uint64;
+  }
+
+  unsigned bits = ch.get_bit_count();
+  switch (ch.get_data_type()) {
+  case mdf::channel::data_type::unsigned_le:
+  case mdf::channel::data_type::unsigned_be:
+    return bits <= 8 ? column_type::uint8 : bits <= 16 ? column_type::uint16 :
+        bits <= 32 ? column_type::uint32 : column_type::uint64;
+
+  case mdf::channel::data_type::signed_le:
+  case mdf::channel::data_type::signed_be:
+    return bits <= 8 ? column_type::int8 : bits <= 16 ? column_type::int16 :
+        bits <= 32 ? column_type::int32 : column_type::int64;
+
+  case mdf::channel::data_type::real_le:
+  case mdf::channel::data_type::real_be:
+    return bits <= 32 ? column_type::float32 : column_type::float64;
+
+  default:
+    return column_type::float64;
+  }
+}
+
+table_decoder::table_decoder(const mdf::channel_group& cg,
+    const std::vector<const mdf::channel*>& channels,
+    const std::vector<column_info>& columns, const mdf::decode_options& options) :
+    cg_(cg), channels_(channels), columns_(columns), options_(options),
+    values_(columns.size()), validity_(columns.size()), capacity_(0), set_(), chunk_()
+{
+  if (channels.size() != columns.size()) {
+    throw std::invalid_argument("count of channels and columns differs");
+  }
+}
+
+template<typename T>
+void table_decoder::add_column(std::size_t i) {
+  set_.add(channels_[i]->get_decoder<T>(), reinterpret_cast<T*>(values_[i].data()));
+}
+
+void table_decoder::reserve(std::size_t rows) {
+  if (rows <= capacity_ && capacity_ != 0) {
+    return;
+  }
+
+  capacity_ = rows;
+  set_ = mdf::column_set();
+  for (std::size_t i = 0; i < columns_.size(); i++) {
+    values_[i].resize(rows * type_size(columns_[i].type));
+    switch (columns_[i].type) {
+    case column_type::int8: add_column<int8_t>(i); break;
+    case column_type::uint8: add_column<uint8_t>(i); break;
+    case column_type::int16: add_column<int16_t>(i); break;
+    case column_type::uint16: add_column<uint16_t>(i); break;
+    case column_type::int32: add_column<int32_t>(i); break;
+    case column_type::uint32: add_column<uint32_t>(i); break;
+    case column_type::int64: add_column<int64_t>(i); break;
+    case column_type::uint64: add_column<uint64_t>(i); break;
+    case column_type::float32: add_column<float>(i); break;
+    default: add_column<double>(i); break;
+    }
+
+    if (columns_[i].nullable) {
+      validity_[i].resize((rows + 7) / 8);
+      set_.add(channels_[i]->get_validity_decoder(), validity_[i].data());
+    }
+  }
+}
+
+const table_chunk& table_decoder::decode(uint64_t first, uint64_t last) {
+  last = std::min(last, cg_.get_cycle_count());
+  first = std::min(first, last);
+
+  // the buffers and decoders of the first chunk serve all chunks not longer
+  reserve(last - first);
+  uint64_t rows = columns_.empty() ? last - first : cg_.decode(set_, first, last, options_);
+
+  chunk_.first = first;
+  chunk_.rows = rows;
+  chunk_.values.clear();
+  chunk_.validity.clear();
+  for (std::size_t i = 0; i < columns_.size(); i++) {
+    chunk_.values.push_back(values_[i].data());
+    chunk_.validity.push_back(columns_[i].nullable ? validity_[i].data() : nullptr);
+  }
+  return chunk_;
+}
+
+std::size_t chunk_rows(const std::vector<column_info>& columns, std::size_t memory_limit) {
+  // bytes of 8 rows
+  std::size_t block_bytes = 0;
+  for (const column_info& column : columns) {
+    block_bytes += 8 * type_size(column.type) + (column.nullable ? 1 : 0);
+  }
+  return 8 * std::max<std::size_t>(1, memory_limit / (2 * std::max<std::size_t>(1, block_bytes)));
+}
+
+void write_table(const mdf::channel_group& cg,
+    const std::vector<const mdf::channel*>& channels,
+    const std::vector<column_info>& columns, const mdf::decode_options& options,
+    std::size_t rows, table_writer& writer) {
+  uint64_t count = cg.get_cycle_count();
+  rows = std::max<std::size_t>(1, std::min<uint64_t>(rows, count));
+
+  table_decoder decoders[2] = {
+      table_decoder(cg, channels, columns, options),
+      table_decoder(cg, channels, columns, options) };
+  auto decode = [&decoders, rows](int k, uint64_t first) {
+    return std::async(std::launch::async, [&decoders, rows, k, first]() {
+      return &decoders[k].decode(first, first + rows);
+    });
+  };
+
+  writer.begin(columns);
+
+  std::future<const table_chunk*> next;
+  if (count != 0) {
+    next = decode(0, 0);
+  }
+  for (int k = 0; next.valid(); k = 1 - k) {
+    const table_chunk* chunk = next.get();
+
+    // a short chunk is the last one
+    uint64_t following = chunk->first + rows;
+    if (chunk->rows == rows && following < count) {
+      next = decode(1 - k, following);
+    }
+
+    try {
+      writer.write(*chunk);
+    } catch (...) {
+      // the decoder in use must outlive the task
+      if (next.valid()) {
+        next.wait();
+      }
+      throw;
+    }
+  }
+
+  writer.end();
+}
@@ -0,0 +1,116 @@
+/*
+ * table.h
+ *
+ *  This file is part of libmdf4.
+ *
+ *  Copyright (C) 2014 Richard Liebscher <r1tschy@yahoo.de>
+ *
+ *  libmdf4 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libmdf4 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MDF4_EXPORT_TABLE_H_
+#define MDF4_EXPORT_TABLE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "libmdf4.h"
+
+/// type of the values of an exported column
+enum class column_type {
+  int8, uint8, int16, uint16, int32, uint32, int64, uint64, float32, float64
+};
+
+std::size_t type_size(column_type type);
+const char* type_name(column_type type);
+
+/// Smallest type which holds the samples of ch without loss: the integer or
+/// float type of the raw values, double if they are converted.
+column_type native_type(const mdf::channel& ch);
+
+struct column_info {
+  std::string name;
+  std::string unit;
+  column_type type;
+  bool nullable; // validity bitmaps are given
+};
+
+/// Decoded rows [first, first + rows) of all columns. values[i] points to
+/// rows values of the type of column i, validity[i] to its validity bitmap
+/// (see mdf::validity_decoder) or is nullptr if all values are valid.
+struct table_chunk {
+  uint64_t first;
+  std::size_t rows;
+  std::vector<const void*> values;
+  std::vector<const uint8_t*> validity;
+};
+
+/// output format of mdf4-export
+class table_writer {
+public:
+  virtual ~table_writer() { }
+
+  virtual void begin(const std::vector<column_info>& columns) = 0;
+
+  /// write the next rows
+  virtual void write(const table_chunk& chunk) = 0;
+
+  virtual void end() = 0;
+};
+
+/// Decodes the samples of channels of a channel group into typed buffers,
+/// all columns in one pass over the records.
+class table_decoder {
+public:
+  table_decoder(const mdf::channel_group& cg,
+      const std::vector<const mdf::channel*>& channels,
+      const std::vector<column_info>& columns,
+      const mdf::decode_options& options = mdf::decode_options());
+
+  /// decode the records [first, last), valid until the next call
+  const table_chunk& decode(uint64_t first, uint64_t last);
+
+private:
+  const mdf::channel_group& cg_;
+  std::vector<const mdf::channel*> channels_;
+  std::vector<column_info> columns_;
+  mdf::decode_options options_;
+
+  std::vector<std::vector<char> > values_;
+  std::vector<std::vector<uint8_t> > validity_;
+  std::size_t capacity_; // rows of the buffers
+  mdf::column_set set_; // decoders of the columns into the buffers
+  table_chunk chunk_;
+
+  /// grow the buffers to rows and add the decoders for them to set_
+  void reserve(std::size_t rows);
+
+  template<typename T>
+  void add_column(std::size_t i);
+};
+
+/// count of rows of columns, multiple of 8, such that two chunks of decoded
+/// values and validity bitmaps take at most memory_limit bytes
+std::size_t chunk_rows(const std::vector<column_info>& columns, std::size_t memory_limit);
+
+/// Decode the records of cg in chunks of rows records and write them with
+/// writer. The next chunk is decoded on another thread while the current
+/// one is written, so at most two chunks are in memory.
+void write_table(const mdf::channel_group& cg,
+    const std::vector<const mdf::channel*>& channels,
+    const std::vector<column_info>& columns, const mdf::decode_options& options,
+    std::size_t rows, table_writer& writer);
+
+#endif // MDF4_EXPORT_TABLE_H_
@@ -25,8 +25,17 @@
 #include <string.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "libmdf4.h"
+#include "batch.h"
 #include "../config.h"
 
 static int quiet_mode = 0;
@@ -37,6 +46,9 @@ static bool show_file_mdf_version = false;
 static bool show_generator = false;
 static bool show_comment = false;
 static bool show_data_structure = false;
+static bool show_stats = false;
+static std::string output_directory;
+static std::size_t jobs = std::thread::hardware_concurrency();
 
 /* GETTEXT */
 #if ENABLE_NLS
@@ -53,9 +65,18 @@ static bool show_data_structure = false;
 
 static void usage() {
   printf(
-      _("Usage: %s FILE\n"
+      _("Usage: %s FILE...\n"
+          "-o, --output=DIR        write the information of every file to DIR/FILE.txt\n"
+          "                        instead of stdout\n"
+          "-j, --jobs=N            read N files at the same time (default is the count\n"
+          "                        of processor cores)\n"
+          "-s, --stats             print counters of reads and parsed blocks and\n"
+          "                        the time of opening and reading the metadata\n"
           "-h, --help              print this help\n"
-          "    --version           print current version\n")
+          "    --version           print current version\n"
+          "\n"
+          "FILE can be a directory or a pattern like 'logs/*.mf4' too, the files\n"
+          "are read largest first.\n")
           , command);
 }
 
@@ -63,13 +84,96 @@ static void version(void) {
   printf("mdf4-info/" PACKAGE_VERSION " %s\n", mdf::version());
 }
 
+/// printf to the end of out
+static void appendf(std::string& out, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  if (n <= 0) {
+    return;
+  }
+
+  std::size_t begin = out.size();
+  out.resize(begin + n + 1);
+  va_start(args, format);
+  vsnprintf(&out[begin], n + 1, format, args);
+  va_end(args);
+  out.resize(begin + n);
+}
+
+/// the information about one file
+static void describe_file(const std::string& input, std::string& out) {
+  mdf::open_options options;
+  options.timing = show_stats;
+  mdf::file mdf_file(input, options);
+
+  if (show_file_mdf_version)
+    appendf(out, "Version: %s\n", mdf_file.get_mdf_version_string().c_str());
+
+  if (show_generator)
+    appendf(out, "Generator: %s\n", mdf_file.get_generator_name().c_str());
+
+  if (show_comment)
+    appendf(out, "Comment: \n%s\n", mdf_file.get_comment().c_str());
+
+  if (show_data_structure) {
+    int i = 0;
+    for (const auto& dg : mdf_file.get_data_groups()) {
+      appendf(out, "Data Group %d\n", ++i);
+      appendf(out, "\tMetadata Comment: \n%s\n", dg.get_metadata_comment().c_str());
+
+      int j = 0;
+      for (const auto& cg : dg.get_channel_groups()) {
+        appendf(out, "\tChannel Group %d\n", ++j);
+
+        int k = 0;
+        for (const auto& ch : cg.get_channels()) {
+          appendf(out, "\tChannel %d: %s\n", ++k, ch.get_name().c_str());
+          if (ch.get_source_information()) {
+            appendf(out, "\t\tSource Name: %s\n", ch.get_source_information()->get_name().c_str());
+            appendf(out, "\t\tSource Path: %s\n", ch.get_source_information()->get_path().c_str());
+            appendf(out, "\t\tSource Metadata Comment: \n%s\n", ch.get_source_information()->get_metadata_comment().c_str());
+          }
+          appendf(out, "\t\tMetadata Unit: %s\n", ch.get_metadata_unit().c_str());
+          appendf(out, "\t\tMetadata Comment: \n%s\n", ch.get_metadata_comment().c_str());
+        }
+      }
+    }
+  }
+
+  if (show_stats) {
+    mdf::file_stats stats = mdf_file.get_stats();
+    appendf(out, "Statistics:\n");
+    appendf(out, "\tOpen: %.6f s\n", stats.open_seconds);
+    appendf(out, "\tMetadata: %.6f s\n", stats.metadata_seconds);
+    appendf(out, "\tDecode: %.6f s\n", stats.decode_seconds);
+    appendf(out, "\tRead Calls: %llu\n", (unsigned long long) stats.read_calls);
+    appendf(out, "\tBytes Read: %llu\n", (unsigned long long) stats.bytes_read);
+    appendf(out, "\tSeeks: %llu\n", (unsigned long long) stats.seeks);
+    appendf(out, "\tCached Reads: %llu (%llu loads)\n", (unsigned long long) stats.cached_reads,
+        (unsigned long long) stats.cache_loads);
+    appendf(out, "\tText Cache: %llu hits, %llu misses\n", (unsigned long long) stats.text_hits,
+        (unsigned long long) stats.text_misses);
+    appendf(out, "\tBlocks:");
+    for (const auto& block : stats.blocks) {
+      appendf(out, " %s %llu", block.first.c_str(), (unsigned long long) block.second);
+    }
+    appendf(out, "\n");
+  }
+
+}
+
 int main(int argc, char *argv[]) {
   int option_index = 1;
-  static const char short_options[] = "chV";
+  static const char short_options[] = "chso:j:V";
   static const struct option long_options[] = {
       {"help", 0, 0, 'h'},
       {"version", 0, 0, 'V'},
       {"comment", 0, 0, 'c'},
+      {"stats", 0, 0, 's'},
+      {"output", required_argument, 0, 'o'},
+      {"jobs", required_argument, 0, 'j'},
       {0, 0, 0, 0}
   };
   int c;
@@ -95,13 +199,25 @@ int main(int argc, char *argv[]) {
       show_comment = true;
       break;
 
+    case 's':
+      show_stats = true;
+      break;
+
+    case 'o':
+      output_directory = optarg;
+      break;
+
+    case 'j':
+      jobs = strtoul(optarg, NULL, 10);
+      break;
+
     default:
       fprintf(stderr, _("Try `%s --help' for more information.\n"), command);
       return 1;
     }
   }
 
-  if (argc - optind != 1) {
+  if (argc - optind < 1) {
     usage();
     return 0;
   }
@@ -113,41 +229,64 @@ int main(int argc, char *argv[]) {
     show_data_structure = true;
   }
 
-  mdf::file mdf_file(argv[optind]);
-
-  if (show_file_mdf_version)
-    printf("Version: %s\n", mdf_file.get_mdf_version_string().c_str());
-
-  if (show_generator)
-    printf("Generator: %s\n", mdf_file.get_generator_name().c_str());
-
-  if (show_comment)
-    printf("Comment: \n%s\n", mdf_file.get_comment().c_str());
+  std::vector<std::string> args(argv + optind, argv + argc);
+  std::vector<mdf::batch_file> files = mdf::find_batch_files(args);
+  bool batch = args.size() != 1 || files.size() != 1 || files[0].name != args[0];
+  if (!output_directory.empty() && mkdir(output_directory.c_str(), 0777) != 0 &&
+      errno != EEXIST) {
+    fprintf(stderr, _("Error while creating output directory %s: %s\n"),
+        output_directory.c_str(), strerror(errno));
+    return EXIT_FAILURE;
+  }
 
-  if (show_data_structure) {
-    int i = 0;
-    for (const auto& dg : mdf_file.get_data_groups()) {
-      printf("Data Group %d\n", ++i);
-      printf("\tMetadata Comment: \n%s\n", dg.get_metadata_comment().c_str());
+  if (!output_directory.empty()) {
+    auto conflict = mdf::find_output_conflict(files, output_directory, ".txt");
+    if (conflict.first) {
+      fprintf(stderr, _("%s and %s would be written to the same file %s.\n"),
+          conflict.first->name.c_str(), conflict.second->name.c_str(),
+          mdf::batch_output_path(conflict.second->name, output_directory, ".txt").c_str());
+      return EXIT_FAILURE;
+    }
+  }
 
-      int j = 0;
-      for (const auto& cg : dg.get_channel_groups()) {
-        printf("\tChannel Group %d\n", ++j);
+  std::mutex output_mutex;
+  std::size_t failed = mdf::run_batch(files, jobs,
+      [&](const mdf::batch_file& file) {
+        std::string text;
+        describe_file(file.name, text);
 
-        int k = 0;
-        for (const auto& ch : cg.get_channels()) {
-          printf("\tChannel %d: %s\n", ++k, ch.get_name().c_str());
-          if (ch.get_source_information()) {
-            printf("\t\tSource Name: %s\n", ch.get_source_information()->get_name().c_str());
-            printf("\t\tSource Path: %s\n", ch.get_source_information()->get_path().c_str());
-            printf("\t\tSource Metadata Comment: \n%s\n", ch.get_source_information()->get_metadata_comment().c_str());
+        if (!output_directory.empty()) {
+          std::string path = mdf::batch_output_path(file.name, output_directory, ".txt");
+          FILE* out = fopen(path.c_str(), "w");
+          if (!out) {
+            fprintf(stderr, _("%s: Error while opening output file %s: %s\n"),
+                file.name.c_str(), path.c_str(), strerror(errno));
+            return false;
           }
-          printf("\t\tMetadata Unit: %s\n", ch.get_metadata_unit().c_str());
-          printf("\t\tMetadata Comment: \n%s\n", ch.get_metadata_comment().c_str());
+          bool written = fwrite(text.data(), 1, text.size(), out) == text.size();
+          return fclose(out) == 0 && written;
         }
-      }
+
+        std::lock_guard<std::mutex> lock(output_mutex);
+        if (batch) {
+          printf("==> %s <==\n", file.name.c_str());
+        }
+        fwrite(text.data(), 1, text.size(), stdout);
+        if (batch) {
+          printf("\n");
+        }
+        fflush(stdout);
+        return true;
+      },
+      [](const mdf::batch_file& file, const char* what) {
+        fprintf(stderr, _("%s: Error while reading: %s\n"), file.name.c_str(), what);
+      });
+
+  if (failed != 0) {
+    if (batch) {
+      fprintf(stderr, _("%zu of %zu files could not be read.\n"), failed, files.size());
     }
+    return EXIT_FAILURE;
   }
-
   return EXIT_SUCCESS;
 }